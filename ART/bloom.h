@@ -0,0 +1,129 @@
+/*
+  Blocked Bloom filter ("Cache-, Hash- and Space-Efficient Bloom
+  Filters", Putze et al., WEA 2007), in the split-block layout: a key
+  maps to one 64-byte block and sets one bit in each of its eight 64-bit
+  words, so a probe touches a single cache line.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+class BloomFilter {
+ public:
+  static const unsigned BITS_PER_KEY = 10; // ~1% false positives at capacity
+  static const unsigned WORDS_PER_BLOCK = 8;
+  static const size_t BLOCK_SIZE = WORDS_PER_BLOCK * sizeof(uint64_t);
+
+  BloomFilter() : blocks(NULL), num_blocks(0) {}
+
+  ~BloomFilter() {
+    free(blocks);
+  }
+
+  // Empties the filter and sizes it for capacity keys.
+  void reset(uint64_t capacity) {
+    uint64_t n = (capacity * BITS_PER_KEY + BLOCK_SIZE * 8 - 1) / (BLOCK_SIZE * 8);
+    if (n == 0)
+      n = 1;
+    if (n != num_blocks) {
+      free(blocks);
+      void* ptr = NULL;
+      if (posix_memalign(&ptr, BLOCK_SIZE, n * BLOCK_SIZE) != 0) {
+	std::cout << "BLOOM FILTER ALLOCATION FAIL!\n";
+	exit(1);
+      }
+      blocks = (uint64_t*)ptr;
+      num_blocks = n;
+    }
+    memset(blocks, 0, num_blocks * BLOCK_SIZE);
+  }
+
+  // Frees the bits; contains() is true for every key until reset().
+  void release() {
+    free(blocks);
+    blocks = NULL;
+    num_blocks = 0;
+  }
+
+  // Moves the contents of other into this filter, leaving other empty.
+  void take(BloomFilter& other) {
+    free(blocks);
+    blocks = other.blocks;
+    num_blocks = other.num_blocks;
+    other.blocks = NULL;
+    other.num_blocks = 0;
+  }
+
+  inline void insert(const uint8_t key[], unsigned keyLength) {
+    if (!blocks)
+      return;
+    uint64_t h = hash(key, keyLength);
+    uint64_t* block = blockOf(h);
+    uint32_t x = (uint32_t)h;
+    for (unsigned i = 0; i < WORDS_PER_BLOCK; i++)
+      block[i] |= bitOf(x, i);
+  }
+
+  inline bool contains(const uint8_t key[], unsigned keyLength) const {
+    if (!blocks)
+      return true;
+    uint64_t h = hash(key, keyLength);
+    const uint64_t* block = blockOf(h);
+    uint32_t x = (uint32_t)h;
+    for (unsigned i = 0; i < WORDS_PER_BLOCK; i++)
+      if (!(block[i] & bitOf(x, i)))
+	return false;
+    return true;
+  }
+
+  uint64_t getMemory() const {
+    return num_blocks * BLOCK_SIZE;
+  }
+
+ private:
+  BloomFilter(const BloomFilter&);
+  BloomFilter& operator=(const BloomFilter&);
+
+  static inline uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static inline uint64_t hash(const uint8_t key[], unsigned keyLength) {
+    uint64_t h = keyLength;
+    unsigned i = 0;
+    for (; i + 8 <= keyLength; i += 8) {
+      uint64_t w;
+      memcpy(&w, key + i, 8);
+      h = mix(h ^ w);
+    }
+    if (i < keyLength) {
+      uint64_t w = 0;
+      memcpy(&w, key + i, keyLength - i);
+      h = mix(h ^ w);
+    }
+    return h;
+  }
+
+  // high half of the hash picks the block, the low half the bits
+  inline uint64_t* blockOf(uint64_t h) const {
+    return blocks + ((h >> 32) * num_blocks >> 32) * WORDS_PER_BLOCK;
+  }
+
+  static inline uint64_t bitOf(uint32_t x, unsigned word) {
+    static const uint32_t salt[WORDS_PER_BLOCK] = {
+      0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+      0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+    };
+    return 1ULL << ((x * salt[word]) >> 26);
+  }
+
+  uint64_t* blocks;
+  uint64_t num_blocks;
+};
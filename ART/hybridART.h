@@ -11,11 +11,22 @@
 #include <stdio.h>
 #include <assert.h>
 #include <sys/time.h>  // gettime
+#include <sys/mman.h>  // mmap
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <algorithm>   // std::random_shuffle
 
 #include <iostream>
 #include <vector>
 #include <deque>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "bloom.h"
+#include "keySearch.h"
+#include "nodeAllocator.h"
 
 //#define MERGE_TIME 1;
 
@@ -25,6 +36,8 @@ public:
   static const unsigned MERGE=1;
   static const unsigned MERGE_THOLD=1000000;
   static const unsigned MERGE_RATIO=10;
+  static const unsigned COMPACT_RATIO=2;
+  static const unsigned MERGE_PIECE_KEYS=64;
 
   // Constants for the node types
   static const int8_t NodeType4=0;
@@ -44,6 +57,11 @@ public:
   // demand
   static const unsigned maxPrefixLength=9;
 
+  // Key length 0 selects variable-length keys: zero-terminated strings
+  // of at most MaxVarKeyLength bytes, the zero included. The terminator
+  // keeps the keys prefix-free, and every key is as long as its string.
+  static const unsigned MaxVarKeyLength=255;
+
   static const unsigned NodeDItemTHold=227;
   //static const unsigned NodeDItemTHold=48;
   //static const unsigned UpperLevelTHold=10000;
@@ -279,6 +297,44 @@ public:
     return true;
   }
 
+  // Counts the leaves under n off left; false, part way through, once
+  // there are more than left.
+  bool leaves_within(Node* n, int& left) {
+    if (isLeaf(n))
+      return --left >= 0;
+    switch (n->type) {
+    case NodeType4: {
+      Node4* node=static_cast<Node4*>(n);
+      for (unsigned i = 0; i < node->count; i++)
+	if (!leaves_within(node->child[i], left))
+	  return false;
+      return true;
+    }
+    case NodeType16: {
+      Node16* node=static_cast<Node16*>(n);
+      for (unsigned i = 0; i < node->count; i++)
+	if (!leaves_within(node->child[i], left))
+	  return false;
+      return true;
+    }
+    case NodeType48: {
+      Node48* node=static_cast<Node48*>(n);
+      for (unsigned i = 0; i < node->count; i++)
+	if (!leaves_within(node->child[i], left))
+	  return false;
+      return true;
+    }
+    case NodeType256: {
+      Node256* node=static_cast<Node256*>(n);
+      for (unsigned i = 0; i < 256; i++)
+	if (node->child[i] && !leaves_within(node->child[i], left))
+	  return false;
+      return true;
+    }
+    }
+    return true;
+  }
+
   inline bool isInner(NodeStatic* n) {
     switch (n->type) {
     case NodeTypeD: {
@@ -345,6 +401,21 @@ public:
     return reinterpret_cast<uintptr_t>(node)&1;
   }
 
+  // A static child read from a node, as a pointer. In a tree mapped by
+  // load_static() inner children are file offsets, which are even and
+  // below the mapping size; pointers, leaves and NULL come back as they
+  // are, so resolving twice is harmless.
+  inline NodeStatic* resolve(NodeStatic* child) {
+    uintptr_t v = reinterpret_cast<uintptr_t>(child);
+    if (!(v&1) && v-1 < static_map_size)
+      return reinterpret_cast<NodeStatic*>(static_map+v);
+    return child;
+  }
+
+  inline Node* resolve(Node* child) {
+    return child;
+  }
+
   inline uint8_t flipSign(uint8_t keyByte) {
     // Flip the sign bit, enables signed SSE comparison of unsigned values, used by Node16
     return keyByte^128;
@@ -358,12 +429,30 @@ public:
 
   //huanchen
   inline void loadKey(uintptr_t tid, uint8_t key[], unsigned keyLength) {
-    if (keyLength == 8)
+    if (var_keys) {
+      // up to the terminating zero, zero-padded like a fixed-size key
+      const uint8_t* src = reinterpret_cast<const uint8_t*>(tid);
+      unsigned i = 0;
+      for (; i < keyLength && src[i]; i++)
+	key[i] = src[i];
+      memset(key + i, 0, keyLength - i);
+    }
+    else if (keyLength == 8)
       reinterpret_cast<uint64_t*>(key)[0]=__builtin_bswap64(tid);
     else
       memcpy(reinterpret_cast<void*>(key), (const void*)tid, keyLength);
   }
 
+  // Length of a variable-length key, its terminating zero included.
+  inline unsigned varKeyLength(const uint8_t key[]) {
+    return strnlen((const char*)key, key_length - 1) + 1;
+  }
+
+  // Bytes that identify key, for the filter.
+  inline unsigned keyBytes(const uint8_t key[]) {
+    return var_keys ? varKeyLength(key) : key_length;
+  }
+
   // This address is used to communicate that search failed
   Node* nullNode=NULL;
   NodeStatic* nullNode_static=NULL;
@@ -424,47 +513,17 @@ public:
 
     case NodeTypeD: {
       NodeD* node = static_cast<NodeD*>(n);
-
-      if (node->count < 5) {
-	for (unsigned i = 0; i < node->count; i++)
-	  if (node->key()[i] == flipSign(keyByte))
-	    return &node->child()[i];
-	return &nullNode_static;
-      }
-
-      for (unsigned i = 0; i < node->count; i += 16) {
-	__m128i cmp=_mm_cmpeq_epi8(_mm_set1_epi8(flipSign(keyByte)),_mm_loadu_si128(reinterpret_cast<__m128i*>(node->key(i))));
-	unsigned bitfield;
-	if (i + 16 >= node->count)
-	  bitfield =_mm_movemask_epi8(cmp)&((1<<node->count)-1);
-	else
-	  bitfield =_mm_movemask_epi8(cmp);
-	if (bitfield)
-	  return &node->child(i)[ctz(bitfield)]; 
-      }
+      int pos = KeySearch::find(node->key(), node->count, flipSign(keyByte));
+      if (pos >= 0)
+	return &node->child()[pos];
       return &nullNode_static;
     }
 
     case NodeTypeDP: {
       NodeDP* node = static_cast<NodeDP*>(n);
-
-      if (node->count < 5) {
-	for (unsigned i = 0; i < node->count; i++)
-	  if (node->key()[i] == flipSign(keyByte))
-	    return &node->child()[i];
-	return &nullNode_static;
-      }
-
-      for (unsigned i = 0; i < node->count; i += 16) {
-	__m128i cmp=_mm_cmpeq_epi8(_mm_set1_epi8(flipSign(keyByte)),_mm_loadu_si128(reinterpret_cast<__m128i*>(node->key(i))));
-	unsigned bitfield;
-	if (i + 16 >= node->count)
-	  bitfield =_mm_movemask_epi8(cmp)&((1<<node->count)-1);
-	else
-	  bitfield =_mm_movemask_epi8(cmp);
-	if (bitfield)
-	  return &node->child(i)[ctz(bitfield)]; 
-      }
+      int pos = KeySearch::find(node->key(), node->count, flipSign(keyByte));
+      if (pos >= 0)
+	return &node->child()[pos];
       return &nullNode_static;
     }
 
@@ -477,6 +536,14 @@ public:
       NodeFP* node = static_cast<NodeFP*>(n);
       return &(node->child()[keyByte]);
     }
+
+    case NodeTypeU: {
+      NodeU* node = static_cast<NodeU*>(n);
+      int pos = KeySearch::find(node->key(), node->count, keyByte);
+      if (pos >= 0)
+	return &node->child()[pos];
+      return &nullNode_static;
+    }
     }
     std::cout << "throw_static, type = " << (uint64_t)n->type <<"\n";
     throw; // Unreachable
@@ -520,6 +587,7 @@ public:
 
   //huanchen-static
   inline NodeStatic* minimum(NodeStatic* node) {
+    node=resolve(node);
     if (!node)
       return NULL;
 
@@ -590,6 +658,7 @@ public:
 
   //huanchen-static
   inline NodeStatic* maximum(NodeStatic* node) {
+    node=resolve(node);
     if (!node)
       return NULL;
 
@@ -627,7 +696,7 @@ public:
     // Check if the key of the leaf is equal to the searched key
     if (depth!=keyLength) {
       uint8_t leafKey[maxKeyLength];
-      loadKey(getLeafValue(leaf),leafKey);
+      loadKey(getLeafValue(leaf),leafKey,keyLength);
       for (unsigned i=depth;i<keyLength;i++)
 	if (leafKey[i]!=key[i])
 	  return false;
@@ -639,7 +708,7 @@ public:
   inline bool leafMatches(NodeStatic* leaf,uint8_t key[],unsigned keyLength,unsigned depth,unsigned maxKeyLength) {
     if (depth!=keyLength) {
       uint8_t leafKey[maxKeyLength];
-      loadKey(getLeafValue(leaf),leafKey);
+      loadKey(getLeafValue(leaf),leafKey,keyLength);
       for (unsigned i=depth;i<keyLength;i++)
 	if (leafKey[i]!=key[i])
 	  return false;
@@ -654,8 +723,8 @@ public:
       for (pos=0;pos<maxPrefixLength;pos++)
 	if (key[depth+pos]!=node->prefix[pos])
 	  return pos;
-      uint8_t minKey[maxKeyLength];
-      loadKey(getLeafValue(minimum(node)),minKey);
+      uint8_t minKey[key_length];
+      loadKey(getLeafValue(minimum(node)),minKey,key_length);
       for (;pos<node->prefixLength;pos++)
 	if (key[depth+pos]!=minKey[depth+pos])
 	  return pos;
@@ -680,8 +749,8 @@ public:
 	for (pos = 0; pos < maxPrefixLength; pos++)
 	  if (key[depth+pos] != n->prefix()[pos])
 	    return pos;
-	uint8_t minKey[maxKeyLength];
-	loadKey(getLeafValue(minimum(n)),minKey);
+	uint8_t minKey[key_length];
+	loadKey(getLeafValue(minimum(n)),minKey,key_length);
 	for (; pos< n->prefixLength; pos++)
 	  if (key[depth+pos] != minKey[depth+pos])
 	    return pos;
@@ -702,8 +771,8 @@ public:
 	for (pos = 0; pos < maxPrefixLength; pos++)
 	  if (key[depth+pos] != n->prefix()[pos])
 	    return pos;
-	uint8_t minKey[maxKeyLength];
-	loadKey(getLeafValue(minimum(n)),minKey);
+	uint8_t minKey[key_length];
+	loadKey(getLeafValue(minimum(n)),minKey,key_length);
 	for (; pos< n->prefixLength; pos++)
 	  if (key[depth+pos] != minKey[depth+pos])
 	    return pos;
@@ -785,6 +854,7 @@ public:
 	} else
 	  skippedPrefix=true;
 	depth += n->prefixLength;
+	break;
       }
       case NodeTypeFP: {
 	NodeFP* n = static_cast<NodeFP*>(node);
@@ -798,7 +868,7 @@ public:
       }
       }
 
-      node=*findChild(node,key[depth]);
+      node=resolve(*findChild(node,key[depth]));
       depth++;
     }
     return NULL;
@@ -829,6 +899,44 @@ public:
   //huanchen
   //************************************************************************************************
 
+  // Key of any leaf below n, for checking prefixes longer than
+  // maxPrefixLength (iterator version; hybridART_OLC validates).
+  inline bool anyLeafKey(Node* n, uint8_t key[]) {
+    Node* leaf = minimum(n);
+    if (!leaf || !isLeaf(leaf))
+      return false;
+    loadKey(getLeafValue(leaf), key, key_length);
+    return true;
+  }
+
+  inline bool anyLeafKey(NodeStatic* n, uint8_t key[]) {
+    NodeStatic* leaf = minimum(n);
+    if (!leaf || !isLeaf(leaf))
+      return false;
+    loadKey(getLeafValue(leaf), key, key_length);
+    return true;
+  }
+
+  // Node version hooks for hybridART_Iterator. Nothing changes under a
+  // scan of the single-threaded tree; hybridART_OLC checks real versions.
+  static inline bool readLock(Node* n, uint64_t& v) {
+    v = 0;
+    return true;
+  }
+
+  static inline bool validate(Node* n, uint64_t v) {
+    return true;
+  }
+
+  static inline bool readLock(NodeStatic* n, uint64_t& v) {
+    v = 0;
+    return true;
+  }
+
+  static inline bool validate(NodeStatic* n, uint64_t v) {
+    return true;
+  }
+
   inline Node* minimum_recordPath(Node* node) {
     if (!node)
       return NULL;
@@ -872,6 +980,7 @@ public:
 
   //huanchen-static
   inline NodeStatic* minimum_recordPath(NodeStatic* node) {
+    node=resolve(node);
     if (!node)
       return NULL;
 
@@ -995,30 +1104,28 @@ public:
     switch (n->type) {
     case NodeTypeD: {
       NodeD* node=static_cast<NodeD*>(n);
-      for (unsigned i=0;i<node->count;i++) {
-	if (node->key()[i]>=keyByte) {
-	  nc.cursor = i;
-	  node_stack_static.push_back(nc);
-	  if (node->key()[i]==keyByte)
-	    return node->child()[i];
-	  else
-	    return minimum_recordPath(node->child()[i]);
-	}
+      unsigned i = KeySearch::lowerBound<true>(node->key(), node->count, flipSign(keyByte));
+      if (i < node->count) {
+	nc.cursor = i;
+	node_stack_static.push_back(nc);
+	if (node->key()[i]==flipSign(keyByte))
+	  return node->child()[i];
+	else
+	  return minimum_recordPath(node->child()[i]);
       }
       node_stack_static.pop_back();
       return minimum_recordPath(nextSlot_static());
     }
     case NodeTypeDP: {
       NodeDP* node=static_cast<NodeDP*>(n);
-      for (unsigned i=0;i<node->count;i++) {
-	if (node->key()[i]>=keyByte) {
-	  nc.cursor = i;
-	  node_stack_static.push_back(nc);
-	  if (node->key()[i]==keyByte)
-	    return node->child()[i];
-	  else
-	    return minimum_recordPath(node->child()[i]);
-	}
+      unsigned i = KeySearch::lowerBound<true>(node->key(), node->count, flipSign(keyByte));
+      if (i < node->count) {
+	nc.cursor = i;
+	node_stack_static.push_back(nc);
+	if (node->key()[i]==flipSign(keyByte))
+	  return node->child()[i];
+	else
+	  return minimum_recordPath(node->child()[i]);
       }
       node_stack_static.pop_back();
       return minimum_recordPath(nextSlot_static());
@@ -1076,8 +1183,8 @@ public:
 	    return -1;
 	}
       }
-      uint8_t minKey[maxKeyLength];
-      loadKey(getLeafValue(minimum(node)),minKey);
+      uint8_t minKey[key_length];
+      loadKey(getLeafValue(minimum(node)),minKey,key_length);
       for (;pos<node->prefixLength;pos++) {
 	if (key[depth+pos]!=minKey[depth+pos]) {
 	  if (key[depth+pos]>minKey[depth+pos])
@@ -1116,8 +1223,8 @@ public:
 	      return -1;
 	  }
 	}
-	uint8_t minKey[maxKeyLength];
-	loadKey(getLeafValue(minimum(node)),minKey);
+	uint8_t minKey[key_length];
+	loadKey(getLeafValue(minimum(node)),minKey,key_length);
 	for (;pos<node->prefixLength;pos++) {
 	  if (key[depth+pos]!=minKey[depth+pos]) {
 	    if (key[depth+pos]>minKey[depth+pos])
@@ -1149,8 +1256,8 @@ public:
 	      return -1;
 	  }
 	}
-	uint8_t minKey[maxKeyLength];
-	loadKey(getLeafValue(minimum(node)),minKey);
+	uint8_t minKey[key_length];
+	loadKey(getLeafValue(minimum(node)),minKey,key_length);
 	for (;pos<node->prefixLength;pos++) {
 	  if (key[depth+pos]!=minKey[depth+pos]) {
 	    if (key[depth+pos]>minKey[depth+pos])
@@ -1225,7 +1332,7 @@ public:
 	return minimum_recordPath(node);
       }
 
-      node = findChild_recordPath(node,key[depth]);
+      node = resolve(findChild_recordPath(node,key[depth]));
       depth++;
     }
 
@@ -1430,9 +1537,9 @@ public:
     return false;
   }
 
-  inline void upsert(Node* node,uint8_t key[],uintptr_t value,unsigned keyLength,unsigned depth,unsigned maxKeyLength) {
+  inline void upsert(Node* node,Node** nodeRef,uint8_t key[],uintptr_t value,unsigned keyLength,unsigned depth,unsigned maxKeyLength) {
     if (!update(node, key, value, keyLength, depth, maxKeyLength))
-      insert(node, &node, key, depth, value, maxKeyLength);
+      insert(node, nodeRef, key, depth, value, maxKeyLength);
   }
 
   unsigned min(unsigned a,unsigned b) {
@@ -1456,7 +1563,7 @@ public:
 
     if (isLeaf(node)) {
       // Replace leaf with Node4 and store both leaves in it
-      uint8_t existingKey[maxKeyLength];
+      uint8_t existingKey[key_length];
       loadKey(getLeafValue(node),existingKey,key_length);
       unsigned newPrefixLength=0;
       //huanchen
@@ -1465,7 +1572,7 @@ public:
       if (depth + newPrefixLength >= maxKeyLength)
 	return;
 
-      Node4* newNode=new Node4();
+      Node4* newNode=allocNode<Node4>();
       memory += sizeof(Node4); //h
       node4_count++; //h
       newNode->prefixLength=newPrefixLength;
@@ -1483,7 +1590,7 @@ public:
       unsigned mismatchPos=prefixMismatch(node,key,depth,maxKeyLength);
       if (mismatchPos!=node->prefixLength) {
 	// Prefix differs, create new node
-	Node4* newNode=new Node4();
+	Node4* newNode=allocNode<Node4>();
 	memory += sizeof(Node4); //h
 	node4_count++; //h
 	*nodeRef=newNode;
@@ -1496,8 +1603,8 @@ public:
 	  memmove(node->prefix,node->prefix+mismatchPos+1,min(node->prefixLength,maxPrefixLength));
 	} else {
 	  node->prefixLength-=(mismatchPos+1);
-	  uint8_t minKey[maxKeyLength];
-	  loadKey(getLeafValue(minimum(node)),minKey);
+	  uint8_t minKey[key_length];
+	  loadKey(getLeafValue(minimum(node)),minKey,key_length);
 	  insertNode4(newNode,nodeRef,minKey[depth+mismatchPos],node);
 	  memmove(node->prefix,minKey+depth+mismatchPos+1,min(node->prefixLength,maxPrefixLength));
 	}
@@ -1539,7 +1646,7 @@ public:
       node->count++;
     } else {
       // Grow to Node16
-      Node16* newNode=new Node16();
+      Node16* newNode=allocNode<Node16>();
       memory += sizeof(Node16); //h
       node16_count++; //h
       *nodeRef=newNode;
@@ -1548,7 +1655,7 @@ public:
       for (unsigned i=0;i<4;i++)
 	newNode->key[i]=flipSign(node->key[i]);
       memcpy(newNode->child,node->child,node->count*sizeof(uintptr_t));
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node4); //h
       node4_count--; //h
       return insertNode16(newNode,nodeRef,keyByte,child);
@@ -1570,7 +1677,7 @@ public:
       node->count++;
     } else {
       // Grow to Node48
-      Node48* newNode=new Node48();
+      Node48* newNode=allocNode<Node48>();
       memory += sizeof(Node48); //h
       node48_count++; //h
       *nodeRef=newNode;
@@ -1579,7 +1686,7 @@ public:
 	newNode->childIndex[flipSign(node->key[i])]=i;
       copyPrefix(node,newNode);
       newNode->count=node->count;
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node16); //h
       node16_count--; //h
       return insertNode48(newNode,nodeRef,keyByte,child);
@@ -1598,7 +1705,7 @@ public:
       node->count++;
     } else {
       // Grow to Node256
-      Node256* newNode=new Node256();
+      Node256* newNode=allocNode<Node256>();
       memory += sizeof(Node256); //h
       node256_count++; //h
       for (unsigned i=0;i<256;i++)
@@ -1607,7 +1714,7 @@ public:
       newNode->count=node->count;
       copyPrefix(node,newNode);
       *nodeRef=newNode;
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node48); //h
       node48_count--; //h
       return insertNode256(newNode,nodeRef,keyByte,child);
@@ -1681,7 +1788,7 @@ public:
 	child->prefixLength+=node->prefixLength+1;
       }
       *nodeRef=child;
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node4); //h
       node4_count--; //h
     }
@@ -1696,7 +1803,7 @@ public:
 
     if (node->count==3) {
       // Shrink to Node4
-      Node4* newNode=new Node4();
+      Node4* newNode=allocNode<Node4>();
       memory += sizeof(Node4); //h
       node4_count++; //h
       newNode->count=node->count;
@@ -1705,7 +1812,7 @@ public:
 	newNode->key[i]=flipSign(node->key[i]);
       memcpy(newNode->child,node->child,sizeof(uintptr_t)*4);
       *nodeRef=newNode;
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node16); //h
       node16_count--; //h
     }
@@ -1719,7 +1826,7 @@ public:
 
     if (node->count==12) {
       // Shrink to Node16
-      Node16 *newNode=new Node16();
+      Node16 *newNode=allocNode<Node16>();
       memory += sizeof(Node16); //h
       node16_count++; //h
       *nodeRef=newNode;
@@ -1731,7 +1838,7 @@ public:
 	  newNode->count++;
 	}
       }
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node48); //h
       node48_count--; //h
     }
@@ -1744,7 +1851,7 @@ public:
 
     if (node->count==37) {
       // Shrink to Node48
-      Node48 *newNode=new Node48();
+      Node48 *newNode=allocNode<Node48>();
       memory += sizeof(Node48); //h
       node48_count++; //h
       *nodeRef=newNode;
@@ -1756,7 +1863,7 @@ public:
 	  newNode->count++;
 	}
       }
-      delete node;
+      freeNode(node);
       memory -= sizeof(Node256); //h
       node256_count--; //h
     }
@@ -1884,7 +1991,7 @@ public:
     std::deque<NodeStatic*> node_queue;
     node_queue.push_back(r);
     while (!node_queue.empty()) {
-      NodeStatic* n = node_queue.front();
+      NodeStatic* n = resolve(node_queue.front());
       if (!isLeaf(n)) {
 	int leaf_count = 0;
 	switch (n->type) {
@@ -2338,33 +2445,114 @@ public:
     return 0;
   }
 
-  inline size_t get_NodeU_size(NodeStatic* n) {
-    switch (n->type) {
-    case NodeTypeD: {
-      NodeD* node = static_cast<NodeD*>(n);
-      return sizeof(NodeU) + node->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-    }
-    case NodeTypeDP: {
-      NodeDP* node = static_cast<NodeDP*>(n);
-      return sizeof(NodeU) + node->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-    }
-    case NodeTypeF: {
-      NodeF* node = static_cast<NodeF*>(n);
-      return sizeof(NodeU) + node->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-    }
-    case NodeTypeFP: {
-      NodeFP* node = static_cast<NodeFP*>(n);
-      return sizeof(NodeU) + node->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-    }
-    }
-    return 0;
+  // A scratch NodeU for count children, in malloc'ed memory that
+  // NodeU_to_NodeStatic() frees.
+  inline NodeU* new_NodeU(uint16_t count) {
+    size_t size = sizeof(NodeU) + count * (sizeof(uint8_t) + sizeof(NodeStatic*));
+    return new(malloc(size)) NodeU(count);
+  }
+
+
+  // Dynamic nodes come from node_pool. Static nodes are only ever made by
+  // a merge, which makes them in merge_arena (see build_static()).
+  template<class T>
+  inline T* allocNode() {
+    return new(node_pool.allocate(sizeof(T))) T();
+  }
+
+  inline void freeNode(Node* n) {
+    node_pool.deallocate(n, node_size(n));
+  }
+
+  inline void* allocNodeStatic(size_t size) {
+    return merge_arena.allocate(size);
+  }
+
+  // Frees a dynamic node that a merge has converted. A node from the pool
+  // goes with its whole pool once the merge is over; only nodes that do
+  // not come from the pool (hybridART_OLC) are collected for their owner.
+  inline void release(Node* n) {
+    if (!pooled_nodes)
+      retired_nodes.push_back(n);
+  }
+
+  // Copies the static tree rooted at n into arena, depth first.
+  NodeStatic* copy_static(NodeStatic* n, NodeArena& arena) {
+    size_t size = node_size(n);
+    NodeStatic* n_copy = (NodeStatic*)arena.allocate(size);
+    memcpy(n_copy, n, size);
+    NodeStatic** child;
+    unsigned count;
+    static_children(n_copy, child, count);
+    for (unsigned i = 0; i < count; i++)
+      if (child[i] && !isLeaf(child[i]))
+	child[i] = copy_static(resolve(child[i]), arena);
+    return n_copy;
   }
 
+  // Copies the nodes of the tree rooted at n that the running merge made,
+  // the ones in merge_arena, into arena, depth first. Any other node
+  // roots a subtree that the merge kept from the old static tree; it
+  // stays where it is, shared by the old and the merged tree.
+  NodeStatic* copy_merged(NodeStatic* n, NodeArena& arena) {
+    if (!merge_arena.owns(n))
+      return n;
+    size_t size = node_size(n);
+    NodeStatic* n_copy = (NodeStatic*)arena.allocate(size);
+    memcpy(n_copy, n, size);
+    NodeStatic** child;
+    unsigned count;
+    static_children(n_copy, child, count);
+    for (unsigned i = 0; i < count; i++)
+      if (child[i] && !isLeaf(child[i]))
+	child[i] = copy_merged(child[i], arena);
+    return n_copy;
+  }
+
+  // static_arena keeps the nodes that merges have replaced until a merge
+  // compacts it, copying the whole tree so that the old arena can go.
+  // That happens once static_arena holds COMPACT_RATIO times the bytes
+  // of the live nodes, so a merge copies, on average, about as much as
+  // it replaces.
+  inline bool compact_static() {
+    return static_arena.getMemory() > COMPACT_RATIO * static_memory;
+  }
 
-  inline NodeStatic* convert_to_static() {
-    if (!root) return NULL;
+  // Adds the nodes of the merged tree to static_arena once its root is
+  // installed; after a compacting merge they replace all others.
+  inline void adopt_merged() {
+    if (merge_compacts)
+      static_arena.take(merged_arena);
+    else
+      static_arena.append(merged_arena);
+  }
+
+  // Converts the dynamic tree rooted at tree_root, merges it with
+  // old_static and copies the nodes the merge made into merged_arena.
+  // The conversion and the merge leave the trees they read intact and
+  // make their nodes in merge_arena, which is dropped at the end. The
+  // merged tree shares the subtrees it kept with old_static, unless the
+  // merge compacts (see compact_static()) and copies all of it.
+  NodeStatic* build_static(Node* tree_root, NodeStatic* old_static) {
+    merge_compacts = compact_static();
+    NodeStatic* root_s;
+    if (merge_threads > 1 && build_static_parallel(tree_root, old_static, root_s))
+      return root_s;
+    root_s = convert_tree_to_static(tree_root);
+    if (!root_s)
+      root_s = old_static;
+    else if (old_static)
+      root_s = merge_nodes(root_s, old_static, 0, NULL, 0);
+    if (root_s)
+      root_s = merge_compacts ? copy_static(root_s, merged_arena) : copy_merged(root_s, merged_arena);
+    merge_arena.release();
+    return root_s;
+  }
 
-    Node* n = root;
+  inline NodeStatic* convert_tree_to_static(Node* tree_root) {
+    if (!tree_root) return NULL;
+
+    Node* n = tree_root;
     NodeStatic* n_new = NULL;
     NodeStatic* n_new_parent = NULL;
     NodeStatic* returnNode = NULL;
@@ -2381,7 +2569,7 @@ public:
 	if ((n->count > NodeDItemTHold) || isInner(n) || (node_count < UpperLevelTHold)) {
 	  if (n->prefixLength) {
 	    size_t size = sizeof(NodeFP) + n->prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
-	    void* ptr = malloc(size);
+	    void* ptr = allocNodeStatic(size);
 	    NodeFP* n_static = new(ptr) NodeFP(n->count, n->prefixLength);
 	    nodeFP_count++; //h
 	    Node_to_NodeFP(n, n_static);
@@ -2392,7 +2580,7 @@ public:
 	  }
 	  else {
 	    size_t size = sizeof(NodeF);
-	    void* ptr = malloc(size);
+	    void* ptr = allocNodeStatic(size);
 	    NodeF* n_static = new(ptr) NodeF(n->count);
 	    nodeF_count++; //h
 	    Node_to_NodeF(n, n_static);
@@ -2405,7 +2593,7 @@ public:
 	else {
 	  if (n->prefixLength) {
 	    size_t size = sizeof(NodeDP) + n->prefixLength * sizeof(uint8_t) + n->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	    void* ptr = malloc(size);
+	    void* ptr = allocNodeStatic(size);
 	    NodeDP* n_static = new(ptr) NodeDP(n->count, n->prefixLength);
 	    nodeDP_count++; //h
 	    Node_to_NodeDP(n, n_static);
@@ -2416,7 +2604,7 @@ public:
 	  }
 	  else {
 	    size_t size = sizeof(NodeD) + n->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	    void* ptr = malloc(size);
+	    void* ptr = allocNodeStatic(size);
 	    NodeD* n_static = new(ptr) NodeD(n->count);
 	    nodeD_count++; //h
 	    Node_to_NodeD(n, n_static);
@@ -2510,7 +2698,7 @@ public:
 	  }
 	} while (next_parent);
 
-	delete node_queue.front();
+	release(node_queue.front());
 	node_queue.pop_front();
       }
     }
@@ -2521,52 +2709,52 @@ public:
     if ((n->count > NodeDItemTHold) || isInner(n)) {
       if (n->prefixLength) {
 	size_t size = sizeof(NodeFP) + n->prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeFP* n_static = new(ptr) NodeFP(n->count, n->prefixLength);
 	nodeFP_count++; //h
 	Node_to_NodeFP(n, n_static);
 	for (unsigned i = 0; i < 256; i++)
 	  if ((n_static->child()[i]) && (!isLeaf(n_static->child()[i])))
 	    n_static->child()[i] = convert_to_static((Node*)n_static->child()[i]);
-	delete n;
+	release(n);
 	return n_static;
       }
       else {
 	size_t size = sizeof(NodeF);
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeF* n_static = new(ptr) NodeF(n->count);
 	nodeF_count++; //h
 	Node_to_NodeF(n, n_static);
 	for (unsigned i = 0; i < 256; i++)
 	  if ((n_static->child[i]) && (!isLeaf(n_static->child[i])))
 	    n_static->child[i] = convert_to_static((Node*)n_static->child[i]);
-	delete n;
+	release(n);
 	return n_static;
       }
     }
     else {
       if (n->prefixLength) {
 	size_t size = sizeof(NodeDP) + n->prefixLength * sizeof(uint8_t) + n->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeDP* n_static = new(ptr) NodeDP(n->count, n->prefixLength);
 	nodeDP_count++; //h
 	Node_to_NodeDP(n, n_static);
 	for (unsigned i = 0; i < n_static->count; i++)
 	  if (!isLeaf(n_static->child()[i]))
 	    n_static->child()[i] = convert_to_static((Node*)n_static->child()[i]);
-	delete n;
+	release(n);
 	return n_static;
       }
       else {
 	size_t size = sizeof(NodeD) + n->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeD* n_static = new(ptr) NodeD(n->count);
 	nodeD_count++; //h
 	Node_to_NodeD(n, n_static);
 	for (unsigned i = 0; i < n_static->count; i++)
 	  if (!isLeaf(n_static->child()[i]))
 	    n_static->child()[i] = convert_to_static((Node*)n_static->child()[i]);
-	delete n;
+	release(n);
 	return n_static;
       }
     }
@@ -2645,7 +2833,7 @@ public:
     if ((n->count > NodeDItemTHold) || isInner(n_s)) {
       if (n->prefixLength) {
 	size_t size = sizeof(NodeFP) + n->prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeFP* n_static = new(ptr) NodeFP(n->count, n->prefixLength);
 	nodeFP_count++; //h
 	for (unsigned i = 0; i < n->prefixLength; i++)
@@ -2657,7 +2845,7 @@ public:
       }
       else {
 	size_t size = sizeof(NodeF);
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeF* n_static = new(ptr) NodeF(n->count);
 	nodeF_count++; //h
 	for (unsigned i = 0; i < n->count; i++)
@@ -2669,13 +2857,13 @@ public:
     else {
       if (n->prefixLength) {
 	size_t size = sizeof(NodeDP) + n->prefixLength * sizeof(uint8_t) + n->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeDP* n_static = new(ptr) NodeDP(n->count, n->prefixLength);
 	nodeDP_count++; //h
 	for (unsigned i = 0; i < n->prefixLength; i++)
 	  n_static->prefix()[i] = n->prefix[i];
 	for (unsigned i = 0; i < n->count; i++) {
-	  n_static->key()[i] = n->key()[i];
+	  n_static->key()[i] = flipSign(n->key()[i]);
 	  n_static->child()[i] = n->child()[i];
 	}
 	free(n);
@@ -2683,11 +2871,11 @@ public:
       }
       else {
 	size_t size = sizeof(NodeD) + n->count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeD* n_static = new(ptr) NodeD(n->count);
 	nodeD_count++; //h
 	for (unsigned i = 0; i < n->count; i++) {
-	  n_static->key()[i] = n->key()[i];
+	  n_static->key()[i] = flipSign(n->key()[i]);
 	  n_static->child()[i] = n->child()[i];
 	}
 	free(n);
@@ -2698,7 +2886,7 @@ public:
 
   inline NodeF* NodeD_to_NodeF(NodeD* nd) {
     size_t size = sizeof(NodeF);
-    void* ptr = malloc(size);
+    void* ptr = allocNodeStatic(size);
     NodeF* nf = new(ptr) NodeF(nd->count);
     nodeF_count++; //h
     static_memory += size; //h
@@ -2706,7 +2894,6 @@ public:
     for (unsigned i = 0; i < nd->count; i++)
       nf->child[flipSign(nd->key()[i])] = nd->child()[i];
 
-    free(nd);
     nodeD_count--; //h
     static_memory -= node_size(nd); //h
     return nf;
@@ -2714,7 +2901,7 @@ public:
 
   inline NodeFP* NodeDP_to_NodeFP(NodeDP* nd) {
     size_t size = sizeof(NodeFP) + nd->prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
-    void* ptr = malloc(size);
+    void* ptr = allocNodeStatic(size);
     NodeFP* nf = new(ptr) NodeFP(nd->count, nd->prefixLength);
     nodeFP_count++; //h
     static_memory += size; //h
@@ -2725,16 +2912,13 @@ public:
     for (unsigned i = 0; i < nd->count; i++)
       nf->child()[flipSign(nd->key()[i])] = nd->child()[i];
 
-    free(nd);
     nodeDP_count--; //h
     static_memory -= node_size(nd); //h
     return nf;
   }
 
   NodeU* create_1_item_NodeU(uint8_t key, NodeStatic* value) {
-    size_t size_n = sizeof(NodeU) + sizeof(uint8_t) + sizeof(NodeStatic*);
-    void* ptr = malloc(size_n);
-    NodeU* n = new(ptr) NodeU(1);
+    NodeU* n = new_NodeU(1);
     n->prefixLength = 0;
     n->key()[0] = key;
     n->child()[0] = value;
@@ -2747,9 +2931,7 @@ public:
     if (m->type == NodeTypeU)
       mu = static_cast<NodeU*>(m);
     else {
-      size_t size_m = get_NodeU_size(m);
-      void* ptr = malloc(size_m);
-      mu = new(ptr) NodeU(node_count(m));
+      mu = new_NodeU(node_count(m));
       NodeStatic_to_NodeU(m, mu);
       static_memory -= node_size(m); //h
       if (m->type == NodeTypeD)
@@ -2760,16 +2942,13 @@ public:
 	nodeF_count--;
       else if (m->type == NodeTypeFP)
 	nodeFP_count--;
-      free(m);
     }
 
     NodeU* nu;
     if (n->type == NodeTypeU)
       nu = static_cast<NodeU*>(n);
     else {
-      size_t size_n = get_NodeU_size(n);
-      void* ptr = malloc(size_n);
-      nu = new(ptr) NodeU(node_count(n));
+      nu = new_NodeU(node_count(n));
       NodeStatic_to_NodeU(n, nu);
       static_memory -= node_size(n); //h
       if (n->type == NodeTypeD)
@@ -2780,7 +2959,6 @@ public:
 	nodeF_count--;
       else if (n->type == NodeTypeFP)
 	nodeFP_count--;
-      free(n);
     }
 
     //==================handle prefix==================================
@@ -2795,7 +2973,7 @@ public:
 	p++;
       
       //copy inherited prefix
-      uint8_t pf[maxPrefixLength];
+      uint8_t pf[key_length];
       for (int i = 0; i < prefixLength; i++)
 	pf[i] = prefix[i];
 
@@ -2854,7 +3032,7 @@ public:
       uint16_t new_node_count16 = (new_node_count == 0) ? 256 : new_node_count;
       if (prefixLength > 0) {
 	size_t size = sizeof(NodeFP) + prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeFP* n_static = new(ptr) NodeFP(new_node_count16, prefixLength);
 	nodeFP_count++; //h
 	static_memory += size; //h
@@ -2895,7 +3073,7 @@ public:
 		num_items_static--;
 	      }
 	      else {
-		uint8_t pf[maxPrefixLength];
+		uint8_t pf[key_length];
 		for (int k = 0; k < p; k++)
 		  pf[k] = leaf_key_m[depth + 1 + k];
 
@@ -2952,7 +3130,7 @@ public:
       }
       else {
 	size_t size = sizeof(NodeF);
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeF* n_static = new(ptr) NodeF(new_node_count16);
 	nodeF_count++; //h
 	static_memory += size; //h
@@ -2991,7 +3169,7 @@ public:
 		num_items_static--;
 	      }
 	      else {
-		uint8_t pf[maxPrefixLength];
+		uint8_t pf[key_length];
 		for (int k = 0; k < p; k++)
 		  pf[k] = leaf_key_m[depth + 1 + k];
 
@@ -3050,7 +3228,7 @@ public:
     else {
       if (prefixLength > 0) {
 	size_t size = sizeof(NodeDP) + prefixLength * sizeof(uint8_t) + new_node_count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeDP* n_static = new(ptr) NodeDP(new_node_count, prefixLength);
 	nodeDP_count++; //h
 	static_memory += size; //h
@@ -3100,7 +3278,7 @@ public:
 		num_items_static--;
 	      }
 	      else {
-		uint8_t pf[maxPrefixLength];
+		uint8_t pf[key_length];
 		for (int k = 0; k < p; k++)
 		  pf[k] = leaf_key_m[depth + 1 + k];
 
@@ -3168,7 +3346,7 @@ public:
       }
       else {
 	size_t size = sizeof(NodeD) + new_node_count * (sizeof(uint8_t) + sizeof(NodeStatic*));
-	void* ptr = malloc(size);
+	void* ptr = allocNodeStatic(size);
 	NodeD* n_static = new(ptr) NodeD(new_node_count);
 	nodeD_count++; //h
 	static_memory += size; //h
@@ -3210,7 +3388,7 @@ public:
 		num_items_static--;
 	      }
 	      else {
-		uint8_t pf[maxPrefixLength];
+		uint8_t pf[key_length];
 		for (int k = 0; k < p; k++)
 		  pf[k] = leaf_key_m[depth + 1 + k];
 
@@ -3292,20 +3470,21 @@ public:
     double start = getnow();
     std::cout << (memory + static_memory)/1000000 << " ";
 #endif
+    unmap_static();
     num_items_static += num_items;
-    NodeStatic* root_s = convert_to_static();
-    if (!static_root)
-      static_root = root_s;
-    else
-      static_root = merge_nodes(root_s, static_root, 0, NULL, 0);
+    static_root = build_static(root, static_root);
+    adopt_merged();
 
     root = NULL;
+    node_pool.release();
     memory = 0;
     num_items = 0;
     node4_count = 0;
     node16_count = 0;
     node48_count = 0;
     node256_count = 0;
+    if (use_filter)
+      filter.reset(filter_capacity());
 
 #ifdef MERGE_TIME
     double end = getnow();
@@ -3314,6 +3493,1055 @@ public:
 #endif
   }
 
+  //************************************************************************************************
+  //Asynchronous Merge
+  //************************************************************************************************
+  // The dynamic tree is frozen and a fresh one takes new writes while a
+  // background thread converts the frozen tree and merges it into the
+  // static tree. Nothing reachable from frozen_root or static_root is
+  // modified or freed until finish_merge() installs the merged root, so
+  // the foreground keeps serving lookups from root, then frozen_root, then
+  // static_root, and the newest value of a key always wins. While merging
+  // only the merge thread touches the static-side fields (static_memory,
+  // num_items_static, nodeD_count etc.).
+
+  void start_merge() {
+    unmap_static();
+    num_items_static += num_items;
+    frozen_root = root;
+    frozen_memory = memory;
+    frozen_pool.take(node_pool);
+    static_memory_snapshot = static_memory;
+
+    root = NULL;
+    memory = 0;
+    num_items = 0;
+    node4_count = 0;
+    node16_count = 0;
+    node48_count = 0;
+    node256_count = 0;
+    if (use_filter) {
+      frozen_filter.take(filter);
+      filter.reset(filter_capacity());
+    }
+
+    merging = true;
+    merge_done.store(false, std::memory_order_relaxed);
+    if (merge_step_budget)
+      start_merge_steps();
+    else
+      merge_thread = std::thread(&hybridART::run_merge, this, frozen_root, static_root.load());
+  }
+
+  void run_merge(Node* frozen, NodeStatic* old_static) {
+#ifdef MERGE_TIME
+    double start = getnow();
+#endif
+    merged_root = build_static(frozen, old_static);
+#ifdef MERGE_TIME
+    double end = getnow();
+    std::cout << "async merge " << (end - start) * 1000000 << "\n";
+#endif
+    merge_done.store(true, std::memory_order_release);
+  }
+
+  // Waits for the merge thread, or runs the steps left of an incremental
+  // merge, and swaps in the merged static tree. The frozen tree goes with
+  // its pool and the old static tree with its arena.
+  void finish_merge() {
+    if (merge_thread.joinable())
+      merge_thread.join();
+    else
+      while (!merge_done.load(std::memory_order_relaxed))
+	merge_step();
+    static_root.store(merged_root);
+    adopt_merged();
+    frozen_root = NULL;
+    frozen_memory = 0;
+    frozen_pool.release();
+    merged_root = NULL;
+    merging = false;
+    frozen_filter.release();
+  }
+
+  // An incremental merge also takes its next step here.
+  inline void poll_merge() {
+    if (merging && merge_step_budget && !merge_done.load(std::memory_order_relaxed))
+      merge_step();
+    if (merging && merge_done.load(std::memory_order_acquire))
+      finish_merge();
+  }
+
+  inline void check_merge() {
+    if (!MERGE)
+      return;
+    if (async_merge) {
+      poll_merge();
+      if (!merging && num_items > MERGE_THOLD && num_items * MERGE_RATIO > num_items_static)
+	start_merge();
+    }
+    else if (merge_step_budget) {
+      poll_merge();
+      if (!merging && num_items > MERGE_THOLD && num_items * MERGE_RATIO > num_items_static)
+	start_merge();
+    }
+    else if (num_items > MERGE_THOLD && num_items * MERGE_RATIO > num_items_static)
+      merge_trees();
+  }
+
+  //************************************************************************************************
+  //Parallel Merge
+  //************************************************************************************************
+  // With merge_threads > 1, build_static() splits a merge by the key byte
+  // under the two roots. Every byte is one task: convert the dynamic
+  // subtree under it, merge it with the static subtree under the same
+  // byte and copy the result out. Tasks share nothing, so the threads
+  // take them off a common cursor, and the calling thread makes the new
+  // root over the results once all are done. Every thread runs its tasks
+  // on a shard, a scratch hybridART with the same key length: the
+  // conversion and merge code runs unchanged, while the arenas and the
+  // node and item counts it updates belong to the thread. The shards'
+  // counts are added up at the end, and their merged_arena is adopted.
+  // The roots must have the same prefix, of at most maxPrefixLength
+  // bytes; other merges run on one thread.
+
+  // Child of the static node n under every key byte, or NULL.
+  inline void static_children_by_byte(NodeStatic* n, NodeStatic* child[256]) {
+    memset(child, 0, 256 * sizeof(NodeStatic*));
+    switch (n->type) {
+    case NodeTypeD: {
+      NodeD* node = static_cast<NodeD*>(n);
+      for (unsigned i = 0; i < node->count; i++)
+	child[flipSign(node->key()[i])] = *node->child(i);
+      break;
+    }
+    case NodeTypeDP: {
+      NodeDP* node = static_cast<NodeDP*>(n);
+      for (unsigned i = 0; i < node->count; i++)
+	child[flipSign(node->key()[i])] = *node->child(i);
+      break;
+    }
+    case NodeTypeF:
+      memcpy(child, static_cast<NodeF*>(n)->child, 256 * sizeof(NodeStatic*));
+      break;
+    case NodeTypeFP:
+      memcpy(child, static_cast<NodeFP*>(n)->child(), 256 * sizeof(NodeStatic*));
+      break;
+    }
+  }
+
+  // The prefix of a static node; NodeD and NodeF have none.
+  inline uint32_t static_prefix(NodeStatic* n, uint8_t*& prefix) {
+    if (n->type == NodeTypeDP) {
+      prefix = static_cast<NodeDP*>(n)->prefix();
+      return static_cast<NodeDP*>(n)->prefixLength;
+    }
+    if (n->type == NodeTypeFP) {
+      prefix = static_cast<NodeFP*>(n)->prefix();
+      return static_cast<NodeFP*>(n)->prefixLength;
+    }
+    prefix = NULL;
+    return 0;
+  }
+
+  inline void uncount_static(NodeStatic* n) {
+    static_memory -= node_size(n); //h
+    if (n->type == NodeTypeD)
+      nodeD_count--;
+    else if (n->type == NodeTypeDP)
+      nodeDP_count--;
+    else if (n->type == NodeTypeF)
+      nodeF_count--;
+    else if (n->type == NodeTypeFP)
+      nodeFP_count--;
+  }
+
+  // One task, run on a shard: the subtree under key byte key of the new
+  // root, from dynamic child d and static child s (either may be NULL),
+  // copied into merged_arena.
+  NodeStatic* merge_subtree(uint8_t key, Node* d, NodeStatic* s, int depth) {
+    NodeStatic* m = NULL;
+    if (d)
+      m = isLeaf(d) ? reinterpret_cast<NodeStatic*>(d) : convert_tree_to_static(d);
+    return merge_static_subtree(key, m, s, depth);
+  }
+
+  // The same with the dynamic child already converted to m. A pair of
+  // children is merged under a one-item parent so that merge_nodes()
+  // sorts out leaves and prefixes as it does anywhere else; the parent
+  // is scratch. merge_arena is reset, not released: an incremental merge
+  // comes here once for every pair it cannot split.
+  NodeStatic* merge_static_subtree(uint8_t key, NodeStatic* m, NodeStatic* s, int depth) {
+    NodeStatic* r = s;
+    if (m) {
+      if (!s)
+	r = m;
+      else {
+	NodeStatic* parent = merge_nodes(create_1_item_NodeU(key, m), create_1_item_NodeU(key, s), 0, NULL, depth);
+	NodeStatic* child[256];
+	static_children_by_byte(parent, child);
+	r = child[key];
+	uncount_static(parent);
+      }
+    }
+    if (r && !isLeaf(r))
+      r = merge_compacts ? copy_static(r, merged_arena) : copy_merged(r, merged_arena);
+    merge_arena.reset();
+    return r;
+  }
+
+  // The partitions of a merge: the children of the two roots by key
+  // byte, the bytes that have any, and the merged subtree of every byte
+  // done so far. An incremental merge splits pairs of children the same
+  // way (see merge_unit()); depth is where the prefix of tree_root
+  // starts, key the byte the pair hangs from in the split above, and
+  // other_static a static child whose prefix differs from tree_root's,
+  // to be merged with the result once it is made.
+  struct MergeSplit {
+    Node* tree_root;
+    NodeStatic* old_static;
+    uint32_t prefixLength;
+    uint32_t depth;
+    uint8_t key;
+    NodeStatic* other_static;
+    Node* dynamic_child[256];
+    NodeStatic* static_child[256];
+    NodeStatic* child[256];
+    std::vector<uint8_t> keys;
+    size_t next = 0;
+  };
+
+  // Fills split for a merge of tree_root, whose prefix starts at depth,
+  // into old_static; false if the roots cannot be split by key byte.
+  bool split_merge(Node* tree_root, NodeStatic* old_static, uint32_t depth, MergeSplit& split) {
+    if (!tree_root || isLeaf(tree_root) || (old_static && isLeaf(old_static)))
+      return false;
+    uint32_t prefixLength = tree_root->prefixLength;
+    if (prefixLength > maxPrefixLength)
+      return false;
+    if (old_static) {
+      uint8_t* prefix;
+      if (static_prefix(old_static, prefix) != prefixLength || memcmp(prefix, tree_root->prefix, prefixLength) != 0)
+	return false;
+    }
+
+    split.tree_root = tree_root;
+    split.old_static = old_static;
+    split.prefixLength = prefixLength;
+    split.depth = depth;
+    split.other_static = NULL;
+    NodeF dynamic_child(0);
+    Node_to_NodeF(tree_root, &dynamic_child);
+    memcpy(split.dynamic_child, dynamic_child.child, sizeof(split.dynamic_child));
+    if (old_static)
+      static_children_by_byte(old_static, split.static_child);
+    else
+      memset(split.static_child, 0, sizeof(split.static_child));
+    split.keys.clear();
+    for (unsigned b = 0; b < 256; b++)
+      if (split.dynamic_child[b] || split.static_child[b])
+	split.keys.push_back((uint8_t)b);
+    split.next = 0;
+    return true;
+  }
+
+  inline NodeStatic* merge_partition(MergeSplit& split, uint8_t key) {
+    return merge_subtree(key, split.dynamic_child[key], split.static_child[key], split.depth + split.prefixLength);
+  }
+
+  // Makes the new root over the merged subtrees of all partitions, of
+  // the type merge_nodes() and the conversion choose, in merged_arena.
+  NodeStatic* stitch_merge(MergeSplit& split) {
+    std::vector<uint8_t>& keys = split.keys;
+    NodeStatic** child = split.child;
+    uint32_t prefixLength = split.prefixLength;
+    unsigned count = keys.size();
+    bool inner = true;
+    for (unsigned i = 0; i < count; i++)
+      if (isLeaf(child[keys[i]]))
+	inner = false;
+    NodeStatic* new_root;
+    size_t size;
+    if (count > NodeDItemTHold || inner) {
+      if (prefixLength) {
+	size = sizeof(NodeFP) + prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
+	NodeFP* n_static = new(merged_arena.allocate(size)) NodeFP(count, prefixLength);
+	memcpy(n_static->prefix(), split.tree_root->prefix, prefixLength);
+	for (unsigned i = 0; i < count; i++)
+	  n_static->child()[keys[i]] = child[keys[i]];
+	nodeFP_count++; //h
+	new_root = n_static;
+      }
+      else {
+	size = sizeof(NodeF);
+	NodeF* n_static = new(merged_arena.allocate(size)) NodeF(count);
+	for (unsigned i = 0; i < count; i++)
+	  n_static->child[keys[i]] = child[keys[i]];
+	nodeF_count++; //h
+	new_root = n_static;
+      }
+    }
+    else {
+      if (prefixLength) {
+	size = sizeof(NodeDP) + prefixLength * sizeof(uint8_t) + count * (sizeof(uint8_t) + sizeof(NodeStatic*));
+	NodeDP* n_static = new(merged_arena.allocate(size)) NodeDP(count, prefixLength);
+	memcpy(n_static->prefix(), split.tree_root->prefix, prefixLength);
+	for (unsigned i = 0; i < count; i++) {
+	  n_static->key()[i] = flipSign(keys[i]);
+	  *n_static->child(i) = child[keys[i]];
+	}
+	nodeDP_count++; //h
+	new_root = n_static;
+      }
+      else {
+	size = sizeof(NodeD) + count * (sizeof(uint8_t) + sizeof(NodeStatic*));
+	NodeD* n_static = new(merged_arena.allocate(size)) NodeD(count);
+	for (unsigned i = 0; i < count; i++) {
+	  n_static->key()[i] = flipSign(keys[i]);
+	  *n_static->child(i) = child[keys[i]];
+	}
+	nodeD_count++; //h
+	new_root = n_static;
+      }
+    }
+    static_memory += size; //h
+    if (split.old_static)
+      uncount_static(split.old_static);
+    release(split.tree_root);
+    return new_root;
+  }
+
+  // build_static() on merge_threads threads; false, with nothing done,
+  // if the roots cannot be split by key byte.
+  bool build_static_parallel(Node* tree_root, NodeStatic* old_static, NodeStatic*& new_root) {
+    MergeSplit split;
+    if (!split_merge(tree_root, old_static, 0, split))
+      return false;
+
+    unsigned num_threads = std::min<size_t>(merge_threads, split.keys.size());
+    std::vector<std::unique_ptr<hybridART> > shards;
+    for (unsigned t = 0; t < num_threads; t++) {
+      shards.emplace_back(new hybridART(var_keys ? 0 : key_length));
+      shards[t]->pooled_nodes = pooled_nodes;
+      shards[t]->merge_compacts = merge_compacts;
+    }
+    std::atomic<size_t> next(0);
+    auto work = [&](unsigned t) {
+      for (size_t i = next++; i < split.keys.size(); i = next++)
+	split.child[split.keys[i]] = shards[t]->merge_partition(split, split.keys[i]);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+      threads.emplace_back(work, t);
+    work(0);
+    for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+    new_root = stitch_merge(split);
+
+    // the shards' counts are deltas and may have wrapped below zero
+    for (unsigned t = 0; t < num_threads; t++) {
+      hybridART* shard = shards[t].get();
+      merged_arena.append(shard->merged_arena);
+      static_memory += shard->static_memory;
+      num_items_static += shard->num_items_static;
+      nodeD_count += shard->nodeD_count;
+      nodeDP_count += shard->nodeDP_count;
+      nodeF_count += shard->nodeF_count;
+      nodeFP_count += shard->nodeFP_count;
+      retired_nodes.insert(retired_nodes.end(), shard->retired_nodes.begin(), shard->retired_nodes.end());
+    }
+    return true;
+  }
+
+  //************************************************************************************************
+  //Incremental Merge
+  //************************************************************************************************
+  // With a step budget set (setMergeStepBudget()), a synchronous merge no
+  // longer runs inside a single insert. start_merge() freezes the dynamic
+  // tree as it does for an asynchronous merge. Every later write or
+  // lookup then runs one step of the merge, as many pairs of children as
+  // fit in the budget, while lookups keep going to root, then
+  // frozen_root, then the old static_root. The merge walks the two trees
+  // depth first with a stack of splits (see split_merge()), one for every
+  // dynamic node on the current path, so a step can stop between any two
+  // pairs:
+  // - a pair without a dynamic child keeps the static one, shared;
+  // - a pair with a larger dynamic child is split in turn. If the prefix
+  //   of the static child differs, the dynamic child is split alone, and
+  //   the node it becomes is merged with the static child afterwards;
+  //   that only remakes the nodes down to where the two differ;
+  // - any other pair is merged at once: one whose dynamic child holds
+  //   at most MERGE_PIECE_KEYS keys, and one whose dynamic child has a
+  //   prefix too long to split.
+  // A split that is done makes its node in merged_arena (stitch_merge()),
+  // so the merged tree shares every static subtree it did not touch. A
+  // compacting merge (see compact_static()) then copies the merged tree
+  // into a new arena, a few nodes per step as well, and finish_merge()
+  // installs the new root. Pairs too large for one piece that cannot be
+  // split either, and merges whose roots cannot be split at all, are
+  // timed apart for merge_info(), next to the duration of every step.
+
+  static inline uint64_t merge_clock_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+  // The children of a node being copied, and the next one to copy.
+  struct CopyStep {
+    NodeStatic** child;
+    unsigned count;
+    unsigned next;
+  };
+
+  // An incremental merge under way: the splits on the current path, of
+  // which the first levels are in use, the merged root once it is made,
+  // and the nodes on the current path of the copy that follows it.
+  struct MergeSteps {
+    std::vector<std::unique_ptr<MergeSplit> > splits;
+    size_t levels = 0;
+    bool compact = false;
+    NodeStatic* root = NULL;
+    std::vector<CopyStep> copies;
+  };
+
+  // Splits the pair (d, s) whose prefixes start at depth onto the stack;
+  // false if d cannot be split.
+  bool push_merge_split(MergeSteps& steps, Node* d, NodeStatic* s, uint32_t depth, uint8_t key) {
+    if (steps.levels == steps.splits.size())
+      steps.splits.emplace_back(new MergeSplit);
+    MergeSplit& split = *steps.splits[steps.levels];
+    if (!split_merge(d, s, depth, split)) {
+      if (!s || !split_merge(d, NULL, depth, split))
+	return false;
+      split.other_static = s;
+    }
+    split.key = key;
+    steps.levels++;
+    return true;
+  }
+
+  // Copies static node n into merge_arena, to have its children copied
+  // by later steps.
+  NodeStatic* copy_static_node(MergeSteps& steps, NodeStatic* n) {
+    size_t size = node_size(n);
+    NodeStatic* n_copy = (NodeStatic*)merge_arena.allocate(size);
+    memcpy(n_copy, n, size);
+    CopyStep copy;
+    static_children(n_copy, copy.child, copy.count);
+    copy.next = 0;
+    steps.copies.push_back(copy);
+    return n_copy;
+  }
+
+  void start_merge_steps() {
+    merge_steps.reset(new MergeSteps);
+    merge_steps->compact = compact_static();
+    merge_compacts = false; // the pairs share; the copy at the end compacts
+    if (!push_merge_split(*merge_steps, frozen_root, static_root.load(), 0, 0))
+      merge_steps.reset();
+  }
+
+  // One pair of children, one split done, or one node copied; true once
+  // the merged root is ready.
+  bool merge_unit(MergeSteps& steps) {
+    if (steps.levels) {
+      MergeSplit& split = *steps.splits[steps.levels - 1];
+      uint32_t depth = split.depth + split.prefixLength;
+      if (split.next < split.keys.size()) {
+	uint8_t key = split.keys[split.next++];
+	Node* d = split.dynamic_child[key];
+	NodeStatic* s = split.static_child[key];
+	int left = MERGE_PIECE_KEYS;
+	if (!d)
+	  split.child[key] = s;
+	else if (leaves_within(d, left))
+	  split.child[key] = merge_partition(split, key);
+	else if (!push_merge_split(steps, d, s, depth + 1, key)) {
+	  uint64_t start = merge_clock_ns();
+	  split.child[key] = merge_partition(split, key);
+	  merge_unsplit_ns.push_back(merge_clock_ns() - start);
+	}
+	return false;
+      }
+
+      NodeStatic* n = stitch_merge(split);
+      steps.levels--;
+      if (steps.levels) {
+	MergeSplit& parent = *steps.splits[steps.levels - 1];
+	if (split.other_static)
+	  n = merge_static_subtree(split.key, n, split.other_static, parent.depth + parent.prefixLength);
+	parent.child[split.key] = n;
+	return false;
+      }
+      if (split.other_static) {
+	n = merge_nodes(n, split.other_static, 0, NULL, 0);
+	n = copy_merged(n, merged_arena);
+      }
+      merge_arena.release();
+      steps.root = n;
+      if (!steps.compact || isLeaf(n))
+	return true;
+      steps.root = copy_static_node(steps, n);
+      return false;
+    }
+
+    while (!steps.copies.empty() && steps.copies.back().next == steps.copies.back().count)
+      steps.copies.pop_back();
+    if (steps.copies.empty()) {
+      merged_arena.take(merge_arena);
+      merge_compacts = true;
+      return true;
+    }
+    CopyStep& copy = steps.copies.back();
+    NodeStatic** child = &copy.child[copy.next++];
+    if (*child && !isLeaf(*child))
+      *child = copy_static_node(steps, *child);
+    return false;
+  }
+
+  void merge_step() {
+    uint64_t start = merge_clock_ns();
+    if (!merge_steps) {
+      merged_root = build_static(frozen_root, static_root.load());
+      merge_done.store(true, std::memory_order_release);
+      merge_unsplit_ns.push_back(merge_clock_ns() - start);
+      return;
+    }
+    bool done;
+    do
+      done = merge_unit(*merge_steps);
+    while (!done && merge_clock_ns() - start < merge_step_budget);
+    if (done) {
+      merged_root = merge_steps->root;
+      merge_steps.reset();
+      merge_done.store(true, std::memory_order_release);
+    }
+    merge_step_ns.push_back(merge_clock_ns() - start);
+  }
+
+  //************************************************************************************************
+  //Static Tree Snapshot
+  //************************************************************************************************
+  // save_static() writes the static tree into one file, depth first, with
+  // every inner child stored as its offset in the file instead of a
+  // pointer; leaves and NULL children are written as they are. The file
+  // is a StaticFileHeader followed by the nodes, each 8-byte aligned.
+  // load_static() maps such a file read-only into an empty tree and
+  // serves the static tree straight from the mapping, resolving child
+  // offsets on the way down (see resolve()), so a restart costs an mmap
+  // and only the pages that lookups touch are ever read. merge_nodes()
+  // reads child slots directly, so the first merge after a load copies
+  // the mapped tree into static_arena and drops the mapping.
+  //
+  // Leaves hold tids, and only 8-byte keys are their own tids; a leaf of
+  // any other key points into memory of the process that built it.
+
+  struct StaticFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t key_length;
+    uint64_t num_items;
+    uint64_t root; // stored like a child
+    uint64_t size; // of the whole file
+  };
+
+  static const uint32_t STATIC_FILE_VERSION = 1;
+
+  // The child slots of static node n.
+  inline void static_children(NodeStatic* n, NodeStatic**& child, unsigned& count) {
+    if (n->type == NodeTypeD) {
+      child = static_cast<NodeD*>(n)->child();
+      count = static_cast<NodeD*>(n)->count;
+    }
+    else if (n->type == NodeTypeDP) {
+      child = static_cast<NodeDP*>(n)->child();
+      count = static_cast<NodeDP*>(n)->count;
+    }
+    else if (n->type == NodeTypeF) {
+      child = static_cast<NodeF*>(n)->child;
+      count = 256;
+    }
+    else {
+      child = static_cast<NodeFP*>(n)->child();
+      count = 256;
+    }
+  }
+
+  // Appends the tree rooted at n to buf and returns what the parent
+  // stores for it. The slots are patched through memcpy at buf offsets:
+  // the buffer may move while the children are written, and child slots
+  // need not be aligned.
+  uint64_t serialize_static(NodeStatic* n, std::vector<char>& buf) {
+    n = resolve(n);
+    if (!n || isLeaf(n))
+      return reinterpret_cast<uint64_t>(n);
+    size_t size = node_size(n);
+    size_t offset = buf.size();
+    buf.resize(offset + ((size + 7) & ~(size_t)7));
+    memcpy(&buf[offset], n, size);
+    NodeStatic** child;
+    unsigned count;
+    static_children(n, child, count);
+    size_t slots = offset + ((char*)child - (char*)n);
+    for (unsigned i = 0; i < count; i++) {
+      if (!child[i] || isLeaf(child[i]))
+	continue;
+      uint64_t ref = serialize_static(child[i], buf);
+      memcpy(&buf[slots + i * sizeof(NodeStatic*)], &ref, sizeof(ref));
+    }
+    return offset;
+  }
+
+  bool save_static(const char* path) {
+    if (key_length != 8 || var_keys) {
+      std::cout << "STATIC TREE SNAPSHOT NEEDS 8-BYTE KEYS!\n";
+      return false;
+    }
+    if (merging)
+      finish_merge();
+    std::vector<char> buf(sizeof(StaticFileHeader));
+    StaticFileHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "HARTSTAT", sizeof(h.magic));
+    h.version = STATIC_FILE_VERSION;
+    h.key_length = key_length;
+    h.num_items = num_items_static;
+    h.root = serialize_static(static_root.load(), buf);
+    h.size = buf.size();
+    memcpy(&buf[0], &h, sizeof(h));
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+      std::cout << "OPENING STATIC TREE FILE FAIL!\n";
+      return false;
+    }
+    bool ok = fwrite(&buf[0], 1, buf.size(), f) == buf.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok)
+      std::cout << "WRITING STATIC TREE FILE FAIL!\n";
+    return ok;
+  }
+
+  bool load_static(const char* path) {
+    if (root || static_root.load() || merging || static_map) {
+      std::cout << "LOADING STATIC TREE INTO NON-EMPTY TREE FAIL!\n";
+      return false;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      std::cout << "OPENING STATIC TREE FILE FAIL!\n";
+      return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(StaticFileHeader))
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      std::cout << "MAPPING STATIC TREE FILE FAIL!\n";
+      return false;
+    }
+    const StaticFileHeader* h = (const StaticFileHeader*)map;
+    // offsets and pointers are told apart by the mapping size
+    if (memcmp(h->magic, "HARTSTAT", sizeof(h->magic)) != 0 || h->version != STATIC_FILE_VERSION
+	|| h->key_length != key_length || var_keys || h->size != (uint64_t)st.st_size
+	|| (uintptr_t)map <= h->size) {
+      std::cout << "BAD STATIC TREE FILE!\n";
+      munmap(map, st.st_size);
+      return false;
+    }
+    static_map = (char*)map;
+    static_map_size = h->size;
+    static_root = resolve(reinterpret_cast<NodeStatic*>(h->root));
+    num_items_static = h->num_items;
+    static_memory = h->size - sizeof(StaticFileHeader);
+    if (use_filter)
+      filter.reset(filter_capacity());
+    return true;
+  }
+
+  // Copies a mapped static tree into static_arena and drops the mapping.
+  void unmap_static() {
+    if (!static_map)
+      return;
+    NodeStatic* r = static_root.load();
+    if (r && !isLeaf(r))
+      r = copy_static(r, static_arena);
+    static_root = r;
+    munmap(static_map, static_map_size);
+    static_map = NULL;
+    static_map_size = 0;
+  }
+
+  //************************************************************************************************
+  //Bulk Load
+  //************************************************************************************************
+  // bulk_load() builds the static tree of an empty hybridART straight
+  // from tids sorted by key, with no dynamic tree and no merge. Keys must
+  // be distinct and of fixed length. Every node is made the way
+  // convert_to_static() would make it from a dynamic node with the same
+  // children. The top levels are built on the calling thread until there
+  // are BULK_TASKS_PER_THREAD subtrees per thread; the threads then take
+  // the subtrees one by one and build each into an arena of their own,
+  // which static_arena adopts at the end.
+
+  static const unsigned BULK_TASKS_PER_THREAD = 16;
+
+  struct BuildCounts {
+    uint64_t memory = 0;
+    uint64_t nodeD = 0;
+    uint64_t nodeDP = 0;
+    uint64_t nodeF = 0;
+    uint64_t nodeFP = 0;
+  };
+
+  // A subtree still to be built, and the slot that takes its root.
+  struct BuildTask {
+    const uintptr_t* tids;
+    size_t n;
+    unsigned depth;
+    NodeStatic** slot;
+  };
+
+  // Byte depth of the key of tid, as loadKey() would load it.
+  inline uint8_t tidKeyByte(uintptr_t tid, unsigned depth) {
+    if (key_length == 8)
+      return (uint8_t)(tid >> (56 - 8 * depth));
+    return reinterpret_cast<const uint8_t*>(tid)[depth];
+  }
+
+  // Makes the node over tids[0..n), n > 1, with its child slots unset.
+  // Child i takes tids[bound[i]..bound[i+1]) and goes into *slot[i];
+  // returns the child count. The keys share prefixLength bytes from
+  // depth: those of the smallest and the largest key.
+  unsigned make_sorted_node(const uintptr_t* tids, size_t n, unsigned depth, NodeArena& arena, BuildCounts& counts,
+			    NodeStatic*& node, unsigned& prefixLength, size_t bound[], NodeStatic** slot[]) {
+    prefixLength = 0;
+    while (tidKeyByte(tids[0], depth + prefixLength) == tidKeyByte(tids[n - 1], depth + prefixLength))
+      prefixLength++;
+    unsigned d = depth + prefixLength;
+    uint8_t byte[256];
+    unsigned count = 0;
+    bool inner = true;
+    for (size_t begin = 0; begin < n; count++) {
+      uint8_t b = tidKeyByte(tids[begin], d);
+      size_t lo = begin + 1, hi = n;
+      while (lo < hi) {
+	size_t mid = (lo + hi) / 2;
+	if (tidKeyByte(tids[mid], d) == b)
+	  lo = mid + 1;
+	else
+	  hi = mid;
+      }
+      if (lo - begin == 1)
+	inner = false;
+      byte[count] = b;
+      bound[count] = begin;
+      begin = lo;
+    }
+    bound[count] = n;
+
+    size_t size;
+    if ((count > NodeDItemTHold) || inner) {
+      if (prefixLength) {
+	size = sizeof(NodeFP) + prefixLength * sizeof(uint8_t) + 256 * sizeof(NodeStatic*);
+	NodeFP* n_static = new(arena.allocate(size)) NodeFP(count, prefixLength);
+	for (unsigned i = 0; i < prefixLength; i++)
+	  n_static->prefix()[i] = tidKeyByte(tids[0], depth + i);
+	for (unsigned i = 0; i < count; i++)
+	  slot[i] = &n_static->child()[byte[i]];
+	counts.nodeFP++;
+	node = n_static;
+      }
+      else {
+	size = sizeof(NodeF);
+	NodeF* n_static = new(arena.allocate(size)) NodeF(count);
+	for (unsigned i = 0; i < count; i++)
+	  slot[i] = &n_static->child[byte[i]];
+	counts.nodeF++;
+	node = n_static;
+      }
+    }
+    else {
+      if (prefixLength) {
+	size = sizeof(NodeDP) + prefixLength * sizeof(uint8_t) + count * (sizeof(uint8_t) + sizeof(NodeStatic*));
+	NodeDP* n_static = new(arena.allocate(size)) NodeDP(count, prefixLength);
+	for (unsigned i = 0; i < prefixLength; i++)
+	  n_static->prefix()[i] = tidKeyByte(tids[0], depth + i);
+	for (unsigned i = 0; i < count; i++) {
+	  n_static->key()[i] = flipSign(byte[i]);
+	  slot[i] = n_static->child(i);
+	}
+	counts.nodeDP++;
+	node = n_static;
+      }
+      else {
+	size = sizeof(NodeD) + count * (sizeof(uint8_t) + sizeof(NodeStatic*));
+	NodeD* n_static = new(arena.allocate(size)) NodeD(count);
+	for (unsigned i = 0; i < count; i++) {
+	  n_static->key()[i] = flipSign(byte[i]);
+	  slot[i] = n_static->child(i);
+	}
+	counts.nodeD++;
+	node = n_static;
+      }
+    }
+    counts.memory += size;
+    return count;
+  }
+
+  NodeStatic* build_sorted(const uintptr_t* tids, size_t n, unsigned depth, NodeArena& arena, BuildCounts& counts) {
+    if (n == 1)
+      return reinterpret_cast<NodeStatic*>(makeLeaf(tids[0]));
+    NodeStatic* node;
+    unsigned prefixLength;
+    size_t bound[257];
+    NodeStatic** slot[256];
+    unsigned count = make_sorted_node(tids, n, depth, arena, counts, node, prefixLength, bound, slot);
+    for (unsigned i = 0; i < count; i++)
+      *slot[i] = build_sorted(tids + bound[i], bound[i + 1] - bound[i], depth + prefixLength + 1, arena, counts);
+    return node;
+  }
+
+  bool bulk_load(const uintptr_t* tids, size_t n, unsigned num_threads) {
+    if (var_keys || root || static_root.load() || merging || static_map)
+      return false;
+    if (num_threads < 1)
+      num_threads = 1;
+    NodeStatic* new_root = NULL;
+    BuildCounts counts;
+
+    // top levels, breadth first
+    std::vector<BuildTask> tasks;
+    if (n)
+      tasks.push_back(BuildTask{tids, n, 0, &new_root});
+    while (tasks.size() < (size_t)BULK_TASKS_PER_THREAD * num_threads) {
+      std::vector<BuildTask> next_level;
+      for (size_t t = 0; t < tasks.size(); t++) {
+	BuildTask& task = tasks[t];
+	if (task.n == 1) {
+	  *task.slot = reinterpret_cast<NodeStatic*>(makeLeaf(task.tids[0]));
+	  continue;
+	}
+	unsigned prefixLength;
+	size_t bound[257];
+	NodeStatic** slot[256];
+	unsigned count = make_sorted_node(task.tids, task.n, task.depth, static_arena, counts, *task.slot, prefixLength, bound, slot);
+	for (unsigned i = 0; i < count; i++)
+	  next_level.push_back(BuildTask{task.tids + bound[i], bound[i + 1] - bound[i], task.depth + prefixLength + 1, slot[i]});
+      }
+      tasks.swap(next_level);
+      if (tasks.empty())
+	break;
+    }
+
+    std::vector<NodeArena> arenas(num_threads);
+    std::vector<BuildCounts> thread_counts(num_threads);
+    std::atomic<size_t> next(0);
+    auto work = [&](unsigned t) {
+      for (size_t i = next++; i < tasks.size(); i = next++)
+	*tasks[i].slot = build_sorted(tasks[i].tids, tasks[i].n, tasks[i].depth, arenas[t], thread_counts[t]);
+    };
+    std::vector<std::thread> threads;
+    for (unsigned t = 1; t < num_threads; t++)
+      threads.emplace_back(work, t);
+    work(0);
+    for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
+
+    for (unsigned t = 0; t < num_threads; t++) {
+      static_arena.append(arenas[t]);
+      counts.memory += thread_counts[t].memory;
+      counts.nodeD += thread_counts[t].nodeD;
+      counts.nodeDP += thread_counts[t].nodeDP;
+      counts.nodeF += thread_counts[t].nodeF;
+      counts.nodeFP += thread_counts[t].nodeFP;
+    }
+    static_memory += counts.memory;
+    nodeD_count += counts.nodeD;
+    nodeDP_count += counts.nodeDP;
+    nodeF_count += counts.nodeF;
+    nodeFP_count += counts.nodeFP;
+    num_items_static = n;
+    static_root = new_root;
+    if (use_filter)
+      filter.reset(filter_capacity());
+    return true;
+  }
+
+  //************************************************************************************************
+  //Dynamic Tree Filter
+  //************************************************************************************************
+  // Optional Bloom filter over the keys of the dynamic tree. A lookup
+  // skips the dynamic (and frozen) tree when the filter rules the key
+  // out, which is the common case once most keys live in the static tree.
+  // The filter is sized for the largest dynamic tree the merge policy
+  // allows and starts empty after every merge.
+
+  uint64_t filter_capacity() {
+    uint64_t capacity = num_items_static / MERGE_RATIO;
+    if (capacity < MERGE_THOLD)
+      capacity = MERGE_THOLD;
+    return capacity + 1;
+  }
+
+  inline bool filter_may_contain(BloomFilter& f, uint8_t key[]) {
+    if (!use_filter || f.contains(key, keyBytes(key)))
+      return true;
+    filter_skips++;
+    return false;
+  }
+
+  //************************************************************************************************
+  //Batched Lookup
+  //************************************************************************************************
+  // The lookups of a group of keys run side by side, one node per key
+  // per round. Every round prefetches the next node of each key before
+  // any of them is read, so the cache misses of up to BATCH_GROUP keys
+  // overlap instead of forming one dependent chain per key.
+
+  static const unsigned BATCH_GROUP=16;
+
+  // First two cache lines of a node: all of Node4/16, the header of the
+  // other nodes and the first keys of NodeD/DP/U. A leaf only needs its
+  // key, which is memory only for keys loaded through the tid.
+  template<typename N>
+  inline void prefetchNext(N* n, unsigned keyLength) {
+    if (n == NULL)
+      return;
+    if (isLeaf(n)) {
+      if (keyLength != 8)
+	__builtin_prefetch(reinterpret_cast<const void*>(getLeafValue(n)));
+      return;
+    }
+    __builtin_prefetch(n);
+    __builtin_prefetch(reinterpret_cast<char*>(n)+64);
+  }
+
+  // One round of lookup(): moves node one level down the path of key.
+  // Returns true when the lookup is over; node is then the matching leaf
+  // or NULL.
+  inline bool lookupStep(Node*& node,uint8_t key[],unsigned keyLength,unsigned& depth,bool& skippedPrefix,unsigned maxKeyLength) {
+    if (node==NULL)
+      return true;
+    if (isLeaf(node)) {
+      if (depth!=keyLength) {
+	uint8_t leafKey[maxKeyLength];
+	loadKey(getLeafValue(node),leafKey,keyLength);
+	for (unsigned i=(skippedPrefix?0:depth);i<keyLength;i++)
+	  if (leafKey[i]!=key[i]) {
+	    node=NULL;
+	    break;
+	  }
+      }
+      return true;
+    }
+
+    if (node->prefixLength) {
+      if (node->prefixLength<maxPrefixLength) {
+	for (unsigned pos=0;pos<node->prefixLength;pos++)
+	  if (key[depth+pos]!=node->prefix[pos]) {
+	    node=NULL;
+	    return true;
+	  }
+      } else
+	skippedPrefix=true;
+      depth+=node->prefixLength;
+    }
+
+    node=*findChild(node,key[depth]);
+    depth++;
+    prefetchNext(node,keyLength);
+    return false;
+  }
+
+  inline bool lookupStep(NodeStatic*& node,uint8_t key[],unsigned keyLength,unsigned& depth,bool& skippedPrefix,unsigned maxKeyLength) {
+    if (node==NULL)
+      return true;
+    if (isLeaf(node)) {
+      if (depth!=keyLength) {
+	uint8_t leafKey[maxKeyLength];
+	loadKey(getLeafValue(node),leafKey,keyLength);
+	for (unsigned i=(skippedPrefix?0:depth);i<keyLength;i++)
+	  if (leafKey[i]!=key[i]) {
+	    node=NULL;
+	    break;
+	  }
+      }
+      return true;
+    }
+
+    uint32_t prefixLength=0;
+    uint8_t* prefix=NULL;
+    if (node->type==NodeTypeDP) {
+      prefixLength=static_cast<NodeDP*>(node)->prefixLength;
+      prefix=static_cast<NodeDP*>(node)->prefix();
+    }
+    else if (node->type==NodeTypeFP) {
+      prefixLength=static_cast<NodeFP*>(node)->prefixLength;
+      prefix=static_cast<NodeFP*>(node)->prefix();
+    }
+    if (prefixLength) {
+      if (prefixLength<maxPrefixLength) {
+	for (unsigned pos=0;pos<prefixLength;pos++)
+	  if (key[depth+pos]!=prefix[pos]) {
+	    node=NULL;
+	    return true;
+	  }
+      } else
+	skippedPrefix=true;
+      depth+=prefixLength;
+    }
+
+    node=resolve(*findChild(node,key[depth]));
+    depth++;
+    prefetchNext(node,keyLength);
+    return false;
+  }
+
+  // Looks up the keys[i] with !found[i] in the tree under root; sets
+  // found[i] and values[i] for every key it finds. Keys that f rules out
+  // are skipped.
+  template<typename N>
+  void lookup_group(N* root,uint8_t* keys[],unsigned n,unsigned keyLength,unsigned maxKeyLength,bool found[],uint64_t values[],BloomFilter* f) {
+    if (root==NULL)
+      return;
+    N* node[BATCH_GROUP];
+    unsigned depth[BATCH_GROUP];
+    bool skippedPrefix[BATCH_GROUP];
+    unsigned active[BATCH_GROUP];
+    unsigned num_active=0;
+    for (unsigned i=0;i<n;i++) {
+      if (found[i] || (f && !filter_may_contain(*f,keys[i])))
+	continue;
+      node[i]=root;
+      depth[i]=0;
+      skippedPrefix[i]=false;
+      active[num_active++]=i;
+    }
+
+    while (num_active) {
+      unsigned remaining=0;
+      for (unsigned a=0;a<num_active;a++) {
+	unsigned i=active[a];
+	if (var_keys)
+	  keyLength=maxKeyLength=varKeyLength(keys[i]);
+	if (!lookupStep(node[i],keys[i],keyLength,depth[i],skippedPrefix[i],maxKeyLength))
+	  active[remaining++]=i;
+	else if (node[i]) {
+	  found[i]=true;
+	  values[i]=getLeafValue(node[i]);
+	}
+      }
+      num_active=remaining;
+    }
+  }
+
+  inline void setKeyLength(unsigned kl) {
+    var_keys = (kl == 0);
+    key_length = var_keys ? MaxVarKeyLength : kl;
+  }
 
 public:
   hybridART()
@@ -3324,7 +4552,20 @@ public:
   hybridART(unsigned kl)
     : root(NULL), static_root(NULL), memory(0), static_memory(0), key_length(kl), num_items(0), num_items_static(0),
     node4_count(0), node16_count(0), node48_count(0), node256_count(0), nodeD_count(0), nodeDP_count(0), nodeF_count(0), nodeFP_count(0)
-  { }
+  {
+    setKeyLength(kl);
+  }
+
+  // am = asynchronous merge, bf = Bloom filter on the dynamic tree
+  hybridART(unsigned kl, bool am, bool bf = false)
+    : root(NULL), static_root(NULL), memory(0), static_memory(0), key_length(kl), num_items(0), num_items_static(0),
+    node4_count(0), node16_count(0), node48_count(0), node256_count(0), nodeD_count(0), nodeDP_count(0), nodeF_count(0), nodeFP_count(0),
+    async_merge(am), use_filter(bf)
+  {
+    setKeyLength(kl);
+    if (use_filter)
+      filter.reset(filter_capacity());
+  }
 
   hybridART(Node* r, NodeStatic* sr)
     : root(r), static_root(sr), memory(0), static_memory(0), key_length(8), num_items(0), num_items_static(0),
@@ -3334,26 +4575,49 @@ public:
   hybridART(Node* r, NodeStatic* sr, unsigned kl)
     : root(r), static_root(sr), memory(0), static_memory(0), key_length(kl), num_items(0), num_items_static(0),
     node4_count(0), node16_count(0), node48_count(0), node256_count(0), nodeD_count(0), nodeDP_count(0), nodeF_count(0), nodeFP_count(0)
-  { }
+  {
+    setKeyLength(kl);
+  }
 
   void insert(uint8_t key[], unsigned depth, uintptr_t value, unsigned maxKeyLength) {
     insert(root, &root, key, depth, value, maxKeyLength);
   }
 
+  ~hybridART() {
+    if (merging)
+      finish_merge();
+    if (static_map)
+      munmap(static_map, static_map_size);
+  }
+
   void insert(uint8_t key[], uintptr_t value, unsigned maxKeyLength) {
-    if (MERGE && num_items > MERGE_THOLD && num_items * MERGE_RATIO > num_items_static)
-      merge_trees();
+    check_merge();
+    if (var_keys)
+      maxKeyLength = varKeyLength(key);
     insert(root, &root, key, 0, value, maxKeyLength);
+    if (use_filter)
+      filter.insert(key, keyBytes(key));
   }
 
   void upsert(uint8_t key[], uintptr_t value, unsigned keyLength, unsigned maxKeyLength) {
-    if (MERGE && num_items > MERGE_THOLD && num_items * MERGE_RATIO > num_items_static)
-      merge_trees();
-    upsert(root, key, value, keyLength, 0, maxKeyLength);
+    check_merge();
+    if (var_keys)
+      keyLength = maxKeyLength = varKeyLength(key);
+    upsert(root, &root, key, value, keyLength, 0, maxKeyLength);
+    if (use_filter)
+      filter.insert(key, keyBytes(key));
   }
 
   uint64_t lookup(uint8_t key[], unsigned keyLength, unsigned maxKeyLength) {
-    Node* leaf = lookup(root, key, keyLength, 0, maxKeyLength);
+    if (merging)
+      poll_merge();
+    if (var_keys)
+      keyLength = maxKeyLength = varKeyLength(key);
+    Node* leaf = NULL;
+    if (root && filter_may_contain(filter, key))
+      leaf = lookup(root, key, keyLength, 0, maxKeyLength);
+    if (!leaf && frozen_root && filter_may_contain(frozen_filter, key))
+      leaf = lookup(frozen_root, key, keyLength, 0, maxKeyLength);
     if (!leaf) {
       NodeStatic* leaf_static = lookup(static_root, key, keyLength, 0, maxKeyLength);
       if (isLeaf(leaf_static))
@@ -3365,7 +4629,102 @@ public:
     return (uint64_t)0;
   }
 
+  // values[i] = lookup(keys[i]) for i < n, a group of keys at a time.
+  void lookup_batch(uint8_t* keys[], unsigned n, unsigned keyLength, unsigned maxKeyLength, uint64_t values[]) {
+    if (merging)
+      poll_merge();
+    for (unsigned b = 0; b < n; b += BATCH_GROUP) {
+      unsigned m = min(n - b, BATCH_GROUP);
+      bool found[BATCH_GROUP] = {};
+      lookup_group(root, keys + b, m, keyLength, maxKeyLength, found, values + b, &filter);
+      lookup_group(frozen_root, keys + b, m, keyLength, maxKeyLength, found, values + b, &frozen_filter);
+      lookup_group(static_root.load(), keys + b, m, keyLength, maxKeyLength, found, values + b, (BloomFilter*)NULL);
+      for (unsigned i = 0; i < m; i++)
+	if (!found[i])
+	  values[b + i] = 0;
+    }
+  }
+
+  // Inserts keys[i] -> values[i] for i < n. The paths of a group of keys
+  // are walked side by side first, which pulls them into the cache, and
+  // the inserts then run one after another.
+  void insert_batch(uint8_t* keys[], const uintptr_t values[], unsigned n, unsigned maxKeyLength) {
+    for (unsigned b = 0; b < n; b += BATCH_GROUP) {
+      unsigned m = min(n - b, BATCH_GROUP);
+      bool found[BATCH_GROUP] = {};
+      uint64_t ignored[BATCH_GROUP];
+      lookup_group(root, keys + b, m, key_length, maxKeyLength, found, ignored, (BloomFilter*)NULL);
+      for (unsigned i = 0; i < m; i++)
+	insert(keys[b + i], values[b + i], maxKeyLength);
+    }
+  }
+
+  // Position of a lookup() that lookup_step() advances one node at a
+  // time, for callers that interleave many lookups themselves.
+  struct LookupCursor {
+    Node* node;              // next node in the dynamic or frozen tree
+    NodeStatic* node_static; // next node in the static tree
+    unsigned tree;           // 0 = dynamic, 1 = frozen, 2 = static, 3 = done
+    unsigned depth;
+    bool skippedPrefix;
+    uint64_t value;          // result once tree == 3
+  };
+
+  // Points c at the root of the first tree from t on that may hold key.
+  inline void lookup_enter(LookupCursor& c, uint8_t key[], unsigned t) {
+    c.depth = 0;
+    c.skippedPrefix = false;
+    if (t == 0 && root && filter_may_contain(filter, key)) {
+      c.tree = 0;
+      c.node = root;
+    }
+    else if (t <= 1 && frozen_root && filter_may_contain(frozen_filter, key)) {
+      c.tree = 1;
+      c.node = frozen_root;
+    }
+    else {
+      c.tree = 2;
+      c.node_static = static_root.load();
+    }
+  }
+
+  // Unlike lookup(), this does not poll the background merge: finishing
+  // it frees nodes that other lookups in flight may still be on.
+  void lookup_begin(LookupCursor& c, uint8_t key[]) {
+    lookup_enter(c, key, 0);
+  }
+
+  // Searches the node c points at and moves c down to the next one,
+  // which is prefetched; returns false then. Returns true once the lookup
+  // is over, c.value holding what lookup() would return.
+  bool lookup_step(LookupCursor& c, uint8_t key[], unsigned keyLength, unsigned maxKeyLength) {
+    if (var_keys)
+      keyLength = maxKeyLength = varKeyLength(key);
+    if (c.tree == 2) {
+      if (!lookupStep(c.node_static, key, keyLength, c.depth, c.skippedPrefix, maxKeyLength))
+	return false;
+      c.value = c.node_static ? getLeafValue(c.node_static) : 0;
+    }
+    else if (c.tree < 2) {
+      if (!lookupStep(c.node, key, keyLength, c.depth, c.skippedPrefix, maxKeyLength))
+	return false;
+      if (!c.node) {
+	// not in this tree, go on with the next one
+	lookup_enter(c, key, c.tree + 1);
+	return lookup_step(c, key, keyLength, maxKeyLength);
+      }
+      c.value = getLeafValue(c.node);
+    }
+    c.tree = 3;
+    return true;
+  }
+
   uint64_t lower_bound(uint8_t key[], unsigned keyLength, unsigned maxKeyLength) {
+    // the scan cursors do not cover the frozen tree, wait for the merge
+    if (merging)
+      finish_merge();
+    if (var_keys)
+      keyLength = maxKeyLength = varKeyLength(key);
     Node* leaf = lower_bound(root, key, keyLength, 0, maxKeyLength);
     NodeStatic* leaf_static = lower_bound(static_root, key, keyLength, 0, maxKeyLength);
 
@@ -3395,12 +4754,12 @@ public:
     else
       return getLeafValue(leaf);
 
-    uint8_t leaf_key[maxKeyLength];
-    loadKey(leaf_ptr, leaf_key, keyLength);
-    uint8_t leaf_static_key[maxKeyLength];
-    loadKey(leaf_static_ptr, leaf_static_key, keyLength);
+    uint8_t leaf_key[key_length];
+    loadKey(leaf_ptr, leaf_key, key_length);
+    uint8_t leaf_static_key[key_length];
+    loadKey(leaf_static_ptr, leaf_static_key, key_length);
 
-    int cmp = strncmp((const char*)leaf_key, (const char*)leaf_static_key, keyLength);
+    int cmp = strncmp((const char*)leaf_key, (const char*)leaf_static_key, key_length);
 
     if (cmp < 0) {
       nextLeaf();
@@ -3474,17 +4833,57 @@ public:
   }
 
   void erase(uint8_t key[], unsigned keyLength, unsigned maxKeyLength) {
+    if (var_keys)
+      keyLength = maxKeyLength = varKeyLength(key);
     erase(root, &root, key, keyLength, 0, maxKeyLength);
   }
 
+  // threads for every later merge, see build_static_parallel()
+  void setMergeThreads(unsigned n) {
+    if (merging)
+      finish_merge();
+    merge_threads = n ? n : 1;
+  }
+
+  // Merges in steps of about budget_us microseconds each, run by the
+  // operations after the merge starts, instead of all at once; 0 = all
+  // at once. Only the synchronous merge has steps.
+  void setMergeStepBudget(uint64_t budget_us) {
+    if (merging)
+      finish_merge();
+    if (!async_merge)
+      merge_step_budget = budget_us * 1000;
+  }
+
   void merge() {
-    merge_trees();
+    if (!async_merge && !merge_step_budget) {
+      merge_trees();
+      return;
+    }
+    if (merging)
+      finish_merge();
+    if (root) {
+      start_merge();
+      finish_merge();
+    }
   }
 
   Node* getRoot() {
     return root;
   }
 
+  Node* getFrozenRoot() {
+    return frozen_root;
+  }
+
+  unsigned getKeyLength() {
+    return key_length;
+  }
+
+  bool varKeys() {
+    return var_keys;
+  }
+
   NodeStatic* getStaticRoot() {
     return static_root;
   }
@@ -3501,24 +4900,76 @@ public:
     std::cout << "NodeF = " << nodeF_count << "\n";
     std::cout << "NodeFP = " << nodeFP_count << "\n";
       */
-    return memory + static_memory;
+    uint64_t filter_memory = filter.getMemory() + frozen_filter.getMemory();
+    return node_pool.getMemory() + frozen_pool.getMemory() + getStaticMemory() + filter_memory;
   }
 
+  // The bytes of the live static nodes. static_arena also holds the
+  // nodes that merges have replaced until one compacts it (see
+  // compact_static()), so its size depends on the merge history; it is
+  // shown apart by memory_info(). While merging, the merge owns
+  // static_memory and the count from before the merge is reported.
   uint64_t getStaticMemory() {
-    return static_memory;
+    return merging ? static_memory_snapshot : static_memory;
+  }
+
+  // allocator memory next to the bytes the nodes take up
+  void memory_info() {
+    uint64_t dynamic_reserved = node_pool.getMemory() + frozen_pool.getMemory();
+    uint64_t dynamic_used = memory + frozen_memory;
+    uint64_t static_reserved = static_arena.getMemory() + static_map_size;
+    std::cout << "dynamic node memory = " << dynamic_reserved << "\t(fragmentation = " << (dynamic_reserved - dynamic_used) << ")\n";
+    std::cout << "static node memory = " << getStaticMemory() << "\t(arena = " << static_reserved
+	      << ", replaced nodes and fragmentation = " << (static_reserved - getStaticMemory()) << ")\n";
   }
 
   void tree_info() {
     tree_info(root);
   }
 
-private:
+  // the number of incremental merge steps and how long they took, and
+  // of the pieces of the merges that could not be split into steps
+  void merge_info() {
+    if (!merge_step_ns.empty()) {
+      std::vector<uint64_t> ns(merge_step_ns);
+      std::sort(ns.begin(), ns.end());
+      uint64_t sum = 0;
+      for (size_t i = 0; i < ns.size(); i++)
+	sum += ns[i];
+      std::cout << "merge steps = " << ns.size() << "\t(mean = " << sum / ns.size() / 1000
+		<< " us, p99 = " << ns[ns.size() * 99 / 100] / 1000 << " us, max = " << ns.back() / 1000 << " us)\n";
+    }
+    if (!merge_unsplit_ns.empty())
+      std::cout << "unsplit merge pieces = " << merge_unsplit_ns.size() << "\t(max = "
+		<< *std::max_element(merge_unsplit_ns.begin(), merge_unsplit_ns.end()) / 1000 << " us)\n";
+  }
+
+  void filter_info() {
+    if (!use_filter)
+      return;
+    std::cout << "filter memory = " << (filter.getMemory() + frozen_filter.getMemory()) << "\n";
+    std::cout << "filter skipped traversals = " << filter_skips << "\n";
+  }
+
+protected:
   Node* root;
-  NodeStatic* static_root;
+  std::atomic<NodeStatic*> static_root;
 
   uint64_t memory;
   uint64_t static_memory;
 
+  //node memory
+  SlabPool node_pool;
+  SlabPool frozen_pool;
+  NodeArena static_arena; // the nodes of static_root
+  NodeArena merge_arena;  // scratch nodes of the running merge
+  NodeArena merged_arena; // the merged tree until it is installed
+  bool merge_compacts = false; // the running merge copies the whole tree
+  char* static_map = NULL; // the static tree file mapped by load_static()
+  uint64_t static_map_size = 0;
+  bool pooled_nodes = true;
+  unsigned merge_threads = 1; // see build_static_parallel()
+
   uint64_t num_items;
   uint64_t num_items_static;
 
@@ -3526,6 +4977,7 @@ private:
   std::vector<NodeStaticCursor> node_stack_static;
 
   unsigned key_length;
+  bool var_keys = false;
 
   //node stats
   uint64_t node4_count;
@@ -3536,6 +4988,29 @@ private:
   uint64_t nodeDP_count;
   uint64_t nodeF_count;
   uint64_t nodeFP_count;
+
+  //asynchronous merge
+  bool async_merge = false;
+  bool merging = false;
+  Node* frozen_root = NULL;
+  NodeStatic* merged_root = NULL;
+  uint64_t frozen_memory = 0;
+  uint64_t static_memory_snapshot = 0;
+  std::vector<Node*> retired_nodes;
+  std::thread merge_thread;
+  std::atomic<bool> merge_done{false};
+
+  //incremental merge
+  uint64_t merge_step_budget = 0; // ns per step, 0 = merge at once
+  std::unique_ptr<MergeSteps> merge_steps; // NULL: one step does it all
+  std::vector<uint64_t> merge_step_ns;
+  std::vector<uint64_t> merge_unsplit_ns; // pieces merged at once
+
+  //dynamic tree filter
+  bool use_filter = false;
+  BloomFilter filter;
+  BloomFilter frozen_filter;
+  uint64_t filter_skips = 0;
 };
 
 static double gettime(void) {
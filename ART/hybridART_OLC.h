@@ -0,0 +1,724 @@
+/*
+  Thread-safe hybridART.
+
+  The dynamic Node4/16/48/256 tree is synchronized with optimistic lock
+  coupling ("The ART of Practical Synchronization", Leis et al., DaMoN
+  2016): every dynamic node carries a version word, readers validate the
+  versions they traversed and restart on conflict, writers lock at most
+  the node they modify and its parent. The static NodeD/DP/F/FP tree is
+  immutable between merges and is read without any synchronization.
+  Nodes that are replaced (grown nodes, merged trees) are reclaimed
+  through epochs.
+
+  Include after hybridART.h.
+ */
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <emmintrin.h>
+
+//==============================================================
+// EPOCH-BASED RECLAMATION
+//==============================================================
+// A thread announces the global epoch it observed while it may hold
+// pointers into a tree (EpochGuard). Memory retired at epoch e is freed
+// once every active thread announces an epoch newer than e. Threads get
+// a slot on first use and give it back when they exit; a new thread
+// taking over a slot inherits its pending garbage.
+class EpochManager {
+ public:
+  static const int MAX_THREADS = 256;
+  static const size_t COLLECT_THOLD = 1024; // retired pointers per slot before collecting
+
+  static EpochManager& instance() {
+    static EpochManager manager;
+    return manager;
+  }
+
+  int slot() {
+    thread_local SlotHolder holder;
+    if (holder.id < 0)
+      holder.id = acquire_slot();
+    return holder.id;
+  }
+
+  void enter() {
+    Slot& s = slots[slot()];
+    if (s.depth++ == 0) {
+      s.epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+  }
+
+  void exit() {
+    Slot& s = slots[slot()];
+    if (--s.depth == 0)
+      s.epoch.store(0, std::memory_order_release);
+  }
+
+  // Frees ptr (malloc-ed) once no thread can still reach it.
+  void retire(void* ptr) {
+    Slot& s = slots[slot()];
+    s.garbage.push_back(Garbage(global_epoch.load(std::memory_order_relaxed), ptr));
+    if (s.garbage.size() >= COLLECT_THOLD)
+      collect(s);
+  }
+
+  // Waits until every thread that was inside an epoch when this was
+  // called has left it. Must not be called from inside an EpochGuard.
+  void synchronize() {
+    uint64_t e = global_epoch.fetch_add(1) + 1;
+    for (int i = 0; i < MAX_THREADS; i++) {
+      while (true) {
+	uint64_t se = slots[i].epoch.load(std::memory_order_acquire);
+	if (se == 0 || se >= e)
+	  break;
+	std::this_thread::yield();
+      }
+    }
+  }
+
+ private:
+  struct Garbage {
+    uint64_t epoch;
+    void* ptr;
+
+    Garbage(uint64_t e, void* p) : epoch(e), ptr(p) {}
+  };
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch; // 0 = not inside an epoch
+    std::atomic<bool> in_use;
+    int depth;
+    std::vector<Garbage> garbage;
+
+    Slot() : epoch(0), in_use(false), depth(0) {}
+  };
+
+  struct SlotHolder {
+    int id;
+
+    SlotHolder() : id(-1) {}
+    ~SlotHolder() {
+      if (id >= 0)
+	EpochManager::instance().slots[id].in_use.store(false, std::memory_order_release);
+    }
+  };
+
+  EpochManager() : global_epoch(1) {}
+
+  int acquire_slot() {
+    for (int i = 0; i < MAX_THREADS; i++) {
+      bool expected = false;
+      if (!slots[i].in_use.load(std::memory_order_relaxed)
+	  && slots[i].in_use.compare_exchange_strong(expected, true))
+	return i;
+    }
+    std::cout << "EPOCH MANAGER OUT OF THREAD SLOTS!\n";
+    ::exit(1);
+  }
+
+  uint64_t min_active_epoch() {
+    uint64_t min_epoch = global_epoch.load();
+    for (int i = 0; i < MAX_THREADS; i++) {
+      uint64_t se = slots[i].epoch.load(std::memory_order_acquire);
+      if (se != 0 && se < min_epoch)
+	min_epoch = se;
+    }
+    return min_epoch;
+  }
+
+  void collect(Slot& s) {
+    global_epoch.fetch_add(1);
+    uint64_t safe = min_active_epoch();
+    size_t n = 0;
+    while (n < s.garbage.size() && s.garbage[n].epoch < safe) {
+      free(s.garbage[n].ptr);
+      n++;
+    }
+    s.garbage.erase(s.garbage.begin(), s.garbage.begin() + n);
+  }
+
+  std::atomic<uint64_t> global_epoch;
+  Slot slots[MAX_THREADS];
+};
+
+class EpochGuard {
+ public:
+  EpochGuard() {
+    EpochManager::instance().enter();
+  }
+  ~EpochGuard() {
+    EpochManager::instance().exit();
+  }
+};
+
+//==============================================================
+// HYBRID ART, OPTIMISTIC LOCK COUPLING
+//==============================================================
+class hybridART_OLC : public hybridART {
+
+public:
+  // Version word in front of every dynamic node:
+  // bit 0 = obsolete, bit 1 = locked, bits 2-63 = version counter
+  static const size_t NODE_HEADER = sizeof(std::atomic<uint64_t>);
+  static const unsigned STRIPES = 64;        // striped item/memory counters
+  static const unsigned MERGE_CHECK = 1024;  // inserts per stripe between merge checks
+
+  //************************************************************************************************
+  //Node Versions
+  //************************************************************************************************
+
+  // the NodeStatic versions stay the no-op ones: the static tree is immutable
+  using hybridART::readLock;
+  using hybridART::validate;
+  using hybridART::anyLeafKey;
+
+  static inline std::atomic<uint64_t>& version(Node* n) {
+    return *(reinterpret_cast<std::atomic<uint64_t>*>(n) - 1);
+  }
+
+  static inline bool readLock(Node* n, uint64_t& v) {
+    v = version(n).load(std::memory_order_acquire);
+    if (v & 3) {
+      _mm_pause();
+      return false;
+    }
+    return true;
+  }
+
+  // True if n is unchanged since readLock returned v.
+  static inline bool validate(Node* n, uint64_t v) {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version(n).load(std::memory_order_relaxed) == v;
+  }
+
+  static inline bool upgradeLock(Node* n, uint64_t v) {
+    return version(n).compare_exchange_strong(v, v + 2);
+  }
+
+  static inline void writeUnlock(Node* n) {
+    version(n).fetch_add(2, std::memory_order_release);
+  }
+
+  static inline void writeUnlockObsolete(Node* n) {
+    version(n).fetch_add(3, std::memory_order_release);
+  }
+
+  //************************************************************************************************
+  //Node Allocation
+  //************************************************************************************************
+
+  // hides hybridART::allocNode(): these nodes carry a version word and
+  // are freed through the epochs, not through the node pool
+  template<class T>
+  inline T* allocNode() {
+    void* ptr = malloc(NODE_HEADER + sizeof(T));
+    new(ptr) std::atomic<uint64_t>(0);
+    stripe().memory.fetch_add(NODE_HEADER + sizeof(T), std::memory_order_relaxed);
+    return new(static_cast<char*>(ptr) + NODE_HEADER) T();
+  }
+
+  static inline void* nodeBase(Node* n) {
+    return reinterpret_cast<char*>(n) - NODE_HEADER;
+  }
+
+  inline void retireNode(Node* n) {
+    stripe().memory.fetch_sub(NODE_HEADER + node_size(n), std::memory_order_relaxed);
+    EpochManager::instance().retire(nodeBase(n));
+  }
+
+  inline bool isFull(Node* n) {
+    switch (n->type) {
+    case NodeType4: return n->count == 4;
+    case NodeType16: return n->count == 16;
+    case NodeType48: return n->count == 48;
+    }
+    return false;
+  }
+
+  // Inserts into a node that has room (the in-place paths of insertNodeX).
+  inline void insertInto(Node* n, uint8_t keyByte, Node* child) {
+    switch (n->type) {
+    case NodeType4: insertNode4(static_cast<Node4*>(n), NULL, keyByte, child); break;
+    case NodeType16: insertNode16(static_cast<Node16*>(n), NULL, keyByte, child); break;
+    case NodeType48: insertNode48(static_cast<Node48*>(n), NULL, keyByte, child); break;
+    case NodeType256: insertNode256(static_cast<Node256*>(n), NULL, keyByte, child); break;
+    }
+  }
+
+  // Copies a full node into a new node of the next size.
+  inline Node* grow(Node* n) {
+    switch (n->type) {
+    case NodeType4: {
+      Node4* node = static_cast<Node4*>(n);
+      Node16* newNode = allocNode<Node16>();
+      newNode->count = 4;
+      copyPrefix(node, newNode);
+      for (unsigned i = 0; i < 4; i++)
+	newNode->key[i] = flipSign(node->key[i]);
+      memcpy(newNode->child, node->child, node->count * sizeof(uintptr_t));
+      return newNode;
+    }
+    case NodeType16: {
+      Node16* node = static_cast<Node16*>(n);
+      Node48* newNode = allocNode<Node48>();
+      memcpy(newNode->child, node->child, node->count * sizeof(uintptr_t));
+      for (unsigned i = 0; i < node->count; i++)
+	newNode->childIndex[flipSign(node->key[i])] = i;
+      copyPrefix(node, newNode);
+      newNode->count = node->count;
+      return newNode;
+    }
+    case NodeType48: {
+      Node48* node = static_cast<Node48*>(n);
+      Node256* newNode = allocNode<Node256>();
+      for (unsigned i = 0; i < 256; i++)
+	if (node->childIndex[i] != emptyMarker)
+	  newNode->child[i] = node->child[node->childIndex[i]];
+      newNode->count = node->count;
+      copyPrefix(node, newNode);
+      return newNode;
+    }
+    }
+    return NULL; // Node256 never grows
+  }
+
+  //************************************************************************************************
+  //Dynamic Tree Operations
+  //************************************************************************************************
+
+  // Any child of n, read without synchronization (the caller validates).
+  inline Node* anyChild(Node* n) {
+    switch (n->type) {
+    case NodeType4:
+      return n->count ? static_cast<Node4*>(n)->child[0] : NULL;
+    case NodeType16:
+      return n->count ? static_cast<Node16*>(n)->child[0] : NULL;
+    case NodeType48: {
+      Node48* node = static_cast<Node48*>(n);
+      for (unsigned i = 0; i < 256; i++)
+	if (node->childIndex[i] != emptyMarker)
+	  return node->child[node->childIndex[i] % 48];
+      return NULL;
+    }
+    case NodeType256: {
+      Node256* node = static_cast<Node256*>(n);
+      for (unsigned i = 0; i < 256; i++)
+	if (node->child[i])
+	  return node->child[i];
+      return NULL;
+    }
+    }
+    return NULL;
+  }
+
+  // Key of any leaf below n, read optimistically; false if the subtree
+  // changed under us.
+  inline bool anyLeafKey(Node* n, uint8_t key[]) {
+    while (true) {
+      uint64_t v;
+      if (!readLock(n, v))
+	return false;
+      Node* child = anyChild(n);
+      if (!validate(n, v) || !child)
+	return false;
+      if (isLeaf(child)) {
+	loadKey(getLeafValue(child), key, key_length);
+	return true;
+      }
+      n = child;
+    }
+  }
+
+  // Returns the leaf for key in the tree rooted at r, NULL if absent.
+  inline Node* lookupOLC(Node* r, uint8_t key[], unsigned keyLength, unsigned maxKeyLength) {
+  restart:
+    Node* node = r;
+    unsigned depth = 0;
+    bool skippedPrefix = false;
+
+    while (true) {
+      uint64_t v;
+      if (!readLock(node, v))
+	goto restart;
+
+      if (node->prefixLength) {
+	if (node->prefixLength < maxPrefixLength) {
+	  for (unsigned pos = 0; pos < node->prefixLength; pos++)
+	    if (key[depth + pos] != node->prefix[pos]) {
+	      if (!validate(node, v))
+		goto restart;
+	      return NULL;
+	    }
+	} else
+	  skippedPrefix = true;
+	depth += node->prefixLength;
+      }
+
+      if (depth >= keyLength) {
+	if (!validate(node, v))
+	  goto restart;
+	return NULL;
+      }
+
+      Node* next = *findChild(node, key[depth]);
+      if (!validate(node, v))
+	goto restart;
+      depth++;
+
+      if (!next)
+	return NULL;
+
+      if (isLeaf(next)) {
+	if (!skippedPrefix && depth == keyLength)
+	  return next;
+	uint8_t leafKey[maxKeyLength];
+	loadKey(getLeafValue(next), leafKey, keyLength);
+	for (unsigned i = (skippedPrefix ? 0 : depth); i < keyLength; i++)
+	  if (leafKey[i] != key[i])
+	    return NULL;
+	return next;
+      }
+      node = next;
+    }
+  }
+
+  // Inserts key into the tree rooted at r (a Node256 that is never
+  // replaced). An existing key is left alone unless replace is set.
+  // Returns true if a new leaf was added.
+  inline bool insertOLC(Node* r, uint8_t key[], uintptr_t value, unsigned maxKeyLength, bool replace) {
+  restart:
+    Node* node = NULL;
+    Node* next = r;
+    Node* parent = NULL;
+    uint8_t parentKey = 0;
+    uint8_t nodeKey = 0;
+    uint64_t parentVersion = 0;
+    unsigned depth = 0;
+
+    while (true) {
+      parent = node;
+      parentKey = nodeKey;
+      node = next;
+      uint64_t v;
+      if (!readLock(node, v))
+	goto restart;
+
+      // Handle prefix of inner node
+      if (node->prefixLength) {
+	unsigned mismatchPos;
+	uint8_t minKey[maxKeyLength];
+	bool haveMinKey = false;
+	if (node->prefixLength > maxPrefixLength) {
+	  for (mismatchPos = 0; mismatchPos < maxPrefixLength; mismatchPos++)
+	    if (key[depth + mismatchPos] != node->prefix[mismatchPos])
+	      break;
+	  if (mismatchPos == maxPrefixLength) {
+	    if (!anyLeafKey(node, minKey) || !validate(node, v))
+	      goto restart;
+	    haveMinKey = true;
+	    for (; mismatchPos < node->prefixLength; mismatchPos++)
+	      if (key[depth + mismatchPos] != minKey[depth + mismatchPos])
+		break;
+	  }
+	}
+	else {
+	  for (mismatchPos = 0; mismatchPos < node->prefixLength; mismatchPos++)
+	    if (key[depth + mismatchPos] != node->prefix[mismatchPos])
+	      break;
+	}
+
+	if (mismatchPos != node->prefixLength) {
+	  // Prefix differs, create new node above node
+	  if (!upgradeLock(parent, parentVersion))
+	    goto restart;
+	  if (!upgradeLock(node, v)) {
+	    writeUnlock(parent);
+	    goto restart;
+	  }
+	  if (node->prefixLength >= maxPrefixLength && !haveMinKey && !anyLeafKey(node, minKey)) {
+	    writeUnlock(node);
+	    writeUnlock(parent);
+	    goto restart;
+	  }
+
+	  Node4* newNode = allocNode<Node4>();
+	  newNode->prefixLength = mismatchPos;
+	  memcpy(newNode->prefix, node->prefix, min(mismatchPos, maxPrefixLength));
+	  // Break up prefix
+	  if (node->prefixLength < maxPrefixLength) {
+	    insertNode4(newNode, NULL, node->prefix[mismatchPos], node);
+	    node->prefixLength -= (mismatchPos + 1);
+	    memmove(node->prefix, node->prefix + mismatchPos + 1, min(node->prefixLength, maxPrefixLength));
+	  }
+	  else {
+	    node->prefixLength -= (mismatchPos + 1);
+	    insertNode4(newNode, NULL, minKey[depth + mismatchPos], node);
+	    memmove(node->prefix, minKey + depth + mismatchPos + 1, min(node->prefixLength, maxPrefixLength));
+	  }
+	  insertNode4(newNode, NULL, key[depth + mismatchPos], makeLeaf(value));
+
+	  *findChild(parent, parentKey) = newNode;
+	  writeUnlock(node);
+	  writeUnlock(parent);
+	  return true;
+	}
+	depth += node->prefixLength;
+      }
+
+      nodeKey = key[depth];
+      next = *findChild(node, nodeKey);
+      if (!validate(node, v))
+	goto restart;
+
+      if (!next) {
+	// Insert leaf into inner node
+	if (!isFull(node)) {
+	  if (!upgradeLock(node, v))
+	    goto restart;
+	  insertInto(node, nodeKey, makeLeaf(value));
+	  writeUnlock(node);
+	}
+	else {
+	  if (!upgradeLock(parent, parentVersion))
+	    goto restart;
+	  if (!upgradeLock(node, v)) {
+	    writeUnlock(parent);
+	    goto restart;
+	  }
+	  Node* newNode = grow(node);
+	  insertInto(newNode, nodeKey, makeLeaf(value));
+	  *findChild(parent, parentKey) = newNode;
+	  writeUnlockObsolete(node);
+	  retireNode(node);
+	  writeUnlock(parent);
+	}
+	return true;
+      }
+
+      if (isLeaf(next)) {
+	if (!upgradeLock(node, v))
+	  goto restart;
+
+	uint8_t existingKey[maxKeyLength];
+	loadKey(getLeafValue(next), existingKey, key_length);
+	unsigned leafDepth = depth + 1;
+	unsigned newPrefixLength = 0;
+	while ((leafDepth + newPrefixLength < maxKeyLength) && (existingKey[leafDepth + newPrefixLength] == key[leafDepth + newPrefixLength]))
+	  newPrefixLength++;
+	if (leafDepth + newPrefixLength >= maxKeyLength) {
+	  // Same key
+	  if (replace)
+	    *findChild(node, nodeKey) = makeLeaf(value);
+	  writeUnlock(node);
+	  return false;
+	}
+
+	// Replace leaf with Node4 and store both leaves in it
+	Node4* newNode = allocNode<Node4>();
+	newNode->prefixLength = newPrefixLength;
+	memcpy(newNode->prefix, key + leafDepth, min(newPrefixLength, maxPrefixLength));
+	insertNode4(newNode, NULL, existingKey[leafDepth + newPrefixLength], next);
+	insertNode4(newNode, NULL, key[leafDepth + newPrefixLength], makeLeaf(value));
+	*findChild(node, nodeKey) = newNode;
+	writeUnlock(node);
+	return true;
+      }
+
+      depth++;
+      parentVersion = v;
+    }
+  }
+
+  //************************************************************************************************
+  //Merge
+  //************************************************************************************************
+  // A writer that sees the dynamic tree over the merge threshold freezes
+  // it and starts the merge thread. The merge thread waits for a grace
+  // period so that no writer is still inside the frozen tree, converts and
+  // merges it exactly like the single-threaded hybridART (non-destructively,
+  // see build_static()), installs the new static root, waits for another
+  // grace period and only then frees the frozen tree and the old static
+  // arena.
+
+  void maybe_start_merge() {
+    if (!MERGE || olc_merging.load(std::memory_order_relaxed))
+      return;
+    uint64_t items = count_items() - items_at_freeze.load(std::memory_order_relaxed);
+    if (items <= MERGE_THOLD || items * MERGE_RATIO <= items_static.load(std::memory_order_relaxed))
+      return;
+    bool expected = false;
+    if (!olc_merging.compare_exchange_strong(expected, true))
+      return;
+
+    if (olc_merge_thread.joinable())
+      olc_merge_thread.join();
+    items_at_freeze.store(count_items());
+    Node* frozen = olc_root.load();
+    frozen_olc_root.store(frozen);
+    olc_root.store(newRoot());
+    olc_merge_thread = std::thread(&hybridART_OLC::run_merge_olc, this, frozen, items);
+  }
+
+  void run_merge_olc(Node* frozen, uint64_t frozen_items) {
+    EpochManager& em = EpochManager::instance();
+    em.synchronize();
+
+    num_items_static += frozen_items;
+    NodeStatic* root_s = build_static(frozen, static_root.load());
+
+    static_root.store(root_s);
+    frozen_olc_root.store(NULL);
+    static_memory_published.store(static_memory);
+    items_static.store(num_items_static);
+
+    em.synchronize();
+    int64_t freed = 0;
+    for (size_t i = 0; i < retired_nodes.size(); i++) {
+      freed += NODE_HEADER + node_size(retired_nodes[i]);
+      free(nodeBase(retired_nodes[i]));
+    }
+    std::vector<Node*>().swap(retired_nodes);
+    adopt_merged();
+    stripe().memory.fetch_sub(freed, std::memory_order_relaxed);
+
+    olc_merging.store(false);
+  }
+
+  //************************************************************************************************
+  //Counters
+  //************************************************************************************************
+
+  // padded rather than alignas(64): the tree itself is allocated with
+  // plain new
+  struct Stripe {
+    std::atomic<uint64_t> items;
+    std::atomic<int64_t> memory;
+    char padding[64 - 2 * sizeof(uint64_t)];
+
+    Stripe() : items(0), memory(0) {}
+  };
+
+  inline Stripe& stripe() {
+    return stripes[EpochManager::instance().slot() % STRIPES];
+  }
+
+  uint64_t count_items() {
+    uint64_t items = 0;
+    for (unsigned i = 0; i < STRIPES; i++)
+      items += stripes[i].items.load(std::memory_order_relaxed);
+    return items;
+  }
+
+  inline void count_insert() {
+    uint64_t c = stripe().items.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (c % MERGE_CHECK == 0)
+      maybe_start_merge();
+  }
+
+  Node* newRoot() {
+    return allocNode<Node256>();
+  }
+
+public:
+  hybridART_OLC(unsigned kl)
+    : hybridART(kl, true), items_at_freeze(0), items_static(0), static_memory_published(0), olc_merging(false) {
+    pooled_nodes = false;
+    olc_root.store(newRoot());
+    frozen_olc_root.store(NULL);
+  }
+
+  ~hybridART_OLC() {
+    if (olc_merge_thread.joinable())
+      olc_merge_thread.join();
+  }
+
+  void insert(uint8_t key[], uintptr_t value, unsigned maxKeyLength) {
+    bool added;
+    {
+      EpochGuard guard;
+      added = insertOLC(olc_root.load(), key, value, maxKeyLength, false);
+    }
+    if (added)
+      count_insert();
+  }
+
+  void upsert(uint8_t key[], uintptr_t value, unsigned keyLength, unsigned maxKeyLength) {
+    bool added;
+    {
+      EpochGuard guard;
+      added = insertOLC(olc_root.load(), key, value, maxKeyLength, true);
+    }
+    if (added)
+      count_insert();
+  }
+
+  // Checks the dynamic tree, the frozen tree, then the static tree, so
+  // the newest value of a key wins.
+  uint64_t lookup(uint8_t key[], unsigned keyLength, unsigned maxKeyLength) {
+    EpochGuard guard;
+    Node* leaf = lookupOLC(olc_root.load(), key, keyLength, maxKeyLength);
+    if (!leaf) {
+      Node* frozen = frozen_olc_root.load();
+      if (frozen)
+	leaf = lookupOLC(frozen, key, keyLength, maxKeyLength);
+    }
+    if (leaf)
+      return getLeafValue(leaf);
+    NodeStatic* leaf_static = hybridART::lookup(static_root.load(), key, keyLength, 0, maxKeyLength);
+    if (leaf_static && isLeaf(leaf_static))
+      return getLeafValue(leaf_static);
+    return (uint64_t)0;
+  }
+
+  // Merges the dynamic tree now. Not to be called concurrently with writers.
+  void merge() {
+    while (olc_merging.load())
+      std::this_thread::yield();
+    if (olc_merge_thread.joinable())
+      olc_merge_thread.join();
+    items_at_freeze.store(0);
+    uint64_t items = count_items();
+    if (items == 0)
+      return;
+    olc_merging.store(true);
+    for (unsigned i = 0; i < STRIPES; i++)
+      stripes[i].items.store(0);
+    Node* frozen = olc_root.load();
+    frozen_olc_root.store(frozen);
+    olc_root.store(newRoot());
+    run_merge_olc(frozen, items);
+  }
+
+  uint64_t getMemory() {
+    int64_t dynamic_memory = 0;
+    for (unsigned i = 0; i < STRIPES; i++)
+      dynamic_memory += stripes[i].memory.load(std::memory_order_relaxed);
+    return dynamic_memory + static_memory_published.load(std::memory_order_relaxed);
+  }
+
+  uint64_t getStaticMemory() {
+    return static_memory_published.load(std::memory_order_relaxed);
+  }
+
+  Node* getRoot() {
+    return olc_root.load();
+  }
+
+  Node* getFrozenRoot() {
+    return frozen_olc_root.load();
+  }
+
+private:
+  std::atomic<Node*> olc_root;
+  std::atomic<Node*> frozen_olc_root;
+  Stripe stripes[STRIPES];
+
+  std::atomic<uint64_t> items_at_freeze;
+  std::atomic<uint64_t> items_static;
+  std::atomic<uint64_t> static_memory_published;
+  std::atomic<bool> olc_merging;
+  std::thread olc_merge_thread;
+};
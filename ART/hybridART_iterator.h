@@ -0,0 +1,478 @@
+/*
+  Range scan iterator for hybridART and hybridART_OLC.
+
+  An iterator keeps its own cursor stacks, so any number of scans can run
+  at once and a scan never allocates. It walks the dynamic tree, the
+  frozen tree (while a background merge is running) and the static tree
+  side by side and returns their union in key order; if a key is in more
+  than one tree, the value from the newest tree wins.
+
+  On hybridART_OLC the dynamic cursors check node versions and re-seek
+  past the last returned key when a node changes under them. Callers
+  must hold an EpochGuard for the lifetime of the iterator.
+
+  Include after hybridART.h and hybridART_OLC.h.
+ */
+
+//==============================================================
+// NODE ACCESS
+//==============================================================
+// Child enumeration for every node type. A slot is the child index for
+// Node4/16/D/DP and the key byte for Node48/256/F/FP.
+struct hybridART_Slots {
+  typedef hybridART::Node Node;
+  typedef hybridART::NodeStatic NodeStatic;
+
+  static inline unsigned prefixLength(Node* n) {
+    return n->prefixLength;
+  }
+
+  static inline const uint8_t* prefix(Node* n) {
+    return n->prefix;
+  }
+
+  static inline unsigned prefixLength(NodeStatic* n) {
+    if (n->type == hybridART::NodeTypeDP)
+      return static_cast<hybridART::NodeDP*>(n)->prefixLength;
+    if (n->type == hybridART::NodeTypeFP)
+      return static_cast<hybridART::NodeFP*>(n)->prefixLength;
+    return 0;
+  }
+
+  static inline const uint8_t* prefix(NodeStatic* n) {
+    if (n->type == hybridART::NodeTypeDP)
+      return static_cast<hybridART::NodeDP*>(n)->prefix();
+    if (n->type == hybridART::NodeTypeFP)
+      return static_cast<hybridART::NodeFP*>(n)->prefix();
+    return NULL;
+  }
+
+  // First child with a key byte >= keyByte, in slot pos; exact is set if
+  // its key byte is keyByte. NULL if there is none.
+  static inline Node* lowerChild(Node* n, unsigned keyByte, unsigned& pos, bool& exact) {
+    switch (n->type) {
+    case hybridART::NodeType4: {
+      hybridART::Node4* node = static_cast<hybridART::Node4*>(n);
+      for (unsigned i = 0; i < node->count && i < 4; i++)
+	if (node->key[i] >= keyByte) {
+	  pos = i;
+	  exact = (node->key[i] == keyByte);
+	  return node->child[i];
+	}
+      return NULL;
+    }
+    case hybridART::NodeType16: {
+      // keys are sign-flipped, i.e. sorted by their unsigned value
+      hybridART::Node16* node = static_cast<hybridART::Node16*>(n);
+      unsigned count = node->count < 16 ? node->count : 16;
+      unsigned i = KeySearch::lowerBound<true>(node->key, count, keyByte ^ 128);
+      if (i == count)
+	return NULL;
+      pos = i;
+      exact = ((uint8_t)(node->key[i] ^ 128) == keyByte);
+      return node->child[i];
+    }
+    case hybridART::NodeType48: {
+      hybridART::Node48* node = static_cast<hybridART::Node48*>(n);
+      for (unsigned i = keyByte; i < 256; i++)
+	if (node->childIndex[i] != hybridART::emptyMarker) {
+	  pos = i;
+	  exact = (i == keyByte);
+	  return node->child[node->childIndex[i] % 48];
+	}
+      return NULL;
+    }
+    case hybridART::NodeType256: {
+      hybridART::Node256* node = static_cast<hybridART::Node256*>(n);
+      for (unsigned i = keyByte; i < 256; i++)
+	if (node->child[i]) {
+	  pos = i;
+	  exact = (i == keyByte);
+	  return node->child[i];
+	}
+      return NULL;
+    }
+    }
+    return NULL;
+  }
+
+  // First child in a slot after pos, which is updated.
+  static inline Node* nextChild(Node* n, unsigned& pos) {
+    switch (n->type) {
+    case hybridART::NodeType4: {
+      hybridART::Node4* node = static_cast<hybridART::Node4*>(n);
+      if (pos + 1 < node->count && pos + 1 < 4)
+	return node->child[++pos];
+      return NULL;
+    }
+    case hybridART::NodeType16: {
+      hybridART::Node16* node = static_cast<hybridART::Node16*>(n);
+      if (pos + 1 < node->count && pos + 1 < 16)
+	return node->child[++pos];
+      return NULL;
+    }
+    case hybridART::NodeType48:
+    case hybridART::NodeType256: {
+      bool exact;
+      return (pos < 255) ? lowerChild(n, pos + 1, pos, exact) : NULL;
+    }
+    }
+    return NULL;
+  }
+
+  static inline NodeStatic* lowerChild(NodeStatic* n, unsigned keyByte, unsigned& pos, bool& exact) {
+    switch (n->type) {
+    case hybridART::NodeTypeD:
+    case hybridART::NodeTypeDP: {
+      // keys are sign-flipped, i.e. sorted by their unsigned value
+      uint8_t* keys;
+      NodeStatic** children;
+      unsigned count;
+      if (n->type == hybridART::NodeTypeD) {
+	hybridART::NodeD* node = static_cast<hybridART::NodeD*>(n);
+	keys = node->key();
+	children = node->child();
+	count = node->count;
+      }
+      else {
+	hybridART::NodeDP* node = static_cast<hybridART::NodeDP*>(n);
+	keys = node->key();
+	children = node->child();
+	count = node->count;
+      }
+      unsigned i = KeySearch::lowerBound<true>(keys, count, keyByte ^ 128);
+      if (i == count)
+	return NULL;
+      pos = i;
+      exact = ((uint8_t)(keys[i] ^ 128) == keyByte);
+      return children[i];
+    }
+    case hybridART::NodeTypeF:
+    case hybridART::NodeTypeFP: {
+      NodeStatic** children = (n->type == hybridART::NodeTypeF)
+	? static_cast<hybridART::NodeF*>(n)->child
+	: static_cast<hybridART::NodeFP*>(n)->child();
+      for (unsigned i = keyByte; i < 256; i++)
+	if (children[i]) {
+	  pos = i;
+	  exact = (i == keyByte);
+	  return children[i];
+	}
+      return NULL;
+    }
+    }
+    return NULL;
+  }
+
+  static inline NodeStatic* nextChild(NodeStatic* n, unsigned& pos) {
+    switch (n->type) {
+    case hybridART::NodeTypeD: {
+      hybridART::NodeD* node = static_cast<hybridART::NodeD*>(n);
+      if (pos + 1 < node->count)
+	return node->child()[++pos];
+      return NULL;
+    }
+    case hybridART::NodeTypeDP: {
+      hybridART::NodeDP* node = static_cast<hybridART::NodeDP*>(n);
+      if (pos + 1 < node->count)
+	return node->child()[++pos];
+      return NULL;
+    }
+    case hybridART::NodeTypeF:
+    case hybridART::NodeTypeFP: {
+      bool exact;
+      return (pos < 255) ? lowerChild(n, pos + 1, pos, exact) : NULL;
+    }
+    }
+    return NULL;
+  }
+};
+
+//==============================================================
+// CURSOR
+//==============================================================
+// Position in one tree: the path from the root to the current leaf.
+// Every inner node consumes at least one key byte, so the depth of a
+// tree is bounded by the key length, variable-length keys included.
+template<class Tree, typename N>
+class hybridART_Cursor {
+ public:
+  static const unsigned MAX_DEPTH = hybridART::MaxVarKeyLength + 1;
+
+  hybridART_Cursor() : tree(NULL), depth(0), leaf(NULL) {}
+
+  void init(Tree* t) {
+    tree = t;
+    key_length = t->getKeyLength();
+    depth = 0;
+    leaf = NULL;
+  }
+
+  // Current leaf, NULL when the cursor is past the end.
+  inline N* current() const {
+    return leaf;
+  }
+
+  // Moves to the first leaf whose key is >= key (> key if exclusive).
+  // Returns false if a node changed under the cursor; seek again.
+  bool seek(N* root, const uint8_t key[], bool exclusive) {
+    depth = 0;
+    leaf = NULL;
+    if (!root)
+      return true;
+    if (tree->isLeaf(root)) {
+      leaf = root;
+      return checkLeaf(key, exclusive);
+    }
+
+    N* node = root;
+    unsigned keyDepth = 0;
+    while (true) {
+      uint64_t v;
+      if (!Tree::readLock(node, v))
+	return false;
+
+      unsigned prefixLength = hybridART_Slots::prefixLength(node);
+      if (prefixLength) {
+	int cmp;
+	if (!comparePrefix(node, prefixLength, key, keyDepth, cmp) || !Tree::validate(node, v))
+	  return false;
+	if (cmp < 0) // key is below the whole subtree
+	  return descend(node);
+	if (cmp > 0) // key is above the whole subtree
+	  return advance();
+	keyDepth += prefixLength;
+      }
+      if (keyDepth >= key_length)
+	return descend(node);
+
+      unsigned pos;
+      bool exact;
+      N* child = tree->resolve(hybridART_Slots::lowerChild(node, key[keyDepth], pos, exact));
+      if (!Tree::validate(node, v))
+	return false;
+      if (!child)
+	return advance();
+      push(node, v, pos);
+
+      if (tree->isLeaf(child)) {
+	leaf = child;
+	return exact ? checkLeaf(key, exclusive) : true;
+      }
+      if (!exact)
+	return descend(child);
+      node = child;
+      keyDepth++;
+    }
+  }
+
+  // Moves to the next leaf. Returns false if a node changed under the
+  // cursor; seek past the last key again.
+  bool advance() {
+    while (depth > 0) {
+      Entry& e = stack[depth - 1];
+      N* child = tree->resolve(hybridART_Slots::nextChild(e.node, e.pos));
+      if (!Tree::validate(e.node, e.version))
+	return false;
+      if (child) {
+	if (tree->isLeaf(child)) {
+	  leaf = child;
+	  return true;
+	}
+	return descend(child);
+      }
+      depth--;
+    }
+    leaf = NULL;
+    return true;
+  }
+
+ private:
+  struct Entry {
+    N* node;
+    uint64_t version;
+    unsigned pos;
+  };
+
+  inline void push(N* node, uint64_t version, unsigned pos) {
+    stack[depth].node = node;
+    stack[depth].version = version;
+    stack[depth].pos = pos;
+    depth++;
+  }
+
+  // Moves to the smallest leaf below node.
+  bool descend(N* node) {
+    while (true) {
+      uint64_t v;
+      if (!Tree::readLock(node, v))
+	return false;
+      unsigned pos;
+      bool exact;
+      N* child = tree->resolve(hybridART_Slots::lowerChild(node, 0, pos, exact));
+      if (!Tree::validate(node, v))
+	return false;
+      if (!child) // empty (root) node
+	return advance();
+      push(node, v, pos);
+      if (tree->isLeaf(child)) {
+	leaf = child;
+	return true;
+      }
+      node = child;
+    }
+  }
+
+  // Compares the key bytes at keyDepth with the prefix of node. Bytes
+  // past maxPrefixLength are not stored and come from any leaf below.
+  bool comparePrefix(N* node, unsigned prefixLength, const uint8_t key[], unsigned keyDepth, int& cmp) {
+    const uint8_t* prefix = hybridART_Slots::prefix(node);
+    unsigned stored = prefixLength < hybridART::maxPrefixLength ? prefixLength : hybridART::maxPrefixLength;
+    for (unsigned i = 0; i < stored && keyDepth + i < key_length; i++)
+      if (key[keyDepth + i] != prefix[i]) {
+	cmp = (key[keyDepth + i] < prefix[i]) ? -1 : 1;
+	return true;
+      }
+    cmp = 0;
+    if (prefixLength <= stored)
+      return true;
+    uint8_t leafKey[MAX_DEPTH];
+    if (!tree->anyLeafKey(node, leafKey))
+      return false;
+    for (unsigned i = keyDepth + stored; i < keyDepth + prefixLength && i < key_length; i++)
+      if (key[i] != leafKey[i]) {
+	cmp = (key[i] < leafKey[i]) ? -1 : 1;
+	return true;
+      }
+    return true;
+  }
+
+  // The path matched key so far; skip the leaf if its key is smaller.
+  bool checkLeaf(const uint8_t key[], bool exclusive) {
+    uint8_t leafKey[MAX_DEPTH];
+    tree->loadKey(tree->getLeafValue(leaf), leafKey, key_length);
+    int cmp = memcmp(leafKey, key, key_length);
+    if (cmp < 0 || (cmp == 0 && exclusive))
+      return advance();
+    return true;
+  }
+
+  Tree* tree;
+  unsigned key_length;
+  Entry stack[MAX_DEPTH];
+  unsigned depth;
+  N* leaf;
+};
+
+//==============================================================
+// ITERATOR
+//==============================================================
+template<class Tree>
+class hybridART_Iterator {
+ public:
+  typedef hybridART::Node Node;
+  typedef hybridART::NodeStatic NodeStatic;
+  static const unsigned MAX_KEY_LENGTH = hybridART_Cursor<Tree, Node>::MAX_DEPTH - 1;
+
+  hybridART_Iterator(Tree* t) : tree(t), key_length(t->getKeyLength()), current(-1) {
+    if (key_length > MAX_KEY_LENGTH) {
+      std::cout << "KEY TOO LONG FOR hybridART_Iterator!\n";
+      exit(1);
+    }
+    dynamic_cursor.init(t);
+    frozen_cursor.init(t);
+    static_cursor.init(t);
+  }
+
+  // Positions the iterator at the smallest key >= key.
+  void seek(const uint8_t key[]) {
+    dynamic_root = tree->getRoot();
+    frozen_root = tree->getFrozenRoot();
+    static_root = tree->getStaticRoot();
+    while (!dynamic_cursor.seek(dynamic_root, key, false));
+    while (!frozen_cursor.seek(frozen_root, key, false));
+    while (!static_cursor.seek(static_root, key, false));
+    for (int s = 0; s < STREAMS; s++)
+      loadHead(s);
+    pick();
+  }
+
+  inline bool valid() const {
+    return current >= 0;
+  }
+
+  inline uint64_t value() {
+    if (current == STATIC)
+      return tree->getLeafValue(static_cursor.current());
+    if (current == FROZEN)
+      return tree->getLeafValue(frozen_cursor.current());
+    return tree->getLeafValue(dynamic_cursor.current());
+  }
+
+  // Copies the current key into key[0..key length).
+  inline void key(uint8_t key[]) const {
+    memcpy(key, head_key[current], key_length);
+  }
+
+  void next() {
+    if (current < 0)
+      return;
+    uint8_t last[MAX_KEY_LENGTH];
+    memcpy(last, head_key[current], key_length);
+    // older copies of the key are shadowed by the one just returned
+    for (int s = 0; s < STREAMS; s++)
+      if (has_head[s] && memcmp(head_key[s], last, key_length) == 0)
+	advance(s, last);
+    pick();
+  }
+
+ private:
+  enum { DYNAMIC = 0, FROZEN = 1, STATIC = 2, STREAMS = 3 };
+
+  void advance(int s, const uint8_t last[]) {
+    if (s == DYNAMIC) {
+      if (!dynamic_cursor.advance())
+	while (!dynamic_cursor.seek(dynamic_root, last, true));
+    }
+    else if (s == FROZEN) {
+      if (!frozen_cursor.advance())
+	while (!frozen_cursor.seek(frozen_root, last, true));
+    }
+    else
+      static_cursor.advance();
+    loadHead(s);
+  }
+
+  void loadHead(int s) {
+    Node* leaf;
+    if (s == DYNAMIC)
+      leaf = dynamic_cursor.current();
+    else if (s == FROZEN)
+      leaf = frozen_cursor.current();
+    else
+      leaf = (Node*)static_cursor.current(); // same leaf encoding
+    has_head[s] = (leaf != NULL);
+    if (has_head[s])
+      tree->loadKey(tree->getLeafValue(leaf), head_key[s], key_length);
+  }
+
+  // Smallest head; the newest tree wins ties.
+  void pick() {
+    current = -1;
+    for (int s = 0; s < STREAMS; s++)
+      if (has_head[s] && (current < 0 || memcmp(head_key[s], head_key[current], key_length) < 0))
+	current = s;
+  }
+
+  Tree* tree;
+  unsigned key_length;
+  Node* dynamic_root;
+  Node* frozen_root;
+  NodeStatic* static_root;
+  hybridART_Cursor<Tree, Node> dynamic_cursor;
+  hybridART_Cursor<Tree, Node> frozen_cursor;
+  hybridART_Cursor<Tree, NodeStatic> static_cursor;
+  bool has_head[STREAMS];
+  uint8_t head_key[STREAMS][MAX_KEY_LENGTH];
+  int current;
+};
@@ -0,0 +1,151 @@
+/*
+  Byte search in the sorted key arrays of the static nodes (NodeD,
+  NodeDP: sign-flipped keys; NodeU: plain keys) and of Node16.
+
+  Each search has a scalar, an SSE2 and an AVX2 version. The AVX2 one is
+  compiled with a target attribute and picked at run time, so the binary
+  still runs on machines without AVX2. The vector versions read up to a
+  full vector past the last key; every node type keeps its child
+  pointers right after the keys, so for count >= SIMD_MIN_COUNT the read
+  stays inside the node.
+ */
+
+#include <stdint.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+
+class KeySearch {
+ public:
+  // Below this many keys the scalar loop wins and the vector loads could
+  // run past the end of the node.
+  static const unsigned SIMD_MIN_COUNT = 5;
+
+  enum Level { SCALAR = 0, SSE2 = 1, AVX2 = 2 };
+
+  // Best level the CPU supports, detected once.
+  static inline Level detected() {
+    static const Level level = detect();
+    return level;
+  }
+
+  //************************************************************************************************
+  //Exact Match
+  //************************************************************************************************
+  // Position of key in keys[0..count), -1 if absent. Keys are stored as
+  // they are compared, so this works for flipped and plain keys alike.
+
+  static inline int findScalar(const uint8_t* keys, unsigned count, uint8_t key) {
+    for (unsigned i = 0; i < count; i++)
+      if (keys[i] == key)
+	return i;
+    return -1;
+  }
+
+  static inline int findSSE2(const uint8_t* keys, unsigned count, uint8_t key) {
+    __m128i k = _mm_set1_epi8(key);
+    for (unsigned i = 0; i < count; i += 16) {
+      __m128i cmp = _mm_cmpeq_epi8(k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)));
+      unsigned bitfield = _mm_movemask_epi8(cmp) & tailMask16(count - i);
+      if (bitfield)
+	return i + __builtin_ctz(bitfield);
+    }
+    return -1;
+  }
+
+  __attribute__((target("avx2")))
+  static int findAVX2(const uint8_t* keys, unsigned count, uint8_t key) {
+    __m256i k = _mm256_set1_epi8(key);
+    for (unsigned i = 0; i < count; i += 32) {
+      __m256i cmp = _mm256_cmpeq_epi8(k, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)));
+      unsigned bitfield = (unsigned)_mm256_movemask_epi8(cmp) & tailMask32(count - i);
+      if (bitfield)
+	return i + __builtin_ctz(bitfield);
+    }
+    return -1;
+  }
+
+  static inline int find(const uint8_t* keys, unsigned count, uint8_t key) {
+    if (count < SIMD_MIN_COUNT)
+      return findScalar(keys, count, key);
+    if (count > 16 && detected() == AVX2)
+      return findAVX2(keys, count, key);
+    return findSSE2(keys, count, key);
+  }
+
+  //************************************************************************************************
+  //Lower Bound
+  //************************************************************************************************
+  // Position of the first key >= key in the sorted keys[0..count), count
+  // if there is none. Flipped = keys (and key) are sign-flipped and
+  // sorted as signed bytes, otherwise they are plain unsigned bytes.
+
+  template<bool Flipped>
+  static inline unsigned lowerBoundScalar(const uint8_t* keys, unsigned count, uint8_t key) {
+    unsigned i = 0;
+    if (Flipped)
+      while (i < count && (int8_t)keys[i] < (int8_t)key)
+	i++;
+    else
+      while (i < count && keys[i] < key)
+	i++;
+    return i;
+  }
+
+  template<bool Flipped>
+  static inline unsigned lowerBoundSSE2(const uint8_t* keys, unsigned count, uint8_t key) {
+    // compare as signed bytes; plain keys get their sign bit flipped first
+    const __m128i flip = _mm_set1_epi8(Flipped ? 0 : (char)0x80);
+    __m128i k = _mm_xor_si128(_mm_set1_epi8(key), flip);
+    for (unsigned i = 0; i < count; i += 16) {
+      __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), flip);
+      unsigned valid = tailMask16(count - i);
+      unsigned less = _mm_movemask_epi8(_mm_cmplt_epi8(v, k)) & valid;
+      if (less != valid)
+	return i + __builtin_ctz(~less & valid);
+    }
+    return count;
+  }
+
+  template<bool Flipped>
+  __attribute__((target("avx2")))
+  static unsigned lowerBoundAVX2(const uint8_t* keys, unsigned count, uint8_t key) {
+    const __m256i flip = _mm256_set1_epi8(Flipped ? 0 : (char)0x80);
+    __m256i k = _mm256_xor_si256(_mm256_set1_epi8(key), flip);
+    for (unsigned i = 0; i < count; i += 32) {
+      __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), flip);
+      unsigned valid = tailMask32(count - i);
+      unsigned less = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(k, v)) & valid;
+      if (less != valid)
+	return i + __builtin_ctz(~less & valid);
+    }
+    return count;
+  }
+
+  template<bool Flipped>
+  static inline unsigned lowerBound(const uint8_t* keys, unsigned count, uint8_t key) {
+    if (count < SIMD_MIN_COUNT)
+      return lowerBoundScalar<Flipped>(keys, count, key);
+    if (count > 16 && detected() == AVX2)
+      return lowerBoundAVX2<Flipped>(keys, count, key);
+    return lowerBoundSSE2<Flipped>(keys, count, key);
+  }
+
+ private:
+  static Level detect() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+      return AVX2;
+#endif
+    return SSE2;
+  }
+
+  // lanes [0, remaining) of a 16/32-lane compare
+  static inline unsigned tailMask16(unsigned remaining) {
+    return remaining >= 16 ? 0xFFFF : (1u << remaining) - 1;
+  }
+
+  static inline unsigned tailMask32(unsigned remaining) {
+    return remaining >= 32 ? 0xFFFFFFFFu : (1u << remaining) - 1;
+  }
+};
@@ -0,0 +1,200 @@
+/*
+  Node memory for hybridART.
+
+  SlabPool hands out the fixed-size dynamic nodes. Sizes are rounded up
+  to whole cache lines and every size class keeps its own free list, so
+  a node freed by a grow is reused by the next node of its size; new
+  nodes are cut from 1MB slabs. A dynamic tree lives in one pool, and
+  once a merge has converted it the pool is dropped as a whole.
+
+  NodeArena bump-allocates the variable-size static nodes from 1MB
+  chunks and frees nothing but all of them at once. A merge builds its
+  intermediate nodes in a scratch arena and copies the nodes it made
+  into an arena of its own; subtrees it kept from the old static tree
+  stay where they are. The chunks are aligned to their size, so owns()
+  finds the arena of a node from its address alone.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+class SlabPool {
+ public:
+  static const size_t SLAB_SIZE = 1 << 20;
+  static const size_t CLASS_SIZE = 64; // size classes are whole cache lines
+  static const size_t MAX_SIZE = 4096;
+  static const unsigned NUM_CLASSES = MAX_SIZE / CLASS_SIZE + 1;
+
+  SlabPool() : cur(NULL), end(NULL) {
+    for (unsigned i = 0; i < NUM_CLASSES; i++)
+      free_list[i] = NULL;
+  }
+
+  ~SlabPool() {
+    release();
+  }
+
+  inline void* allocate(size_t size) {
+    unsigned c = sizeClass(size);
+    void* ptr = free_list[c];
+    if (ptr) {
+      free_list[c] = *(void**)ptr;
+      return ptr;
+    }
+    size_t bytes = c * CLASS_SIZE;
+    if (cur + bytes > end)
+      newSlab();
+    ptr = cur;
+    cur += bytes;
+    return ptr;
+  }
+
+  inline void deallocate(void* ptr, size_t size) {
+    unsigned c = sizeClass(size);
+    *(void**)ptr = free_list[c];
+    free_list[c] = ptr;
+  }
+
+  // Frees every slab; all nodes of the pool are gone.
+  void release() {
+    for (size_t i = 0; i < slabs.size(); i++)
+      free(slabs[i]);
+    std::vector<void*>().swap(slabs);
+    cur = end = NULL;
+    for (unsigned i = 0; i < NUM_CLASSES; i++)
+      free_list[i] = NULL;
+  }
+
+  // Releases this pool and moves the slabs of other into it, leaving
+  // other empty.
+  void take(SlabPool& other) {
+    release();
+    slabs.swap(other.slabs);
+    cur = other.cur;
+    end = other.end;
+    for (unsigned i = 0; i < NUM_CLASSES; i++)
+      free_list[i] = other.free_list[i];
+    other.cur = other.end = NULL;
+    for (unsigned i = 0; i < NUM_CLASSES; i++)
+      other.free_list[i] = NULL;
+  }
+
+  // bytes held, free list entries and rounding included
+  uint64_t getMemory() const {
+    return slabs.size() * SLAB_SIZE;
+  }
+
+ private:
+  static inline unsigned sizeClass(size_t size) {
+    return (size + CLASS_SIZE - 1) / CLASS_SIZE;
+  }
+
+  void newSlab() {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, CLASS_SIZE, SLAB_SIZE) != 0) {
+      std::cout << "SLAB ALLOCATION FAIL!\n";
+      exit(1);
+    }
+    slabs.push_back(ptr);
+    cur = (char*)ptr;
+    end = cur + SLAB_SIZE;
+  }
+
+  std::vector<void*> slabs;
+  char* cur;
+  char* end;
+  void* free_list[NUM_CLASSES];
+};
+
+class NodeArena {
+ public:
+  static const size_t CHUNK_SIZE = 1 << 20;
+  static const size_t ALIGN = 8;
+
+  NodeArena() : cur(NULL), end(NULL) {}
+
+  ~NodeArena() {
+    release();
+  }
+
+  inline void* allocate(size_t size) {
+    size = (size + ALIGN - 1) & ~(ALIGN - 1);
+    if (cur + size > end)
+      newChunk();
+    void* ptr = cur;
+    cur += size;
+    return ptr;
+  }
+
+  // Frees every chunk; all nodes of the arena are gone.
+  void release() {
+    for (size_t i = 0; i < chunks.size(); i++)
+      free(chunks[i]);
+    std::vector<void*>().swap(chunks);
+    cur = end = NULL;
+  }
+
+  // Frees every chunk but one and allocates from its start again; the
+  // nodes are gone as with release(), but an arena that is filled and
+  // dropped over and over does not go back to malloc every time.
+  void reset() {
+    if (chunks.empty())
+      return;
+    void* keep = chunks.back();
+    for (size_t i = 0; i + 1 < chunks.size(); i++)
+      free(chunks[i]);
+    chunks.assign(1, keep);
+    cur = (char*)keep;
+    end = cur + CHUNK_SIZE;
+  }
+
+  // Releases this arena and moves the chunks of other into it, leaving
+  // other empty.
+  void take(NodeArena& other) {
+    release();
+    chunks.swap(other.chunks);
+    cur = other.cur;
+    end = other.end;
+    other.cur = other.end = NULL;
+  }
+
+  // Moves the chunks of other into this arena, leaving other empty.
+  // Nodes of both stay where they are, and this arena keeps allocating
+  // from the chunk it was filling.
+  void append(NodeArena& other) {
+    chunks.insert(chunks.end(), other.chunks.begin(), other.chunks.end());
+    std::sort(chunks.begin(), chunks.end());
+    std::vector<void*>().swap(other.chunks);
+    other.cur = other.end = NULL;
+  }
+
+  // true if ptr was allocated from this arena
+  inline bool owns(const void* ptr) const {
+    void* chunk = (void*)((uintptr_t)ptr & ~(uintptr_t)(CHUNK_SIZE - 1));
+    return std::binary_search(chunks.begin(), chunks.end(), chunk);
+  }
+
+  // bytes held, the unused tail of the last chunk included
+  uint64_t getMemory() const {
+    return chunks.size() * CHUNK_SIZE;
+  }
+
+ private:
+  void newChunk() {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, CHUNK_SIZE, CHUNK_SIZE) != 0) {
+      std::cout << "ARENA ALLOCATION FAIL!\n";
+      exit(1);
+    }
+    chunks.insert(std::upper_bound(chunks.begin(), chunks.end(), ptr), ptr);
+    cur = (char*)ptr;
+    end = cur + CHUNK_SIZE;
+  }
+
+  std::vector<void*> chunks; // sorted by address
+  char* cur;
+  char* end;
+};
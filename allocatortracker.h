@@ -15,7 +15,7 @@ template<typename ValueType>
 class AllocatorTracker : public std::allocator<ValueType> {
 public:
   typedef typename std::allocator<ValueType> BaseAllocator;
-  typedef typename BaseAllocator::pointer pointer;
+  typedef ValueType* pointer;
   typedef typename BaseAllocator::size_type size_type;
 
   // that's what we passed through copy constructor
@@ -49,8 +49,9 @@ public:
     return dataPtr;
   }
 
+  // the hint is dropped, std::allocator no longer takes one since C++20
   pointer allocate(size_type size, void* ptr) {
-    pointer dataPtr = BaseAllocator::allocate(size, ptr);
+    pointer dataPtr = BaseAllocator::allocate(size);
     *memory_size += size * sizeof(ValueType);
     //VOLT_TRACE("allocate +++++++ %p %lu.\n", dataPtr, size * sizeof(ValueType));
     //VOLT_TRACE("%s\n", typeid(ValueType).name());
@@ -58,7 +59,7 @@ public:
   }
 
   pointer allocate(size_type size, pointer ptr) {
-    pointer dataPtr = BaseAllocator::allocate(size, ptr);
+    pointer dataPtr = BaseAllocator::allocate(size);
     *memory_size += size * sizeof(ValueType);
     //VOLT_TRACE("allocate +++++++ %p %lu.\n", dataPtr, size * sizeof(ValueType));
     //VOLT_TRACE("%s\n", typeid(ValueType).name());
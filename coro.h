@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <vector>
+
+//==============================================================
+// COROUTINE LOOKUPS
+//==============================================================
+// An Index::find_coro() lookup is a coroutine that suspends every time
+// it has prefetched the next node of its path. interleave_finds() keeps
+// a group of them in flight and resumes them round-robin, so that by the
+// time a lookup is resumed its node has (ideally) arrived in the cache.
+
+// Coroutine frames are recycled through a per-thread free list, so that
+// starting a lookup does not go through malloc.
+struct FramePool {
+  static const size_t FRAME_SIZE = 256; // larger frames use operator new
+
+  std::vector<void*> frames;
+
+  ~FramePool() {
+    for (size_t i = 0; i < frames.size(); i++)
+      ::operator delete(frames[i]);
+  }
+};
+
+inline FramePool &frame_pool() {
+  static thread_local FramePool pool;
+  return pool;
+}
+
+class LookupTask {
+ public:
+  struct promise_type {
+    uint64_t value;
+
+    LookupTask get_return_object() {
+      return LookupTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    // a lookup does nothing until the scheduler first resumes it
+    std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+    std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+    void return_value(uint64_t v) { value = v; }
+    void unhandled_exception() { std::terminate(); }
+
+    static void *operator new(size_t size) {
+      FramePool &pool = frame_pool();
+      if (size > FramePool::FRAME_SIZE)
+	return ::operator new(size);
+      if (pool.frames.empty())
+	return ::operator new(FramePool::FRAME_SIZE);
+      void *frame = pool.frames.back();
+      pool.frames.pop_back();
+      return frame;
+    }
+
+    static void operator delete(void *frame, size_t size) {
+      if (size > FramePool::FRAME_SIZE)
+	::operator delete(frame);
+      else
+	frame_pool().frames.push_back(frame);
+    }
+  };
+
+  LookupTask() : handle(NULL) {}
+
+  explicit LookupTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+  LookupTask(LookupTask &&other) : handle(other.handle) {
+    other.handle = NULL;
+  }
+
+  LookupTask &operator=(LookupTask &&other) {
+    if (this != &other) {
+      if (handle)
+	handle.destroy();
+      handle = other.handle;
+      other.handle = NULL;
+    }
+    return *this;
+  }
+
+  LookupTask(const LookupTask&) = delete;
+  LookupTask &operator=(const LookupTask&) = delete;
+
+  ~LookupTask() {
+    if (handle)
+      handle.destroy();
+  }
+
+  // Runs the lookup up to its next suspension; true once it is over.
+  bool resume() {
+    handle.resume();
+    return handle.done();
+  }
+
+  uint64_t value() const {
+    return handle.promise().value;
+  }
+
+ private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+static const size_t CORO_MAX_GROUP = 64;
+
+// Most consecutive READs the drivers hand to one interleave_finds() call.
+// The group only drains at the end of a run, so runs are kept long.
+static const size_t CORO_RUN = 1024;
+
+// out[i] = idx->find_coro(keys[i]) for i < n, with up to group lookups
+// in flight. A slot whose lookup is over takes the next key right away,
+// so the group stays full until the keys run out.
+template<typename IndexType, typename KeyType>
+inline void interleave_finds(IndexType *idx, const KeyType *keys, size_t n, size_t group, uint64_t *out) {
+  LookupTask tasks[CORO_MAX_GROUP];
+  size_t owner[CORO_MAX_GROUP];
+  if (group > CORO_MAX_GROUP)
+    group = CORO_MAX_GROUP;
+
+  size_t next = 0;
+  size_t active = 0;
+  for ( ; active < group && next < n; active++, next++) {
+    tasks[active] = idx->find_coro(keys[next]);
+    owner[active] = next;
+  }
+
+  size_t slots = active;
+  while (active) {
+    for (size_t s = 0; s < slots; s++) {
+      if (owner[s] == n || !tasks[s].resume())
+	continue;
+      out[owner[s]] = tasks[s].value();
+      if (next < n) {
+	tasks[s] = idx->find_coro(keys[next]);
+	owner[s] = next++;
+      }
+      else {
+	owner[s] = n; // slot drained
+	active--;
+      }
+    }
+  }
+}
@@ -0,0 +1,243 @@
+/*
+  Hybrid B+tree: a small stx::btree takes the writes and is merged now
+  and then into a packed, read-only sorted layout, the same dual-stage
+  design as hybridART.
+
+  The static stage keeps all keys in one sorted array and all values in
+  a parallel one; a leaf is a block of NODE_SLOTS consecutive keys, so
+  leaves are 100% full and need no pointers. The inner levels above
+  them are arrays too: entry i of a level is the largest key under its
+  i-th child, and node j of a level covers entries [j * NODE_SLOTS,
+  (j + 1) * NODE_SLOTS). A search reads one node per level.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "../stx/btree_map.h"
+
+template<typename Key, typename Compare = std::less<Key>,
+	 typename Alloc = std::allocator<std::pair<Key, uint64_t> > >
+class hybridBtree {
+
+public:
+  static const unsigned MERGE=1;
+  static const unsigned MERGE_THOLD=1000000;
+  static const unsigned MERGE_RATIO=10;
+
+  // keys per static node (leaf or inner), about 256 bytes of keys
+  static const size_t NODE_SLOTS = BTREE_MAX(8, 256 / sizeof(Key));
+
+  typedef stx::btree_map<Key, uint64_t, Compare, stx::btree_default_map_traits<Key, uint64_t>, Alloc> DynamicTree;
+
+  hybridBtree(const Compare& comp = Compare(), const Alloc& alloc = Alloc())
+    : dynamic(comp, alloc), key_less(comp), num_merges(0) {}
+
+  // false if key is already in either stage
+  bool insert(const Key& key, uint64_t value) {
+    if (static_find(key) != static_keys.size())
+      return false;
+    if (!dynamic.insert(key, value).second)
+      return false;
+    check_merge();
+    return true;
+  }
+
+  // Updates key where it is, the static stage included, and inserts it
+  // into the dynamic stage otherwise.
+  void upsert(const Key& key, uint64_t value) {
+    typename DynamicTree::iterator it = dynamic.find(key);
+    if (it != dynamic.end()) {
+      it.data() = value;
+      return;
+    }
+    size_t pos = static_find(key);
+    if (pos != static_keys.size()) {
+      static_values[pos] = value;
+      return;
+    }
+    dynamic.insert(key, value);
+    check_merge();
+  }
+
+  // true and value set if key is in either stage
+  bool lookup(const Key& key, uint64_t& value) const {
+    typename DynamicTree::const_iterator it = dynamic.find(key);
+    if (it != dynamic.end()) {
+      value = it->second;
+      return true;
+    }
+    size_t pos = static_find(key);
+    if (pos == static_keys.size())
+      return false;
+    value = static_values[pos];
+    return true;
+  }
+
+  // Sum of the values of the first range + 1 keys >= key, the two stages
+  // walked in key order. found is false if there is no such key.
+  uint64_t scan(const Key& key, int range, bool& found) const {
+    typename DynamicTree::const_iterator it = dynamic.lower_bound(key);
+    size_t pos = static_lower_bound(key);
+    uint64_t sum = 0;
+    found = (it != dynamic.end() || pos != static_keys.size());
+    for (int i = 0; i <= range; i++) {
+      bool dynamic_valid = (it != dynamic.end());
+      bool static_valid = (pos != static_keys.size());
+      if (!dynamic_valid && !static_valid)
+	break;
+      if (dynamic_valid && (!static_valid || key_less(it->first, static_keys[pos]))) {
+	sum += it->second;
+	++it;
+      }
+      else {
+	sum += static_values[pos];
+	pos++;
+      }
+    }
+    return sum;
+  }
+
+  // merges whatever the dynamic stage holds
+  void merge() {
+    if (!dynamic.empty())
+      merge_trees();
+  }
+
+  size_t dynamic_items() const {
+    return dynamic.size();
+  }
+
+  size_t static_items() const {
+    return static_keys.size();
+  }
+
+  // bytes of the static stage; the dynamic stage is accounted by Alloc
+  uint64_t getStaticMemory() const {
+    uint64_t memory = static_keys.capacity() * sizeof(Key) + static_values.capacity() * sizeof(uint64_t);
+    for (size_t l = 0; l < levels.size(); l++)
+      memory += levels[l].capacity() * sizeof(Key);
+    return memory;
+  }
+
+  void tree_info() const {
+    std::cout << "dynamic items = " << dynamic.size() << "\n";
+    std::cout << "static items = " << static_keys.size() << "\n";
+    std::cout << "static levels = " << (levels.size() + (static_keys.empty() ? 0 : 1)) << "\n";
+    std::cout << "static memory = " << getStaticMemory() << "\n";
+    std::cout << "merges = " << num_merges << "\n";
+  }
+
+private:
+  typedef stx::btree_simd_search<Key, Compare> simd_search;
+
+  //************************************************************************************************
+  //Static Search
+  //************************************************************************************************
+
+  // first of the n sorted keys that is >= key, n if none
+  inline size_t search_node(const Key* keys, size_t n, const Key& key) const {
+    if (simd_search::enabled)
+      return simd_search::template search<false>(keys, n, key);
+    return std::lower_bound(keys, keys + n, key, key_less) - keys;
+  }
+
+  // position of the first static key >= key, static_keys.size() if none
+  size_t static_lower_bound(const Key& key) const {
+    size_t pos = 0;
+    for (size_t l = levels.size(); l-- > 0; ) {
+      const std::vector<Key>& level = levels[l];
+      size_t begin = pos * NODE_SLOTS;
+      size_t n = std::min(NODE_SLOTS, level.size() - begin);
+      size_t slot = search_node(&level[begin], n, key);
+      // only the root can miss: a parent entry is the largest key below it
+      if (slot == n)
+	return static_keys.size();
+      pos = begin + slot;
+    }
+    size_t begin = pos * NODE_SLOTS;
+    if (begin >= static_keys.size())
+      return static_keys.size();
+    size_t n = std::min(NODE_SLOTS, static_keys.size() - begin);
+    return begin + search_node(&static_keys[begin], n, key);
+  }
+
+  // position of key in the static stage, static_keys.size() if absent
+  inline size_t static_find(const Key& key) const {
+    size_t pos = static_lower_bound(key);
+    if (pos != static_keys.size() && key_less(key, static_keys[pos]))
+      return static_keys.size();
+    return pos;
+  }
+
+  //************************************************************************************************
+  //Merge
+  //************************************************************************************************
+
+  inline void check_merge() {
+    if (MERGE && dynamic.size() > MERGE_THOLD && dynamic.size() * MERGE_RATIO > static_keys.size())
+      merge_trees();
+  }
+
+  // Merges the dynamic stage into new static arrays, sized exactly, and
+  // rebuilds the inner levels over them. The stages never share a key.
+  void merge_trees() {
+    size_t num_items = static_keys.size() + dynamic.size();
+    std::vector<Key> keys;
+    std::vector<uint64_t> values;
+    keys.reserve(num_items);
+    values.reserve(num_items);
+
+    typename DynamicTree::const_iterator it = dynamic.begin();
+    size_t pos = 0;
+    while (it != dynamic.end() || pos != static_keys.size()) {
+      if (it != dynamic.end() && (pos == static_keys.size() || key_less(it->first, static_keys[pos]))) {
+	keys.push_back(it->first);
+	values.push_back(it->second);
+	++it;
+      }
+      else {
+	keys.push_back(static_keys[pos]);
+	values.push_back(static_values[pos]);
+	pos++;
+      }
+    }
+
+    static_keys.swap(keys);
+    static_values.swap(values);
+    dynamic.clear();
+    build_levels();
+    num_merges++;
+  }
+
+  void build_levels() {
+    levels.clear();
+    size_t below_size = static_keys.size();
+    while (below_size > NODE_SLOTS) {
+      // levels grows below, so the level underneath is looked up afresh
+      const Key* below = levels.empty() ? &static_keys[0] : &levels.back()[0];
+      size_t num_nodes = (below_size + NODE_SLOTS - 1) / NODE_SLOTS;
+      std::vector<Key> level;
+      level.reserve(num_nodes);
+      for (size_t j = 0; j < num_nodes; j++)
+	level.push_back(below[std::min((j + 1) * NODE_SLOTS, below_size) - 1]);
+      levels.push_back(std::vector<Key>());
+      levels.back().swap(level);
+      below_size = num_nodes;
+    }
+  }
+
+  DynamicTree dynamic;
+  Compare key_less;
+
+  std::vector<Key> static_keys;
+  std::vector<uint64_t> static_values;
+  std::vector<std::vector<Key> > levels; // levels[0] is right above the leaves
+
+  uint64_t num_merges;
+};
@@ -1,8 +1,18 @@
 #include <iostream>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "indexkey.h"
+#include "parallelsort.h"
 #include "stx/btree_map.h"
 #include "stx/btree.h"
 #include "ART/hybridART.h"
+#include "ART/hybridART_OLC.h"
+#include "ART/hybridART_iterator.h"
+#include "hybrid_btree/hybridBtree.h"
+#include "coro.h"
 
 template<typename KeyType, class KeyComparator>
 class Index
@@ -12,6 +22,39 @@ class Index
 
   virtual uint64_t find(KeyType key) = 0;
 
+  // out[i] = find(keys[i]) for i < n. Indexes that can overlap the
+  // cache misses of several lookups override this.
+  virtual void find_batch(const KeyType* keys, size_t n, uint64_t* out) {
+    for (size_t i = 0; i < n; i++)
+      out[i] = find(keys[i]);
+  }
+
+  // find(key) as a coroutine for interleave_finds(), suspending after
+  // each prefetch of the next node. This one does the whole find() on
+  // the first resume.
+  virtual LookupTask find_coro(KeyType key) {
+    co_return find(key);
+  }
+
+  // Inserts keys[i] -> values[i] for i < n; false if any insert failed.
+  virtual bool insert_batch(const KeyType* keys, const uint64_t* values, size_t n) {
+    bool ok = true;
+    for (size_t i = 0; i < n; i++)
+      ok = insert(keys[i], values[i]) && ok;
+    return ok;
+  }
+
+  // Loads keys[i] -> values[i], i < n, into an empty index, sorting and
+  // building on num_threads threads where the index can. Of equal keys
+  // the first is kept, as insert() keeps it, and is not a failure; false
+  // only if the index cannot be built. This one inserts them one by one
+  // and ignores the inserts refused as duplicates.
+  virtual bool bulk_load(const KeyType* keys, const uint64_t* values, size_t n, int num_threads) {
+    for (size_t i = 0; i < n; i++)
+      insert(keys[i], values[i]);
+    return true;
+  }
+
   virtual bool upsert(KeyType key, uint64_t value) = 0;
 
   virtual uint64_t scan(KeyType key, int range) = 0;
@@ -19,15 +62,64 @@ class Index
   virtual int64_t getMemory() const = 0;
 
   virtual void merge() = 0;
+
+  // Threads for every later merge of the index into its read-optimized
+  // form, for indexes that can spread a merge; set before the index is
+  // used. This one ignores it.
+  virtual void setMergeThreads(int num_threads) {}
+
+  // Spreads every later merge over the following writes in steps of
+  // about budget_us microseconds, for indexes that can; set before the
+  // index is used. This one ignores it.
+  virtual void setMergeStepBudget(uint64_t budget_us) {}
+
+  // Index-specific statistics, printed at the end of a run.
+  virtual void printStats() {}
+
+  // Writes the index to a snapshot file, and fills an empty index from
+  // one. Both return false if the index has no snapshots or on error.
+  virtual bool save(const char* path) {
+    return false;
+  }
+
+  virtual bool load(const char* path) {
+    return false;
+  }
+
+  // Indexes that can be shared by several worker threads without
+  // external synchronization override this to return true.
+  virtual bool isThreadSafe() const {
+    return false;
+  }
 };
 
 
-template<typename KeyType, class KeyComparator>
+// Keys that are nothing but their bytes can be written to a snapshot
+// file as they are; VarKey and HeadKey point to their strings.
+template<typename KeyType>
+struct PlainKey {
+  static const bool value = true;
+};
+
+template<>
+struct PlainKey<VarKey> {
+  static const bool value = false;
+};
+
+template<std::size_t headSize>
+struct PlainKey<HeadKey<headSize> > {
+  static const bool value = false;
+};
+
+
+// AllocatorType is AllocatorTracker (one malloc per node) or
+// PoolAllocator (nodes cut from pooled 2MB chunks, see poolallocator.h)
+template<typename KeyType, class KeyComparator,
+	 class AllocatorType = AllocatorTracker<std::pair<const KeyType, uint64_t> > >
 class BtreeIndex : public Index<KeyType, KeyComparator>
 {
  public:
 
-  typedef AllocatorTracker<std::pair<const KeyType, uint64_t> > AllocatorType;
   typedef stx::btree_map<KeyType, uint64_t, KeyComparator, stx::btree_default_map_traits<KeyType, uint64_t>, AllocatorType> MapType;
 
   ~BtreeIndex() {
@@ -49,6 +141,59 @@ class BtreeIndex : public Index<KeyType, KeyComparator>
     return iter->second;
   }
 
+  void find_batch(const KeyType* keys, size_t n, uint64_t* out) {
+    typename MapType::const_iterator found[MapType::batch_group];
+    for (size_t b = 0; b < n; b += MapType::batch_group) {
+      size_t m = std::min<size_t>(n - b, MapType::batch_group);
+      idx->find_batch(keys + b, m, found);
+      for (size_t i = 0; i < m; i++) {
+	if (found[i] == idx->end()) {
+	  std::cout << "READ FAIL\n";
+	  out[b + i] = 0;
+	}
+	else
+	  out[b + i] = found[i]->second;
+      }
+    }
+  }
+
+  LookupTask find_coro(KeyType key) {
+    typename MapType::find_cursor cursor;
+    typename MapType::const_iterator found;
+    idx->find_begin(cursor);
+    while (!idx->find_step(key, cursor, found))
+      co_await std::suspend_always();
+    if (found == idx->end()) {
+      std::cout << "READ FAIL\n";
+      co_return 0;
+    }
+    co_return found->second;
+  }
+
+  // the interleaved searches pull the insert paths into the cache
+  bool insert_batch(const KeyType* keys, const uint64_t* values, size_t n) {
+    typename MapType::const_iterator found[MapType::batch_group];
+    bool ok = true;
+    for (size_t b = 0; b < n; b += MapType::batch_group) {
+      size_t m = std::min<size_t>(n - b, MapType::batch_group);
+      idx->find_batch(keys + b, m, found);
+      for (size_t i = 0; i < m; i++)
+	ok = insert(keys[b + i], values[b + i]) && ok;
+    }
+    return ok;
+  }
+
+  // Sorts the pairs on num_threads threads and fills the leaves of an
+  // empty tree with them, num_threads threads as well.
+  bool bulk_load(const KeyType* keys, const uint64_t* values, size_t n, int num_threads) {
+    if (!idx->empty())
+      return insert_batch(keys, values, n);
+    std::vector<PairType> pairs;
+    parallel_sort_pairs<KeyType, KeyComparator>(keys, values, n, num_threads, pairs);
+    idx->bulk_load(pairs.begin(), pairs.end(), num_threads);
+    return true;
+  }
+
   bool upsert(KeyType key, uint64_t value) {
     (*idx)[key] = value;
     return true;
@@ -82,16 +227,175 @@ class BtreeIndex : public Index<KeyType, KeyComparator>
     return;
   }
 
+  // The snapshot is the leaf level: a header and then the key/value
+  // pairs in key order, which load() maps and hands to bulk_load().
+  bool save(const char* path) {
+    if (!PlainKey<KeyType>::value) {
+      std::cout << "B+TREE SNAPSHOT NEEDS PLAIN KEYS!\n";
+      return false;
+    }
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+      std::cout << "OPENING B+TREE SNAPSHOT FAIL!\n";
+      return false;
+    }
+    SnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "BTREESNP", sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.pair_size = sizeof(PairType);
+    h.count = idx->size();
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    std::vector<PairType> buf;
+    buf.reserve(SNAPSHOT_BUFFER);
+    for (typename MapType::const_iterator it = idx->begin(); ok && it != idx->end(); ++it) {
+      buf.push_back(PairType(it->first, it->second));
+      if (buf.size() == SNAPSHOT_BUFFER) {
+	ok = fwrite(&buf[0], sizeof(PairType), buf.size(), f) == buf.size();
+	buf.clear();
+      }
+    }
+    if (ok && !buf.empty())
+      ok = fwrite(&buf[0], sizeof(PairType), buf.size(), f) == buf.size();
+    ok = (fclose(f) == 0) && ok;
+    if (!ok)
+      std::cout << "WRITING B+TREE SNAPSHOT FAIL!\n";
+    return ok;
+  }
+
+  bool load(const char* path) {
+    if (!PlainKey<KeyType>::value) {
+      std::cout << "B+TREE SNAPSHOT NEEDS PLAIN KEYS!\n";
+      return false;
+    }
+    if (!idx->empty()) {
+      std::cout << "LOADING B+TREE SNAPSHOT INTO NON-EMPTY TREE FAIL!\n";
+      return false;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      std::cout << "OPENING B+TREE SNAPSHOT FAIL!\n";
+      return false;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size >= sizeof(SnapshotHeader))
+      map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+      std::cout << "MAPPING B+TREE SNAPSHOT FAIL!\n";
+      return false;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    const SnapshotHeader* h = (const SnapshotHeader*)map;
+    bool ok = memcmp(h->magic, "BTREESNP", sizeof(h->magic)) == 0 && h->version == SNAPSHOT_VERSION
+      && h->pair_size == sizeof(PairType) && sizeof(SnapshotHeader) + h->count * sizeof(PairType) == (uint64_t)st.st_size;
+    if (ok) {
+      const PairType* pairs = (const PairType*)(h + 1);
+      idx->bulk_load(pairs, pairs + h->count);
+    }
+    else
+      std::cout << "BAD B+TREE SNAPSHOT!\n";
+    munmap(map, st.st_size);
+    return ok;
+  }
+
   BtreeIndex(uint64_t kt) {
     memory = 0;
     alloc = new AllocatorType(&memory);
     idx = new MapType(KeyComparator(), (*alloc));
   }
 
+  // PoolAllocator only: back the node pool with huge pages
+  BtreeIndex(uint64_t kt, bool huge_pages) {
+    memory = 0;
+    alloc = new AllocatorType(&memory, huge_pages);
+    idx = new MapType(KeyComparator(), (*alloc));
+  }
+
   MapType *idx;
   int64_t memory;
   AllocatorType *alloc;
   typename MapType::const_iterator iter;
+
+ private:
+  typedef std::pair<KeyType, uint64_t> PairType;
+
+  struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pair_size;
+    uint64_t count;
+    uint64_t reserved; // keeps the pairs 16-byte aligned
+  };
+
+  static const uint32_t SNAPSHOT_VERSION = 1;
+  static const size_t SNAPSHOT_BUFFER = 4096; // pairs per write
+};
+
+
+// stx::btree for recent writes, merged into a packed read-only layout
+// (see hybrid_btree/hybridBtree.h)
+template<typename KeyType, class KeyComparator>
+class HybridBtreeIndex : public Index<KeyType, KeyComparator>
+{
+ public:
+
+  typedef AllocatorTracker<std::pair<const KeyType, uint64_t> > AllocatorType;
+  typedef hybridBtree<KeyType, KeyComparator, AllocatorType> TreeType;
+
+  ~HybridBtreeIndex() {
+    delete idx;
+    delete alloc;
+  }
+
+  bool insert(KeyType key, uint64_t value) {
+    return idx->insert(key, value);
+  }
+
+  uint64_t find(KeyType key) {
+    uint64_t value;
+    if (!idx->lookup(key, value)) {
+      std::cout << "READ FAIL\n";
+      return 0;
+    }
+    return value;
+  }
+
+  bool upsert(KeyType key, uint64_t value) {
+    idx->upsert(key, value);
+    return true;
+  }
+
+  uint64_t scan(KeyType key, int range) {
+    bool found;
+    uint64_t sum = idx->scan(key, range, found);
+    if (!found)
+      std::cout << "SCAN FIRST READ FAIL\n";
+    return sum;
+  }
+
+  int64_t getMemory() const {
+    return memory + idx->getStaticMemory();
+  }
+
+  void merge() {
+    idx->merge();
+  }
+
+  void printStats() {
+    idx->tree_info();
+  }
+
+  HybridBtreeIndex(uint64_t kt) {
+    memory = 0;
+    alloc = new AllocatorType(&memory);
+    idx = new TreeType(KeyComparator(), (*alloc));
+  }
+
+  TreeType *idx;
+  int64_t memory;
+  AllocatorType *alloc;
 };
 
 
@@ -117,6 +421,56 @@ class ArtIndex : public Index<KeyType, KeyComparator>
     return idx->lookup(key_bytes, key_length, key_length);
   }
 
+  void find_batch(const KeyType* keys, size_t n, uint64_t* out) {
+    uint8_t bytes[hybridART::BATCH_GROUP][8];
+    uint8_t* batch_keys[hybridART::BATCH_GROUP];
+    for (size_t b = 0; b < n; b += hybridART::BATCH_GROUP) {
+      unsigned m = std::min<size_t>(n - b, hybridART::BATCH_GROUP);
+      for (unsigned i = 0; i < m; i++) {
+	loadKey(keys[b + i], bytes[i]);
+	batch_keys[i] = bytes[i];
+      }
+      idx->lookup_batch(batch_keys, m, key_length, key_length, out + b);
+    }
+  }
+
+  LookupTask find_coro(KeyType key) {
+    uint8_t bytes[8];
+    hybridART::LookupCursor cursor;
+    loadKey(key, bytes);
+    idx->lookup_begin(cursor, bytes);
+    while (!idx->lookup_step(cursor, bytes, key_length, key_length))
+      co_await std::suspend_always();
+    co_return cursor.value;
+  }
+
+  bool insert_batch(const KeyType* keys, const uint64_t* values, size_t n) {
+    uint8_t bytes[hybridART::BATCH_GROUP][8];
+    uint8_t* batch_keys[hybridART::BATCH_GROUP];
+    for (size_t b = 0; b < n; b += hybridART::BATCH_GROUP) {
+      unsigned m = std::min<size_t>(n - b, hybridART::BATCH_GROUP);
+      for (unsigned i = 0; i < m; i++) {
+	loadKey(keys[b + i], bytes[i]);
+	batch_keys[i] = bytes[i];
+      }
+      idx->insert_batch(batch_keys, values + b, m, key_length);
+    }
+    return true;
+  }
+
+  // Sorts the keys on num_threads threads and builds the static tree of
+  // an empty index from them. The values are the tids, as in insert().
+  bool bulk_load(const KeyType* keys, const uint64_t* values, size_t n, int num_threads) {
+    std::vector<std::pair<KeyType, uint64_t> > pairs;
+    parallel_sort_pairs<KeyType, KeyComparator>(keys, values, n, num_threads, pairs);
+    std::vector<uintptr_t> tids(pairs.size());
+    for (size_t i = 0; i < pairs.size(); i++)
+      tids[i] = pairs[i].second;
+    if (!idx->bulk_load(tids.data(), tids.size(), num_threads))
+      return insert_batch(keys, values, n);
+    return true;
+  }
+
   bool upsert(KeyType key, uint64_t value) {
     loadKey(key);
     //idx->insert(key_bytes, value, key_length);
@@ -126,9 +480,13 @@ class ArtIndex : public Index<KeyType, KeyComparator>
 
   uint64_t scan(KeyType key, int range) {
     loadKey(key);
-    uint64_t sum = idx->lower_bound(key_bytes, key_length, key_length);
-    for (int i = 0; i < range - 1; i++)
-      sum += idx->next();
+    hybridART_Iterator<hybridART> iter(idx);
+    iter.seek(key_bytes);
+    uint64_t sum = 0;
+    for (int i = 0; i < range && iter.valid(); i++) {
+      sum += iter.value();
+      iter.next();
+    }
     return sum;
   }
 
@@ -141,7 +499,45 @@ class ArtIndex : public Index<KeyType, KeyComparator>
     idx->merge();
   }
 
-  ArtIndex(uint64_t kt) {
+  void setMergeThreads(int num_threads) {
+    idx->setMergeThreads(num_threads);
+  }
+
+  void setMergeStepBudget(uint64_t budget_us) {
+    idx->setMergeStepBudget(budget_us);
+  }
+
+  void printStats() {
+    idx->memory_info();
+    idx->merge_info();
+    idx->filter_info();
+  }
+
+  // The snapshot is a static tree, which load() serves from the mapped
+  // file. save() leaves the benchmarked index as it is: it reads every
+  // item in key order, bulk-loads them into a scratch tree and writes
+  // that one, so no merge of the live index lands in the numbers.
+  bool save(const char* path) {
+    std::vector<uintptr_t> tids;
+    hybridART_Iterator<hybridART> iter(idx);
+    uint8_t first[8] = {0};
+    iter.seek(first);
+    for ( ; iter.valid(); iter.next())
+      tids.push_back(iter.value());
+    hybridART copy(key_length);
+    if (!copy.bulk_load(tids.data(), tids.size(), 1))
+      return false;
+    return copy.save_static(path);
+  }
+
+  bool load(const char* path) {
+    return idx->load_static(path);
+  }
+
+  // async_merge = merge the dynamic tree into the static one on a
+  // background thread instead of inline in insert()
+  // use_filter = Bloom filter in front of the dynamic tree
+  ArtIndex(uint64_t kt, bool async_merge = false, bool use_filter = false) {
     key_type = kt;
     if (kt == 0) {
       key_length = 8;
@@ -152,14 +548,18 @@ class ArtIndex : public Index<KeyType, KeyComparator>
       key_bytes = new uint8_t [8];
     }
 
-    idx = new hybridART(key_length);
+    idx = new hybridART(key_length, async_merge, use_filter);
   }
 
  private:
 
   inline void loadKey(KeyType key) {
+    loadKey(key, key_bytes);
+  }
+
+  inline void loadKey(KeyType key, uint8_t* bytes) {
     if (key_type == 0) {
-      reinterpret_cast<uint64_t*>(key_bytes)[0]=__builtin_bswap64(key);
+      reinterpret_cast<uint64_t*>(bytes)[0]=__builtin_bswap64(key);
     }
   }
 
@@ -183,7 +583,6 @@ class ArtIndex_Generic : public Index<KeyType, KeyComparator>
 
   ~ArtIndex_Generic() {
     delete idx;
-    delete key_bytes;
   }
 
   bool insert(KeyType key, uint64_t value) {
@@ -197,6 +596,37 @@ class ArtIndex_Generic : public Index<KeyType, KeyComparator>
     return idx->lookup(key_bytes, key_length, key_length);
   }
 
+  void find_batch(const KeyType* keys, size_t n, uint64_t* out) {
+    uint8_t* batch_keys[hybridART::BATCH_GROUP];
+    for (size_t b = 0; b < n; b += hybridART::BATCH_GROUP) {
+      unsigned m = std::min<size_t>(n - b, hybridART::BATCH_GROUP);
+      for (unsigned i = 0; i < m; i++)
+	batch_keys[i] = (uint8_t*)keys[b + i].data;
+      idx->lookup_batch(batch_keys, m, key_length, key_length, out + b);
+    }
+  }
+
+  // key is a copy in the coroutine frame, so its bytes outlive the
+  // suspensions
+  LookupTask find_coro(KeyType key) {
+    hybridART::LookupCursor cursor;
+    idx->lookup_begin(cursor, (uint8_t*)key.data);
+    while (!idx->lookup_step(cursor, (uint8_t*)key.data, key_length, key_length))
+      co_await std::suspend_always();
+    co_return cursor.value;
+  }
+
+  bool insert_batch(const KeyType* keys, const uint64_t* values, size_t n) {
+    uint8_t* batch_keys[hybridART::BATCH_GROUP];
+    for (size_t b = 0; b < n; b += hybridART::BATCH_GROUP) {
+      unsigned m = std::min<size_t>(n - b, hybridART::BATCH_GROUP);
+      for (unsigned i = 0; i < m; i++)
+	batch_keys[i] = (uint8_t*)keys[b + i].data;
+      idx->insert_batch(batch_keys, values + b, m, key_length);
+    }
+    return true;
+  }
+
   bool upsert(KeyType key, uint64_t value) {
     loadKey(key);
     //idx->insert(key_bytes, value, key_length);
@@ -206,9 +636,20 @@ class ArtIndex_Generic : public Index<KeyType, KeyComparator>
 
   uint64_t scan(KeyType key, int range) {
     loadKey(key);
-    uint64_t sum = idx->lower_bound(key_bytes, key_length, key_length);
-    for (int i = 0; i < range - 1; i++)
-      sum += idx->next();
+    hybridART_Iterator<hybridART> iter(idx);
+    if (idx->varKeys()) {
+      // the iterator compares whole key_length buffers
+      uint8_t padded[hybridART::MaxVarKeyLength];
+      strncpy((char*)padded, (const char*)key_bytes, hybridART::MaxVarKeyLength);
+      iter.seek(padded);
+    }
+    else
+      iter.seek(key_bytes);
+    uint64_t sum = 0;
+    for (int i = 0; i < range && iter.valid(); i++) {
+      sum += iter.value();
+      iter.next();
+    }
     return sum;
   }
 
@@ -221,23 +662,33 @@ class ArtIndex_Generic : public Index<KeyType, KeyComparator>
     idx->merge();
   }
 
-  ArtIndex_Generic(uint64_t kt) {
-    key_type = kt;
-    if (kt == 0) {
-      key_length = 31;
-      key_bytes = new uint8_t [31];
-    }
-    else {
-      key_length = 31;
-      key_bytes = new uint8_t [31];
-    }
+  void setMergeThreads(int num_threads) {
+    idx->setMergeThreads(num_threads);
+  }
+
+  void setMergeStepBudget(uint64_t budget_us) {
+    idx->setMergeStepBudget(budget_us);
+  }
+
+  void printStats() {
+    idx->memory_info();
+    idx->merge_info();
+    idx->filter_info();
+  }
 
-    idx = new hybridART(key_length);
+  // KeyType::length 0 (VarKey) builds the tree for variable-length keys
+  ArtIndex_Generic(uint64_t kt, bool async_merge = false, bool use_filter = false) {
+    key_type = kt;
+    idx = new hybridART(KeyType::length, async_merge, use_filter);
+    key_length = idx->getKeyLength();
+    key_bytes = NULL;
   }
 
  private:
 
-  inline void loadKey(KeyType key) {
+  // by reference: key_bytes must point into the caller's key, not into
+  // a copy that is gone on return
+  inline void loadKey(const KeyType &key) {
     if (key_type == 0) {
       key_bytes = (uint8_t*)key.data;
     }
@@ -250,8 +701,163 @@ class ArtIndex_Generic : public Index<KeyType, KeyComparator>
   }
 
   hybridART *idx;
-  uint64_t key_type; // 0 = GenericKey<31>
+  uint64_t key_type; // 0 = GenericKey<31> or VarKey
   unsigned key_length;
   uint8_t* key_bytes;
 };
 
+
+// hybridART_OLC shared by all worker threads. Keys are converted into
+// stack buffers so that concurrent calls do not share state.
+template<typename KeyType, class KeyComparator>
+class ArtOLCIndex : public Index<KeyType, KeyComparator>
+{
+ public:
+
+  ~ArtOLCIndex() {
+    delete idx;
+  }
+
+  bool insert(KeyType key, uint64_t value) {
+    uint8_t key_bytes[8];
+    loadKey(key, key_bytes);
+    idx->insert(key_bytes, value, key_length);
+    return true;
+  }
+
+  uint64_t find(KeyType key) {
+    uint8_t key_bytes[8];
+    loadKey(key, key_bytes);
+    return idx->lookup(key_bytes, key_length, key_length);
+  }
+
+  bool upsert(KeyType key, uint64_t value) {
+    uint8_t key_bytes[8];
+    loadKey(key, key_bytes);
+    idx->upsert(key_bytes, value, key_length, key_length);
+    return true;
+  }
+
+  uint64_t scan(KeyType key, int range) {
+    uint8_t key_bytes[8];
+    loadKey(key, key_bytes);
+    return scan(key_bytes, range);
+  }
+
+  int64_t getMemory() const {
+    return idx->getMemory();
+  }
+
+  void merge() {
+    idx->merge();
+  }
+
+  void setMergeThreads(int num_threads) {
+    idx->setMergeThreads(num_threads);
+  }
+
+  bool isThreadSafe() const {
+    return true;
+  }
+
+  ArtOLCIndex(uint64_t kt) {
+    key_type = kt;
+    key_length = 8;
+    idx = new hybridART_OLC(key_length);
+  }
+
+ private:
+
+  inline void loadKey(KeyType key, uint8_t* key_bytes) {
+    reinterpret_cast<uint64_t*>(key_bytes)[0]=__builtin_bswap64(key);
+  }
+
+  uint64_t scan(uint8_t* key_bytes, int range) {
+    EpochGuard guard;
+    hybridART_Iterator<hybridART_OLC> iter(idx);
+    iter.seek(key_bytes);
+    uint64_t sum = 0;
+    for (int i = 0; i < range && iter.valid(); i++) {
+      sum += iter.value();
+      iter.next();
+    }
+    return sum;
+  }
+
+  hybridART_OLC *idx;
+  uint64_t key_type; // 0 = uint64_t
+  unsigned key_length;
+};
+
+
+template<typename KeyType, class KeyComparator>
+class ArtOLCIndex_Generic : public Index<KeyType, KeyComparator>
+{
+ public:
+
+  ~ArtOLCIndex_Generic() {
+    delete idx;
+  }
+
+  bool insert(KeyType key, uint64_t value) {
+    idx->insert((uint8_t*)key.data, value, key_length);
+    return true;
+  }
+
+  uint64_t find(KeyType key) {
+    return idx->lookup((uint8_t*)key.data, key_length, key_length);
+  }
+
+  bool upsert(KeyType key, uint64_t value) {
+    idx->upsert((uint8_t*)key.data, value, key_length, key_length);
+    return true;
+  }
+
+  uint64_t scan(KeyType key, int range) {
+    return scan((uint8_t*)key.data, range);
+  }
+
+  int64_t getMemory() const {
+    return idx->getMemory();
+  }
+
+  void merge() {
+    idx->merge();
+  }
+
+  void setMergeThreads(int num_threads) {
+    idx->setMergeThreads(num_threads);
+  }
+
+  bool isThreadSafe() const {
+    return true;
+  }
+
+  ArtOLCIndex_Generic(uint64_t kt) {
+    if (KeyType::length == 0) {
+      std::cout << "VARIABLE-LENGTH KEYS NOT SUPPORTED BY ART-OLC!\n";
+      exit(1);
+    }
+    key_type = kt;
+    key_length = KeyType::length;
+    idx = new hybridART_OLC(key_length);
+  }
+
+ private:
+
+  uint64_t scan(uint8_t* key_bytes, int range) {
+    EpochGuard guard;
+    hybridART_Iterator<hybridART_OLC> iter(idx);
+    iter.seek(key_bytes);
+    uint64_t sum = 0;
+    for (int i = 0; i < range && iter.valid(); i++) {
+      sum += iter.value();
+      iter.next();
+    }
+    return sum;
+  }
+
+  hybridART_OLC *idx;
+  uint64_t key_type; // 0 = GenericKey<31>
+  unsigned key_length;
+};
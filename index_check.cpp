@@ -0,0 +1,395 @@
+#include <map>
+#include <random>
+
+#include "microbench.h"
+
+//==============================================================
+// Correctness check of the index types against std::map. Every case
+// loads a set of keys with duplicates, then inserts about a million
+// more (enough for hybridART to start merges of its own) while it
+// upserts and looks up keys that are already in; after that, and again
+// after an explicit merge() and a snapshot round trip, every key is
+// looked up with find(), find_batch() and interleave_finds() and a
+// sample of scans is summed. The values are tids, as in the drivers:
+// the key itself for integers, a pointer to the key bytes for strings.
+// Prints one line per case; exits 1 if any case failed. "index_check NAME"
+// runs only the cases with NAME in their name.
+//==============================================================
+
+static const size_t LOAD_KEYS = 200000;
+static const size_t MORE_KEYS = 1100000;
+static const unsigned DUPLICATES = 20;  // one in DUPLICATES keys repeats an earlier one
+static const unsigned NUM_SCANS = 2000;
+static const unsigned CORO_GROUP = 8;
+static const char *SNAPSHOT_FILE = "index_check.snapshot";
+
+static const char *only = ""; // runs the cases with this in their name
+
+struct CheckCase {
+  const char *name;
+  int type;           // as in the drivers' getInstance()
+  bool batch;         // insert with insert_batch()
+  bool bulk_load;     // load with bulk_load() on 4 threads
+  int threads;        // insert threads, thread-safe indexes only
+  int merge_threads;
+  uint64_t merge_step_us;
+  bool snapshot;
+};
+
+// BtreeIndex::scan() and HybridBtreeIndex::scan() sum range + 1 values
+inline int scan_extra(int type) {
+  return (type == 0 || type == 5 || type == 6) ? 1 : 0;
+}
+
+template<typename KeyType, class KeyComparator>
+Index<KeyType, KeyComparator> *getInstance(const int type) {
+  if (type == 0)
+    return new BtreeIndex<KeyType, KeyComparator>(0);
+  else if (type == 5)
+    return new HybridBtreeIndex<KeyType, KeyComparator>(0);
+  else if (type == 6)
+    return new BtreeIndex<KeyType, KeyComparator, PoolAllocator<std::pair<const KeyType, uint64_t> > >(0, false);
+  return NULL;
+}
+
+template<typename KeyType, class KeyComparator>
+struct Check {
+  typedef std::map<KeyType, uint64_t, KeyComparator> RefType;
+
+  Check(const CheckCase &c, Index<KeyType, KeyComparator> *idx) : c(c), idx(idx), failures(0) {}
+
+  void fail(const char *what, size_t i) {
+    if (failures < 5)
+      std::cout << "  " << what << " mismatch at " << i << "\n";
+    failures++;
+  }
+
+  // every key with find(), find_batch() and interleave_finds()
+  void verify_finds() {
+    std::vector<KeyType> keys;
+    std::vector<uint64_t> expected;
+    for (typename RefType::iterator it = ref.begin(); it != ref.end(); ++it) {
+      keys.push_back(it->first);
+      expected.push_back(it->second);
+    }
+    size_t n = keys.size();
+    for (size_t i = 0; i < n; i++)
+      if (idx->find(keys[i]) != expected[i])
+	fail("find", i);
+
+    std::vector<uint64_t> out(n);
+    idx->find_batch(keys.data(), n, out.data());
+    for (size_t i = 0; i < n; i++)
+      if (out[i] != expected[i])
+	fail("find_batch", i);
+
+    std::fill(out.begin(), out.end(), 0);
+    for (size_t i = 0; i < n; i += CORO_RUN)
+      interleave_finds(idx, keys.data() + i, std::min(CORO_RUN, n - i), CORO_GROUP, out.data() + i);
+    for (size_t i = 0; i < n; i++)
+      if (out[i] != expected[i])
+	fail("find_coro", i);
+  }
+
+  // scans from keys that are in, range 1 to 50
+  void verify_scans(std::mt19937_64 &rng) {
+    std::vector<typename RefType::iterator> starts;
+    size_t step = ref.size() / NUM_SCANS + 1;
+    size_t i = 0;
+    for (typename RefType::iterator it = ref.begin(); it != ref.end(); ++it, i++)
+      if (i % step == 0)
+	starts.push_back(it);
+    for (size_t s = 0; s < starts.size(); s++) {
+      int range = rng() % 50 + 1;
+      uint64_t sum = 0;
+      typename RefType::iterator it = starts[s];
+      for (int j = 0; j < range + scan_extra(c.type) && it != ref.end(); j++, ++it)
+	sum += it->second;
+      if (idx->scan(starts[s]->first, range) != sum)
+	fail("scan", s);
+    }
+  }
+
+  void verify(std::mt19937_64 &rng) {
+    verify_finds();
+    verify_scans(rng);
+  }
+
+  const CheckCase &c;
+  Index<KeyType, KeyComparator> *idx;
+  RefType ref;
+  unsigned failures;
+};
+
+// merge() of the ART indexes prints the trees
+template<typename KeyType, class KeyComparator>
+void quiet_merge(Index<KeyType, KeyComparator> *idx) {
+  std::streambuf *out = std::cout.rdbuf(NULL);
+  idx->merge();
+  std::cout.rdbuf(out);
+}
+
+// Loads the first LOAD_KEYS of keys[i] -> values[i] and inserts the
+// rest; update_values[i] is another tid of keys[i] for the upserts.
+template<typename KeyType, class KeyComparator>
+bool run_case(const CheckCase &c, const std::vector<KeyType> &keys,
+	      const std::vector<uint64_t> &values, const std::vector<uint64_t> &update_values) {
+  if (!strstr(c.name, only))
+    return true;
+  Index<KeyType, KeyComparator> *idx = getInstance<KeyType, KeyComparator>(c.type);
+  if (c.merge_threads)
+    idx->setMergeThreads(c.merge_threads);
+  if (c.merge_step_us)
+    idx->setMergeStepBudget(c.merge_step_us);
+  Check<KeyType, KeyComparator> check(c, idx);
+  std::mt19937_64 rng(7);
+  double start = get_now();
+
+  // load
+  size_t num_load = std::min(LOAD_KEYS, keys.size());
+  for (size_t i = 0; i < num_load; i++)
+    check.ref.insert(std::make_pair(keys[i], values[i]));
+  if (c.bulk_load) {
+    if (!idx->bulk_load(keys.data(), values.data(), num_load, 4))
+      check.fail("bulk_load", 0);
+  }
+  else if (c.batch)
+    idx->insert_batch(keys.data(), values.data(), num_load);
+  else
+    for (size_t i = 0; i < num_load; i++)
+      idx->insert(keys[i], values[i]);
+  check.verify(rng);
+
+  // Insert the keys that are not in yet, with upserts and finds of keys
+  // that are. hybridART looks only into its dynamic tree on insert, so
+  // a key that a merge has moved into the static tree would be shadowed
+  // by a second insert instead of kept.
+  std::vector<size_t> more;
+  for (size_t i = num_load; i < keys.size(); i++)
+    if (check.ref.insert(std::make_pair(keys[i], values[i])).second)
+      more.push_back(i);
+  std::vector<KeyType> more_keys;
+  std::vector<uint64_t> more_values;
+  for (size_t i = 0; i < more.size(); i++) {
+    more_keys.push_back(keys[more[i]]);
+    more_values.push_back(values[more[i]]);
+  }
+  if (c.threads > 1) {
+    std::vector<double> thread_time;
+    run_workers(c.threads, more.size(), [&](int t, size_t begin, size_t end) {
+	for (size_t i = begin; i < end; i++)
+	  idx->insert(more_keys[i], more_values[i]);
+      }, thread_time);
+  }
+  else {
+    size_t step = c.batch ? 64 : 1;
+    for (size_t i = 0; i < more.size(); i += step) {
+      size_t n = std::min(step, more.size() - i);
+      if (c.batch)
+	idx->insert_batch(more_keys.data() + i, more_values.data() + i, n);
+      else
+	idx->insert(more_keys[i], more_values[i]);
+
+      size_t p = rng() % (num_load + i + n);
+      size_t old = (p < num_load) ? p : more[p - num_load];
+      if (i % 4 == 0) {
+	idx->upsert(keys[old], update_values[old]);
+	check.ref[keys[old]] = update_values[old];
+      }
+      if (idx->find(keys[old]) != check.ref[keys[old]])
+	check.fail("find while inserting", i);
+    }
+  }
+  check.verify(rng);
+
+  quiet_merge(idx);
+  check.verify(rng);
+
+  if (c.snapshot) {
+    if (!idx->save(SNAPSHOT_FILE))
+      check.fail("save", 0);
+    delete idx;
+    idx = check.idx = getInstance<KeyType, KeyComparator>(c.type);
+    if (!idx->load(SNAPSHOT_FILE))
+      check.fail("load", 0);
+    unlink(SNAPSHOT_FILE);
+    check.verify(rng);
+  }
+
+  std::cout << c.name << (check.failures ? " FAIL" : " ok") << " (" << check.ref.size() << " keys, "
+	    << (get_now() - start) << " s)\n";
+  delete idx;
+  return check.failures == 0;
+}
+
+//==============================================================
+// INTEGER KEYS
+//==============================================================
+template<>
+Index<uint64_t, std::less<uint64_t> > *getInstance(const int type) {
+  if (type == 1)
+    return new ArtIndex<uint64_t, std::less<uint64_t> >(0);
+  else if (type == 2)
+    return new ArtIndex<uint64_t, std::less<uint64_t> >(0, true);
+  else if (type == 3)
+    return new ArtOLCIndex<uint64_t, std::less<uint64_t> >(0);
+  else if (type == 4)
+    return new ArtIndex<uint64_t, std::less<uint64_t> >(0, false, true);
+  else if (type == 5)
+    return new HybridBtreeIndex<uint64_t, std::less<uint64_t> >(0);
+  else if (type == 6)
+    return new BtreeIndex<uint64_t, std::less<uint64_t>, PoolAllocator<std::pair<const uint64_t, uint64_t> > >(0, false);
+  return new BtreeIndex<uint64_t, std::less<uint64_t> >(0);
+}
+
+static const CheckCase int_cases[] = {
+  // name                    type batch bulk threads merge_threads step_us snapshot
+  { "int btree",              0, false, false, 1, 0, 0, false },
+  { "int btree batch",        0, true,  false, 1, 0, 0, false },
+  { "int btree bulk_load",    0, false, true,  1, 0, 0, false },
+  { "int btree snapshot",     0, false, false, 1, 0, 0, true  },
+  { "int btree-pool",         6, false, false, 1, 0, 0, false },
+  { "int btree-hybrid",       5, false, false, 1, 0, 0, false },
+  { "int btree-hybrid bulk_load", 5, false, true, 1, 0, 0, false },
+  { "int art",                1, false, false, 1, 0, 0, false },
+  { "int art batch",          1, true,  false, 1, 0, 0, false },
+  { "int art bulk_load",      1, false, true,  1, 0, 0, false },
+  { "int art snapshot",       1, false, false, 1, 0, 0, true  },
+  { "int art merge_threads",  1, false, false, 1, 4, 0, false },
+  { "int art merge_step",     1, false, false, 1, 0, 100, false },
+  { "int art merge_step threads", 1, false, false, 1, 4, 100, false },
+  { "int art-async",          2, false, false, 1, 0, 0, false },
+  { "int art-async snapshot", 2, false, false, 1, 0, 0, true  },
+  { "int art-bloom",          4, false, false, 1, 0, 0, false },
+  { "int art-olc",            3, false, false, 1, 0, 0, false },
+  { "int art-olc threads",    3, false, false, 4, 0, 0, false },
+  { "int art-olc merge_threads", 3, false, false, 1, 4, 0, false },
+};
+
+bool check_int() {
+  std::mt19937_64 rng(1);
+  size_t n = LOAD_KEYS + MORE_KEYS;
+  std::vector<uint64_t> keys(n), update_values(n);
+  for (size_t i = 0; i < n; i++)
+    keys[i] = (i > 0 && rng() % DUPLICATES == 0) ? keys[rng() % i] : (rng() >> 1) + 1;
+  // the value of an 8-byte ART key is the key itself
+  update_values = keys;
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(int_cases) / sizeof(int_cases[0]); i++)
+    ok = run_case<uint64_t, std::less<uint64_t> >(int_cases[i], keys, keys, update_values) && ok;
+  return ok;
+}
+
+//==============================================================
+// STRING KEYS
+//==============================================================
+template<>
+Index<GenericKey<31>, GenericComparator<31> > *getInstance(const int type) {
+  typedef GenericKey<31> K;
+  typedef GenericComparator<31> C;
+  if (type == 1)
+    return new ArtIndex_Generic<K, C>(0);
+  else if (type == 2)
+    return new ArtIndex_Generic<K, C>(0, true);
+  else if (type == 3)
+    return new ArtOLCIndex_Generic<K, C>(0);
+  else if (type == 4)
+    return new ArtIndex_Generic<K, C>(0, false, true);
+  else if (type == 5)
+    return new HybridBtreeIndex<K, C>(0);
+  else if (type == 6)
+    return new BtreeIndex<K, C, PoolAllocator<std::pair<const K, uint64_t> > >(0, false);
+  return new BtreeIndex<K, C>(0);
+}
+
+template<>
+Index<VarKey, VarKeyComparator> *getInstance(const int type) {
+  if (type == 1)
+    return new ArtIndex_Generic<VarKey, VarKeyComparator>(0);
+  else if (type == 5)
+    return new HybridBtreeIndex<VarKey, VarKeyComparator>(0);
+  return new BtreeIndex<VarKey, VarKeyComparator>(0);
+}
+
+static const CheckCase generic_cases[] = {
+  { "GenericKey<31> btree",          0, false, false, 1, 0, 0, false },
+  { "GenericKey<31> btree bulk_load", 0, false, true, 1, 0, 0, false },
+  { "GenericKey<31> btree snapshot", 0, false, false, 1, 0, 0, true  },
+  { "GenericKey<31> btree-pool",     6, false, false, 1, 0, 0, false },
+  { "GenericKey<31> btree-hybrid",   5, false, false, 1, 0, 0, false },
+  { "GenericKey<31> art",            1, false, false, 1, 0, 0, false },
+  { "GenericKey<31> art batch",      1, true,  false, 1, 0, 0, false },
+  { "GenericKey<31> art merge_threads", 1, false, false, 1, 4, 0, false },
+  { "GenericKey<31> art merge_step", 1, false, false, 1, 0, 100, false },
+  { "GenericKey<31> art-async",      2, false, false, 1, 0, 0, false },
+  { "GenericKey<31> art-bloom",      4, false, false, 1, 0, 0, false },
+  { "GenericKey<31> art-olc",        3, false, false, 1, 0, 0, false },
+};
+
+static const CheckCase var_cases[] = {
+  { "VarKey btree",                  0, false, false, 1, 0, 0, false },
+  { "VarKey btree-hybrid",           5, false, false, 1, 0, 0, false },
+  { "VarKey art",                    1, false, false, 1, 0, 0, false },
+  { "VarKey art merge_step",         1, false, false, 1, 0, 100, false },
+};
+
+static const CheckCase norm_cases[] = {
+  { "NormalizedKey<32> btree",       0, false, false, 1, 0, 0, false },
+  { "NormalizedKey<32> btree snapshot", 0, false, false, 1, 0, 0, true },
+};
+
+static const CheckCase head_cases[] = {
+  { "HeadKey<16> btree",             0, false, false, 1, 0, 0, false },
+};
+
+// Email-like strings of 4 to 30 bytes, many sharing long prefixes.
+inline std::vector<std::string> make_strings(size_t n) {
+  std::mt19937_64 rng(2);
+  static const char *domains[] = { "@a.com", "@example.org", "@mail.example.io", "" };
+  std::vector<std::string> s(n);
+  for (size_t i = 0; i < n; i++) {
+    if (i > 0 && rng() % DUPLICATES == 0) {
+      s[i] = s[rng() % i];
+      continue;
+    }
+    std::string name = "u" + std::to_string(rng() % 100000000);
+    if (rng() % 2)
+      name = "user." + name;
+    s[i] = name + domains[rng() % 4];
+  }
+  return s;
+}
+
+// Runs the cases on the strings as KeyTypes. A second copy of the keys
+// gives every key another tid for the upserts.
+template<typename KeyType, class KeyComparator>
+bool check_strings(const CheckCase *cases, size_t num_cases, const std::vector<std::string> &strings) {
+  size_t n = strings.size();
+  std::vector<KeyType> keys(n), copies(n);
+  std::vector<uint64_t> values(n), update_values(n);
+  for (size_t i = 0; i < n; i++) {
+    keys[i].setFromString(strings[i]);
+    copies[i].setFromString(strings[i]);
+    values[i] = (uint64_t)(const char*)keys[i].data;
+    update_values[i] = (uint64_t)(const char*)copies[i].data;
+  }
+  bool ok = true;
+  for (size_t i = 0; i < num_cases; i++)
+    ok = run_case<KeyType, KeyComparator>(cases[i], keys, values, update_values) && ok;
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1)
+    only = argv[1];
+  bool ok = check_int();
+
+  std::vector<std::string> strings = make_strings(LOAD_KEYS + MORE_KEYS);
+  ok = check_strings<GenericKey<31>, GenericComparator<31> >(generic_cases, sizeof(generic_cases) / sizeof(generic_cases[0]), strings) && ok;
+  ok = check_strings<VarKey, VarKeyComparator>(var_cases, sizeof(var_cases) / sizeof(var_cases[0]), strings) && ok;
+  ok = check_strings<NormalizedKey<32>, NormalizedComparator<32> >(norm_cases, sizeof(norm_cases) / sizeof(norm_cases[0]), strings) && ok;
+  ok = check_strings<HeadKey<16>, HeadKeyComparator<16> >(head_cases, sizeof(head_cases) / sizeof(head_cases[0]), strings) && ok;
+
+  std::cout << (ok ? "all checks passed\n" : "CHECK FAIL!\n");
+  return ok ? 0 : 1;
+}
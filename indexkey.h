@@ -1,8 +1,16 @@
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <emmintrin.h>
+#include <immintrin.h>
+#include <string>
+#include <iostream>
 
 template <std::size_t keySize>
 class GenericKey {
 public:
+  static const std::size_t length = keySize;
+
   inline void setFromString(std::string key) {
     memset(data, 0, keySize);
     strcpy(data, key.c_str());
@@ -22,3 +30,192 @@ public:
   }
 };
 
+// Normalized string key: the string zero-padded to keySize - 1 bytes,
+// its length in the last byte. Zero padding makes the byte order of the
+// whole key the strcmp order of the strings (the length byte only breaks
+// ties that cannot happen), so a comparison needs no terminator check
+// and can go a word or a vector at a time. data still reads as a C
+// string. Strings longer than keySize - 2 are truncated.
+template <std::size_t keySize>
+class NormalizedKey {
+  static_assert(keySize % 32 == 0 && keySize <= 256, "NormalizedKey size must be a multiple of 32, at most 256");
+
+public:
+  static const std::size_t length = keySize;
+  static const std::size_t WORDS = keySize / 8;
+
+  inline void setFromString(const std::string &key) {
+    setFromString(key.data(), key.size());
+  }
+
+  inline void setFromString(const char *key, std::size_t n) {
+    if (n > keySize - 2)
+      n = keySize - 2;
+    memcpy(data, key, n);
+    memset(data + n, 0, keySize - n);
+    data[keySize - 1] = (char)n;
+  }
+
+  // The i-th 8 bytes as a big-endian integer, which orders like the bytes.
+  inline uint64_t word(std::size_t i) const {
+    uint64_t w;
+    memcpy(&w, data + i * 8, 8);
+    return __builtin_bswap64(w);
+  }
+
+  alignas(8) char data[keySize];
+};
+
+// Compares NormalizedKeys 8 bytes at a time.
+template <std::size_t keySize>
+class NormalizedComparator {
+public:
+  NormalizedComparator() {}
+
+  inline bool operator()(const NormalizedKey<keySize> &lhs, const NormalizedKey<keySize> &rhs) const {
+    for (std::size_t i = 0; i < NormalizedKey<keySize>::WORDS; i++) {
+      uint64_t l = lhs.word(i);
+      uint64_t r = rhs.word(i);
+      if (l != r)
+	return l < r;
+    }
+    return false;
+  }
+};
+
+// Compares NormalizedKeys 32 bytes at a time: one AVX2 compare when the
+// build targets AVX2, two SSE2 compares otherwise. The first differing
+// byte decides.
+template <std::size_t keySize>
+class NormalizedSIMDComparator {
+public:
+  NormalizedSIMDComparator() {}
+
+  inline bool operator()(const NormalizedKey<keySize> &lhs, const NormalizedKey<keySize> &rhs) const {
+    for (std::size_t i = 0; i < keySize; i += 32) {
+      const char *l = lhs.data + i;
+      const char *r = rhs.data + i;
+#ifdef __AVX2__
+      __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)l), _mm256_loadu_si256((const __m256i*)r));
+      uint32_t diff = ~(uint32_t)_mm256_movemask_epi8(eq);
+#else
+      __m128i eq_lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)l), _mm_loadu_si128((const __m128i*)r));
+      __m128i eq_hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(l + 16)), _mm_loadu_si128((const __m128i*)(r + 16)));
+      uint32_t diff = ~((uint32_t)_mm_movemask_epi8(eq_lo) | ((uint32_t)_mm_movemask_epi8(eq_hi) << 16));
+#endif
+      if (diff) {
+	unsigned pos = __builtin_ctz(diff);
+	return (uint8_t)l[pos] < (uint8_t)r[pos];
+      }
+    }
+    return false;
+  }
+};
+
+
+// Variable-length string key: a pointer to its zero-terminated bytes,
+// so an index stores 8 bytes per key however long the string is. The
+// bytes are copied into a process-wide arena and never freed; strings
+// longer than MAX_LENGTH - 1 are truncated.
+class VarKey {
+public:
+  static const std::size_t length = 0; // variable
+  static const std::size_t MAX_LENGTH = 255; // terminating zero included
+
+  inline void setFromString(std::string key) {
+    data = store(key.data(), key.size());
+  }
+
+  // Copies the n bytes at s into the arena as a zero-terminated string.
+  static const char *store(const char *s, std::size_t n) {
+    if (n > MAX_LENGTH - 1)
+      n = MAX_LENGTH - 1;
+    char *p = alloc(n + 1);
+    memcpy(p, s, n);
+    p[n] = 0;
+    return p;
+  }
+
+  const char *data;
+
+private:
+  // ART may read up to MAX_LENGTH bytes of a search key before it finds
+  // a mismatch, so every chunk is followed by MAX_LENGTH zero bytes.
+  static char *alloc(std::size_t n) {
+    static const std::size_t CHUNK_SIZE = 1 << 20;
+    static char *cur = NULL;
+    static char *end = NULL;
+    if (cur == NULL || cur + n > end) {
+      cur = (char*)calloc(CHUNK_SIZE + MAX_LENGTH, 1);
+      if (cur == NULL) {
+	std::cout << "KEY ARENA ALLOCATION FAIL!\n";
+	exit(1);
+      }
+      end = cur + CHUNK_SIZE;
+    }
+    char *p = cur;
+    cur += n;
+    return p;
+  }
+};
+
+class VarKeyComparator {
+public:
+  VarKeyComparator() {}
+
+  inline bool operator()(const VarKey &lhs, const VarKey &rhs) const {
+    int diff = strcmp(lhs.data, rhs.data);
+    return diff < 0;
+  }
+};
+
+// Head-truncated string key: the first headSize bytes of the string,
+// zero-padded and stored as big-endian words, plus a pointer to the
+// whole string in the VarKey arena. A B+tree slot holds headSize + 8
+// bytes however long the string is, and most comparisons are decided by
+// the heads without touching the string; only keys whose heads are
+// equal (and not yet terminated) compare the rest of the strings.
+template <std::size_t headSize>
+class HeadKey {
+  static_assert(headSize % 8 == 0 && headSize > 0, "HeadKey head size must be a multiple of 8");
+
+public:
+  static const std::size_t length = 0; // variable, data is the whole string
+  static const std::size_t WORDS = headSize / 8;
+
+  inline void setFromString(const std::string &key) {
+    data = VarKey::store(key.data(), key.size());
+    char buf[headSize];
+    std::size_t n = key.size() < headSize ? key.size() : headSize;
+    memcpy(buf, data, n);
+    memset(buf + n, 0, headSize - n);
+    for (std::size_t i = 0; i < WORDS; i++) {
+      memcpy(&head[i], buf + i * 8, 8);
+      head[i] = __builtin_bswap64(head[i]);
+    }
+  }
+
+  // Whether the string ends within the head, which then is the whole key.
+  inline bool shortKey() const {
+    return (head[WORDS - 1] & 0xff) == 0;
+  }
+
+  uint64_t head[WORDS];
+  const char *data;
+};
+
+template <std::size_t headSize>
+class HeadKeyComparator {
+public:
+  HeadKeyComparator() {}
+
+  inline bool operator()(const HeadKey<headSize> &lhs, const HeadKey<headSize> &rhs) const {
+    for (std::size_t i = 0; i < HeadKey<headSize>::WORDS; i++)
+      if (lhs.head[i] != rhs.head[i])
+	return lhs.head[i] < rhs.head[i];
+    // equal heads that end in a zero are equal strings
+    if (lhs.shortKey())
+      return false;
+    return strcmp(lhs.data + headSize, rhs.data + headSize) < 0;
+  }
+};
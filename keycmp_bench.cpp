@@ -0,0 +1,102 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include "latency.h"
+#include "indexkey.h"
+#include "stx/btree_map.h"
+
+//==============================================================
+// Compares the strcmp comparator of GenericKey<31> with the word and
+// SIMD comparators of NormalizedKey<32> on email-like keys (reversed
+// host name, then the user name, as the email workloads store them):
+// a binary search over a sorted array, and stx::btree_map::find, which
+// is what BtreeIndex runs for a READ.
+//==============================================================
+
+static const unsigned NUM_SIZES = 2;
+static const unsigned key_counts[NUM_SIZES] = {1 << 16, 1 << 20}; // in cache, in memory
+static const unsigned NUM_QUERIES = 1 << 22;
+
+static std::vector<std::string> makeEmails(unsigned n, std::mt19937 &rng) {
+  static const char *hosts[] = {"com.gmail", "com.yahoo", "com.hotmail", "com.outlook", "org.example.mail",
+				"net.comcast", "edu.university.cs", "de.web"};
+  static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789._";
+  std::set<std::string> seen;
+  std::vector<std::string> emails;
+  while (emails.size() < n) {
+    std::string s = hosts[rng() % (sizeof(hosts) / sizeof(hosts[0]))];
+    s += '@';
+    unsigned len = 4 + rng() % 12;
+    for (unsigned i = 0; i < len; i++)
+      s += chars[rng() % (sizeof(chars) - 1)];
+    if (s.size() > 30)
+      s.resize(30);
+    if (seen.insert(s).second)
+      emails.push_back(s);
+  }
+  return emails;
+}
+
+template<typename K, typename C>
+static double measureArray(const std::vector<K> &sorted, const std::vector<K> &queries, uint64_t &sum) {
+  C less;
+  uint64_t start = monotonic_ns();
+  for (unsigned q = 0; q < NUM_QUERIES; q++)
+    sum += std::lower_bound(sorted.begin(), sorted.end(), queries[q], less) - sorted.begin();
+  return (double)(monotonic_ns() - start) / NUM_QUERIES;
+}
+
+template<typename K, typename C>
+static double measureBtree(const std::vector<K> &keys, const std::vector<K> &queries, uint64_t &sum) {
+  stx::btree_map<K, uint64_t, C> tree;
+  for (unsigned i = 0; i < keys.size(); i++)
+    tree.insert(keys[i], i);
+  uint64_t start = monotonic_ns();
+  for (unsigned q = 0; q < NUM_QUERIES; q++)
+    sum += tree.find(queries[q])->second;
+  return (double)(monotonic_ns() - start) / NUM_QUERIES;
+}
+
+template<typename K, typename C>
+static void run(const char *name, const std::vector<std::string> &emails, const std::vector<unsigned> &picks) {
+  std::vector<K> keys(emails.size());
+  for (size_t i = 0; i < emails.size(); i++)
+    keys[i].setFromString(emails[i]);
+  std::vector<K> queries(NUM_QUERIES);
+  for (unsigned q = 0; q < NUM_QUERIES; q++)
+    queries[q] = keys[picks[q]];
+  std::vector<K> sorted(keys);
+  std::sort(sorted.begin(), sorted.end(), C());
+
+  uint64_t sum = 0;
+  double array = measureArray<K, C>(sorted, queries, sum);
+  double btree = measureBtree<K, C>(keys, queries, sum);
+  std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+	    << std::setw(10) << array << std::setw(10) << btree << "   (" << (sum & 1) << ")\n";
+}
+
+int main(int argc, char *argv[]) {
+  std::mt19937 rng(1);
+  for (unsigned s = 0; s < NUM_SIZES; s++) {
+    std::vector<std::string> emails = makeEmails(key_counts[s], rng);
+    std::vector<unsigned> picks(NUM_QUERIES);
+    for (unsigned q = 0; q < NUM_QUERIES; q++)
+      picks[q] = rng() % key_counts[s];
+
+    std::cout << key_counts[s] << " keys, ns per search"
+#ifdef __AVX2__
+	      << " (SIMD = AVX2)\n";
+#else
+	      << " (SIMD = SSE2)\n";
+#endif
+    std::cout << "comparator                array     btree\n";
+    run<GenericKey<31>, GenericComparator<31> >("strcmp", emails, picks);
+    run<NormalizedKey<32>, NormalizedComparator<32> >("normalized words", emails, picks);
+    run<NormalizedKey<32>, NormalizedSIMDComparator<32> >("normalized SIMD", emails, picks);
+  }
+  return 0;
+}
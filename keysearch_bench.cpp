@@ -0,0 +1,132 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include "latency.h"
+#include "ART/hybridART.h"
+
+//==============================================================
+// Compares the scalar, SSE2 and AVX2 key searches of the static
+// hybridART nodes (ART/keySearch.h) for every node type and fill level.
+// Keys are laid out exactly as in NodeD / NodeDP / NodeU; each search
+// looks up a random byte, so about count/256 of the exact-match
+// searches hit.
+//==============================================================
+
+static const unsigned NUM_NODES = 1024;
+static const unsigned NUM_QUERIES = 1 << 22;
+
+typedef hybridART::NodeStatic NodeStatic;
+
+struct Nodes {
+  const char *type;
+  bool flipped;
+  std::vector<uint8_t*> keys; // key array of each node
+  std::vector<void*> memory;
+
+  ~Nodes() {
+    for (size_t i = 0; i < memory.size(); i++)
+      free(memory[i]);
+  }
+};
+
+// NUM_NODES nodes of one type, each with count distinct sorted keys
+static void makeNodes(Nodes &nodes, int8_t type, unsigned count, std::mt19937 &rng) {
+  std::vector<unsigned> bytes(256);
+  for (unsigned i = 0; i < 256; i++)
+    bytes[i] = i;
+  for (unsigned n = 0; n < NUM_NODES; n++) {
+    std::shuffle(bytes.begin(), bytes.end(), rng);
+    std::vector<uint8_t> k(bytes.begin(), bytes.begin() + count);
+    uint8_t *key;
+    void *ptr;
+    if (type == hybridART::NodeTypeD) {
+      ptr = malloc(sizeof(hybridART::NodeD) + count * (sizeof(uint8_t) + sizeof(NodeStatic*)));
+      key = (new(ptr) hybridART::NodeD(count))->key();
+    }
+    else if (type == hybridART::NodeTypeDP) {
+      unsigned prefixLength = rng() % 8;
+      ptr = malloc(sizeof(hybridART::NodeDP) + prefixLength + count * (sizeof(uint8_t) + sizeof(NodeStatic*)));
+      key = (new(ptr) hybridART::NodeDP(count, prefixLength))->key();
+    }
+    else {
+      ptr = malloc(sizeof(hybridART::NodeU) + count * (sizeof(uint8_t) + sizeof(NodeStatic*)));
+      key = (new(ptr) hybridART::NodeU(count))->key();
+    }
+    // NodeD/DP keep sign-flipped keys sorted as signed bytes, NodeU plain keys
+    if (nodes.flipped) {
+      for (unsigned i = 0; i < count; i++)
+	k[i] ^= 128;
+      std::sort(k.begin(), k.end(), [](uint8_t a, uint8_t b) { return (int8_t)a < (int8_t)b; });
+    }
+    else
+      std::sort(k.begin(), k.end());
+    memcpy(key, k.data(), count);
+    nodes.keys.push_back(key);
+    nodes.memory.push_back(ptr);
+  }
+}
+
+template<typename F>
+static double measure(const Nodes &nodes, unsigned count, const std::vector<uint8_t> &queries, F search, uint64_t &sum) {
+  uint64_t start = monotonic_ns();
+  for (unsigned q = 0; q < NUM_QUERIES; q++)
+    sum += search(nodes.keys[q % NUM_NODES], count, queries[q]);
+  return (double)(monotonic_ns() - start) / NUM_QUERIES;
+}
+
+static void run(Nodes &nodes, unsigned count, const std::vector<uint8_t> &queries, bool avx2) {
+  uint64_t sum = 0;
+  double find[3], lower[3];
+  find[0] = measure(nodes, count, queries, KeySearch::findScalar, sum);
+  find[1] = measure(nodes, count, queries, KeySearch::findSSE2, sum);
+  find[2] = avx2 ? measure(nodes, count, queries, KeySearch::findAVX2, sum) : 0;
+  if (nodes.flipped) {
+    lower[0] = measure(nodes, count, queries, KeySearch::lowerBoundScalar<true>, sum);
+    lower[1] = measure(nodes, count, queries, KeySearch::lowerBoundSSE2<true>, sum);
+    lower[2] = avx2 ? measure(nodes, count, queries, KeySearch::lowerBoundAVX2<true>, sum) : 0;
+  }
+  else {
+    lower[0] = measure(nodes, count, queries, KeySearch::lowerBoundScalar<false>, sum);
+    lower[1] = measure(nodes, count, queries, KeySearch::lowerBoundSSE2<false>, sum);
+    lower[2] = avx2 ? measure(nodes, count, queries, KeySearch::lowerBoundAVX2<false>, sum) : 0;
+  }
+
+  std::cout << std::left << std::setw(7) << nodes.type << std::right << std::setw(5) << count
+	    << std::fixed << std::setprecision(2);
+  for (int i = 0; i < 3; i++)
+    std::cout << std::setw(9) << find[i];
+  for (int i = 0; i < 3; i++)
+    std::cout << std::setw(9) << lower[i];
+  std::cout << "   (" << (sum & 1) << ")\n";
+}
+
+int main(int argc, char *argv[]) {
+  static const unsigned fills[] = {5, 8, 16, 32, 64, 128, 227, 256};
+  bool avx2 = (KeySearch::detected() == KeySearch::AVX2);
+
+  std::mt19937 rng(1);
+  std::vector<uint8_t> queries(NUM_QUERIES);
+  for (unsigned q = 0; q < NUM_QUERIES; q++)
+    queries[q] = rng();
+
+  std::cout << "ns per search" << (avx2 ? "" : " (no AVX2 on this CPU)") << "\n";
+  std::cout << "type   count  find:scalar    sse2     avx2  lower:scalar  sse2     avx2\n";
+  for (int t = 0; t < 3; t++) {
+    static const int8_t types[] = {hybridART::NodeTypeD, hybridART::NodeTypeDP, hybridART::NodeTypeU};
+    static const char *names[] = {"NodeD", "NodeDP", "NodeU"};
+    for (unsigned f = 0; f < sizeof(fills) / sizeof(fills[0]); f++) {
+      // NodeD/DP count is a uint8_t and never exceeds NodeDItemTHold
+      if (types[t] != hybridART::NodeTypeU && fills[f] > hybridART::NodeDItemTHold)
+	continue;
+      Nodes nodes;
+      nodes.type = names[t];
+      nodes.flipped = (types[t] != hybridART::NodeTypeU);
+      makeNodes(nodes, types[t], fills[f], rng);
+      run(nodes, fills[f], queries, avx2);
+    }
+  }
+  return 0;
+}
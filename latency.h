@@ -0,0 +1,198 @@
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include <iomanip>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//==============================================================
+// TIMER
+//==============================================================
+// rdtsc where available (a few ns per read, no syscall), otherwise
+// CLOCK_MONOTONIC in nanoseconds.
+inline uint64_t read_cycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+inline uint64_t monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Number of read_cycles() ticks per nanosecond, calibrated once.
+inline double cycles_per_ns() {
+  static double ratio = 0;
+  if (ratio == 0) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t ns_start = monotonic_ns();
+    uint64_t cycles_start = read_cycles();
+    usleep(20000);
+    uint64_t ns_end = monotonic_ns();
+    uint64_t cycles_end = read_cycles();
+    ratio = (double)(cycles_end - cycles_start) / (ns_end - ns_start);
+#else
+    ratio = 1;
+#endif
+  }
+  return ratio;
+}
+
+//==============================================================
+// LATENCY HISTOGRAM
+//==============================================================
+// HDR-style log-linear histogram over tick counts. Values below
+// 2 * SUB_BUCKETS are recorded exactly; above that every power of two
+// is split into SUB_BUCKETS linear buckets, so the relative error of
+// any reported percentile is below 1 / SUB_BUCKETS (~3%).
+class LatencyHistogram {
+ public:
+  static const unsigned SUB_BUCKET_BITS = 5;
+  static const unsigned SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const unsigned NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram() {
+    clear();
+  }
+
+  void clear() {
+    memset(counts, 0, sizeof(counts));
+    total = 0;
+    max_value = 0;
+  }
+
+  inline void record(uint64_t value) {
+    counts[bucketOf(value)]++;
+    total++;
+    if (value > max_value)
+      max_value = value;
+  }
+
+  void merge(const LatencyHistogram &other) {
+    for (unsigned i = 0; i < NUM_BUCKETS; i++)
+      counts[i] += other.counts[i];
+    total += other.total;
+    if (other.max_value > max_value)
+      max_value = other.max_value;
+  }
+
+  uint64_t count() const {
+    return total;
+  }
+
+  uint64_t max() const {
+    return max_value;
+  }
+
+  // Smallest recorded value v such that at least p percent of the
+  // samples are <= v (reported as the upper edge of its bucket).
+  uint64_t percentile(double p) const {
+    if (total == 0)
+      return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * total + 0.5);
+    if (rank == 0)
+      rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; i++) {
+      seen += counts[i];
+      if (seen >= rank) {
+	uint64_t upper = bucketUpper(i);
+	return (upper < max_value) ? upper : max_value;
+      }
+    }
+    return max_value;
+  }
+
+ private:
+  static inline unsigned bucketOf(uint64_t value) {
+    if (value < 2 * SUB_BUCKETS)
+      return (unsigned)value;
+    unsigned shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + (unsigned)((value >> shift) - SUB_BUCKETS);
+  }
+
+  static inline uint64_t bucketUpper(unsigned index) {
+    if (index < 2 * SUB_BUCKETS)
+      return index;
+    unsigned shift = index / SUB_BUCKETS - 1;
+    uint64_t top = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+  }
+
+  uint64_t counts[NUM_BUCKETS];
+  uint64_t total;
+  uint64_t max_value;
+};
+
+//==============================================================
+// PER-OPERATION LATENCY
+//==============================================================
+// One histogram per operation type (INSERT = 0, READ = 1, UPDATE = 2,
+// SCAN = 3, the same encoding as the ops vector). Only every
+// sample_rate-th operation is timed so that the timer cost does not
+// dominate short operations; sample_rate == 0 disables timing.
+class LatencyStats {
+ public:
+  enum { INSERT = 0, READ = 1, UPDATE = 2, SCAN = 3, NUM_OPS = 4 };
+
+  LatencyStats(uint32_t rate = 0) : sample_rate(rate), countdown(rate) {}
+
+  // True if the next operation should be timed.
+  inline bool sample() {
+    if (sample_rate == 0)
+      return false;
+    if (--countdown != 0)
+      return false;
+    countdown = sample_rate;
+    return true;
+  }
+
+  inline void record(int op, uint64_t cycles) {
+    hist[op].record(cycles);
+  }
+
+  void merge(const LatencyStats &other) {
+    for (int i = 0; i < NUM_OPS; i++)
+      hist[i].merge(other.hist[i]);
+  }
+
+  void clear() {
+    for (int i = 0; i < NUM_OPS; i++)
+      hist[i].clear();
+    countdown = sample_rate;
+  }
+
+  bool enabled() const {
+    return sample_rate != 0;
+  }
+
+  void print(const char *phase) const {
+    static const char *op_names[NUM_OPS] = {"INSERT", "READ", "UPDATE", "SCAN"};
+    double ratio = cycles_per_ns();
+    std::cout << phase << " latency (ns, 1/" << sample_rate << " ops sampled):\n";
+    for (int i = 0; i < NUM_OPS; i++) {
+      if (hist[i].count() == 0)
+	continue;
+      std::cout << "  " << std::left << std::setw(7) << op_names[i] << std::right
+		<< " samples " << hist[i].count()
+		<< " p50 " << (uint64_t)(hist[i].percentile(50) / ratio)
+		<< " p99 " << (uint64_t)(hist[i].percentile(99) / ratio)
+		<< " p99.9 " << (uint64_t)(hist[i].percentile(99.9) / ratio)
+		<< " max " << (uint64_t)(hist[i].max() / ratio) << "\n";
+    }
+  }
+
+ private:
+  LatencyHistogram hist[NUM_OPS];
+  uint32_t sample_rate;
+  uint32_t countdown;
+};
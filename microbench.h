@@ -5,11 +5,23 @@
 #include <iostream>
 #include <string.h>
 #include <utility>
+#include <algorithm>
 #include <time.h>
 #include <sys/time.h>
-#include <papi.h>
+#include <unistd.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <string>
 
 #include "allocatortracker.h"
+#include "poolallocator.h"
+#include "latency.h"
+#include "perfcounters.h"
+#include "trace.h"
 
 //#include "btreeIndex.h"
 //#include "artIndex.h"
@@ -30,9 +42,6 @@
 
 #define VALUES_PER_KEY 10
 
-//#define PAPI_IPC 1
-#define PAPI_CACHE 1
-
 
 //==============================================================
 inline double get_now() {
@@ -41,3 +50,513 @@ inline double get_now() {
   return tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
+//==============================================================
+// WORKLOAD
+//==============================================================
+// Flat view of a loaded workload. The arrays point either into the
+// vectors below (parsed text files) or straight into the mmap-ed
+// binary traces, in which case nothing is copied onto the heap.
+template<typename KeyType>
+struct Workload {
+  size_t num_init;
+  const KeyType *init_keys;
+  const uint64_t *values;   // max(num_init, num_txns) entries
+  size_t num_txns;
+  const KeyType *keys;
+  const uint8_t *ops;       // INSERT = 0, READ = 1, UPDATE = 2, SCAN = 3
+  const int32_t *ranges;
+
+  std::vector<KeyType> init_key_buf;
+  std::vector<KeyType> key_buf;
+  std::vector<uint64_t> value_buf;
+  std::vector<uint8_t> op_buf;
+  std::vector<int32_t> range_buf;
+  TraceFile init_trace;
+  TraceFile txn_trace;
+
+  Workload() : num_init(0), init_keys(NULL), values(NULL), num_txns(0), keys(NULL), ops(NULL), ranges(NULL) {}
+};
+
+// Maps the binary trace that sits next to a text workload file
+// (foo.dat -> foo.trace, see trace_convert). Returns false if there is
+// none; a trace that is malformed or has the wrong key size is fatal.
+template<typename KeyType>
+inline bool map_trace(const std::string &dat_file, TraceFile &trace) {
+  std::string path = dat_file.substr(0, dat_file.rfind('.')) + ".trace";
+  if (access(path.c_str(), R_OK) != 0)
+    return false;
+  if (!trace.open(path.c_str()) || trace.keySize() != sizeof(KeyType)) {
+    std::cout << "BAD TRACE FILE " << path << "\n";
+    exit(1);
+  }
+  return true;
+}
+
+//==============================================================
+// COMMAND LINE OPTIONS
+//==============================================================
+struct BenchOptions {
+  int num_threads;
+  uint32_t latency_sample; // time every N-th op, 0 = off
+  uint32_t report_ms;      // interval report period, 0 = off
+  uint64_t report_ops;     // interval report every N ops, 0 = off
+  std::string report_out;  // interval report file, empty = stderr
+  uint32_t batch;          // READs / load inserts per batch call, <= 1 = off
+  uint32_t coro;           // coroutine lookups in flight per thread, 0 = off
+  uint32_t counters;       // PerfCounters event mask, 0 = off
+  std::string snapshot;    // index snapshot file, empty = off
+  uint32_t bulk_load;      // threads for Index::bulk_load() in place of the insert phase, 0 = off
+  uint32_t merge_threads;  // threads per merge of the hybrid indexes, 0 = index default
+  uint32_t merge_step_us;  // incremental merge step budget of the hybrid indexes, 0 = off
+
+  BenchOptions() : num_threads(1), latency_sample(0), report_ms(0), report_ops(0), batch(0), coro(0), counters(0), bulk_load(0), merge_threads(0), merge_step_us(0) {}
+};
+
+inline void print_options_usage() {
+  std::cout << "options:\n";
+  std::cout << "  --threads N: number of worker threads (default 1)\n";
+  std::cout << "  --latency N: record per-op latency of every N-th operation (default off)\n";
+  std::cout << "  --report-ms N: print a CSV throughput/memory row every N ms (default off)\n";
+  std::cout << "  --report-ops N: print a CSV throughput/memory row every N ops (default off)\n";
+  std::cout << "  --report-out FILE: write the CSV rows to FILE instead of stderr\n";
+  std::cout << "  --batch N: issue up to N consecutive READs (and load inserts) as one batch call (default off)\n";
+  std::cout << "  --coro N: run READs as coroutines, N lookups in flight per thread (max " << CORO_MAX_GROUP << ", default off);\n"
+	    << "          the READs are then replayed with plain find() and as coroutines, and both are printed\n";
+  std::cout << "  --counters LIST: count hardware events per phase and thread; LIST is \"all\" or a comma-separated\n"
+	    << "                   subset of cycles,instructions,llc-misses,dtlb-misses,branch-misses (default off)\n";
+  std::cout << "  --bulk-load N: load the keys with Index::bulk_load() on N threads instead of the insert phase (default off)\n";
+  std::cout << "  --merge-threads N: merge the dynamic part of the hybrid indexes into the static part on N threads (default 1)\n";
+  std::cout << "  --merge-step-us N: merge the hybrid ART indexes in steps of about N microseconds, one per operation,\n"
+	    << "                     instead of all at once (default off)\n";
+  std::cout << "  --snapshot FILE: load the index from FILE instead of running the insert phase; if FILE does\n"
+	    << "                   not exist, run the insert phase and save the index to FILE (default off)\n";
+}
+
+inline bool parse_options(int argc, char *argv[], int first, BenchOptions &opt) {
+  for (int i = first; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      opt.num_threads = atoi(argv[++i]);
+      if (opt.num_threads < 1) {
+	std::cout << "INVALID THREAD NUMBER!\n";
+	return false;
+      }
+    }
+    else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+      opt.latency_sample = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--report-ms") == 0 && i + 1 < argc) {
+      opt.report_ms = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--report-ops") == 0 && i + 1 < argc) {
+      opt.report_ops = strtoull(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--report-out") == 0 && i + 1 < argc) {
+      opt.report_out = argv[++i];
+    }
+    else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+      opt.batch = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--coro") == 0 && i + 1 < argc) {
+      opt.coro = atoi(argv[++i]);
+      if (opt.coro > CORO_MAX_GROUP) {
+	std::cout << "INVALID CORO GROUP SIZE!\n";
+	return false;
+      }
+    }
+    else if (strcmp(argv[i], "--counters") == 0 && i + 1 < argc) {
+      if (!PerfCounters::parse(argv[++i], opt.counters)) {
+	std::cout << "INVALID COUNTER LIST " << argv[i] << "!\n";
+	return false;
+      }
+    }
+    else if (strcmp(argv[i], "--bulk-load") == 0 && i + 1 < argc) {
+      opt.bulk_load = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--merge-threads") == 0 && i + 1 < argc) {
+      opt.merge_threads = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--merge-step-us") == 0 && i + 1 < argc) {
+      opt.merge_step_us = atoi(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+      opt.snapshot = argv[++i];
+    }
+    else {
+      std::cout << "UNRECOGNIZED OPTION " << argv[i] << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+//==============================================================
+// BULK LOAD
+//==============================================================
+// --bulk-load N replaces the insert phase by one Index::bulk_load() call
+// on N threads and prints its rate in Mkeys/sec.
+template<typename KeyType, class KeyComparator>
+inline bool run_bulk_load(Index<KeyType, KeyComparator> *idx, const KeyType *keys, const uint64_t *values, size_t n,
+			  const BenchOptions &opt) {
+  uint64_t start = monotonic_ns();
+  if (!idx->bulk_load(keys, values, n, opt.bulk_load)) {
+    std::cout << "BULK LOAD FAIL!\n";
+    return false;
+  }
+  double sec = (monotonic_ns() - start) / 1000000000.0;
+  std::cout << "bulk load " << n / sec / 1000000 << "\n"; //Mkeys/sec
+  return true;
+}
+
+//==============================================================
+// INDEX SNAPSHOTS
+//==============================================================
+// With --snapshot FILE the insert phase is replaced by Index::load()
+// when FILE exists; otherwise it runs as usual and the index is saved
+// to FILE for the next run.
+inline bool snapshot_exists(const BenchOptions &opt) {
+  return !opt.snapshot.empty() && access(opt.snapshot.c_str(), R_OK) == 0;
+}
+
+template<typename KeyType, class KeyComparator>
+inline bool load_snapshot(Index<KeyType, KeyComparator> *idx, const BenchOptions &opt) {
+  uint64_t start = monotonic_ns();
+  if (!idx->load(opt.snapshot.c_str())) {
+    std::cout << "LOADING SNAPSHOT " << opt.snapshot << " FAIL!\n";
+    return false;
+  }
+  std::cout << "snapshot load " << (monotonic_ns() - start) / 1000000.0 << " ms\n";
+  return true;
+}
+
+template<typename KeyType, class KeyComparator>
+inline void save_snapshot(Index<KeyType, KeyComparator> *idx, const BenchOptions &opt) {
+  uint64_t start = monotonic_ns();
+  if (!idx->save(opt.snapshot.c_str())) {
+    std::cout << "SAVING SNAPSHOT " << opt.snapshot << " FAIL!\n";
+    return;
+  }
+  std::cout << "snapshot save " << (monotonic_ns() - start) / 1000000.0 << " ms\n";
+}
+
+//==============================================================
+// MULTI-THREADED EXECUTION
+//==============================================================
+class ThreadBarrier {
+ public:
+  ThreadBarrier(int n) : threshold(n), waiting(n), generation(0) {}
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mtx);
+    uint64_t gen = generation;
+    if (--waiting == 0) {
+      generation++;
+      waiting = threshold;
+      cv.notify_all();
+    }
+    else {
+      while (gen == generation)
+	cv.wait(lock);
+    }
+  }
+
+ private:
+  std::mutex mtx;
+  std::condition_variable cv;
+  int threshold;
+  int waiting;
+  uint64_t generation;
+};
+
+// Splits [0, total) into num_threads contiguous chunks and runs
+// fn(thread_id, begin, end) on each of them. All workers are released
+// together from a barrier so that thread start-up is not measured.
+// thread_time[i] receives the time worker i spent in fn; the return
+// value is the wall time from release to the last worker finishing.
+// With a single thread fn runs on the calling thread.
+template<typename Fn>
+inline double run_workers(int num_threads, size_t total, Fn fn, std::vector<double> &thread_time) {
+  thread_time.assign(num_threads, 0);
+
+  if (num_threads == 1) {
+    double start_time = get_now();
+    fn(0, (size_t)0, total);
+    thread_time[0] = get_now() - start_time;
+    return thread_time[0];
+  }
+
+  ThreadBarrier barrier(num_threads + 1);
+  std::vector<std::thread> workers;
+  double start_time = 0;
+
+  for (int t = 0; t < num_threads; t++) {
+    size_t begin = total * t / num_threads;
+    size_t end = total * (t + 1) / num_threads;
+    workers.push_back(std::thread([&, t, begin, end]() {
+	  barrier.wait();
+	  double thread_start = get_now();
+	  fn(t, begin, end);
+	  thread_time[t] = get_now() - thread_start;
+	}));
+  }
+
+  start_time = get_now();
+  barrier.wait();
+  for (int t = 0; t < num_threads; t++)
+    workers[t].join();
+
+  return get_now() - start_time;
+}
+
+inline void print_thread_tput(const char *phase, int num_threads, size_t total, std::vector<double> &thread_time) {
+  if (num_threads == 1)
+    return;
+  for (int t = 0; t < num_threads; t++) {
+    size_t count = total * (t + 1) / num_threads - total * t / num_threads;
+    std::cout << "thread " << t << " " << phase << " " << (count / thread_time[t] / 1000000) << "\n";
+  }
+}
+
+// How the READs were issued, so that runs compared against each other
+// can be told apart.
+inline void print_find_mode(const BenchOptions &opt) {
+  if (opt.coro)
+    std::cout << "find mode = coro " << opt.coro << "\n";
+  else if (opt.batch > 1)
+    std::cout << "find mode = batch " << opt.batch << "\n";
+  else
+    std::cout << "find mode = plain\n";
+}
+
+// The paired run of --coro: the READs of the txn phase are looked up
+// again on the same index and threads, once with find() one at a time
+// and once interleaved as coroutines, and both throughputs are printed.
+// Only the READs are replayed, so no write of the phase is applied
+// twice and both passes see the same tree.
+template<typename IndexType, typename KeyType>
+inline void run_coro_pair(IndexType *idx, const KeyType *keys, const uint8_t *ops, size_t n, const BenchOptions &opt) {
+  std::vector<KeyType> reads;
+  for (size_t i = 0; i < n; i++)
+    if (ops[i] == 1)
+      reads.push_back(keys[i]);
+  if (reads.empty())
+    return;
+
+  int num_threads = opt.num_threads;
+  size_t count = reads.size();
+  std::vector<double> thread_time;
+  std::vector<uint64_t> plain_sum(num_threads, 0), coro_sum(num_threads, 0);
+
+  double plain_time = run_workers(num_threads, count, [&](int t, size_t begin, size_t end) {
+      uint64_t sum = 0;
+      for (size_t i = begin; i < end; i++)
+	sum += idx->find(reads[i]);
+      plain_sum[t] = sum;
+    }, thread_time);
+
+  double coro_time = run_workers(num_threads, count, [&](int t, size_t begin, size_t end) {
+      std::vector<uint64_t> out(CORO_RUN);
+      uint64_t sum = 0;
+      for (size_t i = begin; i < end; i += CORO_RUN) {
+	size_t done = std::min(CORO_RUN, end - i);
+	interleave_finds(idx, reads.data() + i, done, opt.coro, out.data());
+	for (size_t j = 0; j < done; j++)
+	  sum += out[j];
+      }
+      coro_sum[t] = sum;
+    }, thread_time);
+
+  uint64_t plain_total = 0, coro_total = 0;
+  for (int t = 0; t < num_threads; t++) {
+    plain_total += plain_sum[t];
+    coro_total += coro_sum[t];
+  }
+  if (plain_total != coro_total)
+    std::cout << "CORO READ MISMATCH!\n";
+
+  double plain_tput = count / plain_time / 1000000;
+  double coro_tput = count / coro_time / 1000000;
+  std::cout << "paired reads = " << count << "\n";
+  std::cout << "read plain " << plain_tput << "\n";
+  std::cout << "read coro " << opt.coro << " " << coro_tput << "\n";
+  std::cout << "coro speedup " << (coro_tput / plain_tput) << "\n";
+}
+
+inline void print_thread_latency(const char *phase, std::vector<LatencyStats> &thread_lat) {
+  if (!thread_lat[0].enabled())
+    return;
+  LatencyStats total = thread_lat[0];
+  for (size_t t = 1; t < thread_lat.size(); t++)
+    total.merge(thread_lat[t]);
+  total.print(phase);
+}
+
+//==============================================================
+// INTERVAL REPORTING
+//==============================================================
+// Samples the workers' progress from a background thread and prints one
+// CSV row per interval:
+//   phase,time_s,ops,interval_ops,interval_mops,memory
+// so that stalls (e.g. hybridART merges) and the memory curve show up
+// over time instead of being averaged into one number. Workers publish
+// their op count with a relaxed store to their own cache line. The
+// memory callback is not called from the reporter thread, which would
+// race with the index: when a row is due the reporter asks for a sample
+// and the next worker to report() takes it between two of its ops, so
+// the callback only has to be safe where the index's own ops are. The
+// last row of a phase is sampled by stop() on the thread that ran it.
+class IntervalReporter {
+ public:
+  IntervalReporter(int n, const BenchOptions &opt)
+    : num_threads(n), interval_ms(opt.report_ms), interval_ops(opt.report_ops),
+      out(NULL), progress(new ThreadProgress[n]), memory_wanted(false),
+      memory_sample(0), final_memory(0), running(false) {
+    if (!enabled())
+      return;
+    if (opt.report_out.empty())
+      out = stderr;
+    else if ((out = fopen(opt.report_out.c_str(), "w")) == NULL) {
+      std::cout << "CANNOT OPEN REPORT FILE " << opt.report_out << "\n";
+      exit(1);
+    }
+    fprintf(out, "phase,time_s,ops,interval_ops,interval_mops,memory\n");
+  }
+
+  ~IntervalReporter() {
+    stop();
+    if (out != NULL && out != stderr)
+      fclose(out);
+    delete[] progress;
+  }
+
+  bool enabled() const {
+    return interval_ms != 0 || interval_ops != 0;
+  }
+
+  inline void report(int thread_id, uint64_t ops_done) {
+    progress[thread_id].ops.store(ops_done, std::memory_order_relaxed);
+    if (memory_wanted.load(std::memory_order_relaxed))
+      sample_memory();
+  }
+
+  void start(const char *phase_name, std::function<int64_t()> memory_fn) {
+    if (!enabled())
+      return;
+    stop();
+    for (int t = 0; t < num_threads; t++)
+      progress[t].ops.store(0, std::memory_order_relaxed);
+    phase = phase_name;
+    memory = memory_fn;
+    memory_wanted.store(false);
+    running = true;
+    reporter = std::thread(&IntervalReporter::run, this);
+  }
+
+  // Prints the final row of the phase and joins the reporter thread.
+  void stop() {
+    if (!running)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      final_memory = memory();
+      running = false;
+    }
+    cv.notify_all();
+    reporter.join();
+  }
+
+ private:
+  struct ThreadProgress {
+    std::atomic<uint64_t> ops;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+
+    ThreadProgress() : ops(0) {}
+  };
+
+  // Called by a worker between its ops when the reporter wants memory.
+  void sample_memory() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!memory_wanted.load(std::memory_order_relaxed))
+      return; // another worker took it
+    memory_sample = memory();
+    memory_wanted.store(false, std::memory_order_relaxed);
+    cv.notify_all();
+  }
+
+  // Waits for a worker to sample the memory, or for stop() if the
+  // workers are done.
+  int64_t wait_memory() {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!running)
+      return final_memory;
+    memory_wanted.store(true, std::memory_order_relaxed);
+    cv.wait(lock, [this] { return !memory_wanted.load(std::memory_order_relaxed) || !running; });
+    if (memory_wanted.load(std::memory_order_relaxed)) {
+      memory_wanted.store(false, std::memory_order_relaxed);
+      return final_memory;
+    }
+    return memory_sample;
+  }
+
+  uint64_t total_ops() const {
+    uint64_t total = 0;
+    for (int t = 0; t < num_threads; t++)
+      total += progress[t].ops.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  void run() {
+    // --report-ops is polled every millisecond
+    uint32_t poll_ms = (interval_ops == 0) ? interval_ms : 1;
+    double start_time = get_now();
+    double last_time = start_time;
+    double next_time = start_time + interval_ms / 1000.0;
+    uint64_t last_ops = 0;
+    uint64_t next_ops = interval_ops;
+    bool stopping = false;
+
+    while (!stopping) {
+      {
+	std::unique_lock<std::mutex> lock(mtx);
+	cv.wait_for(lock, std::chrono::milliseconds(poll_ms), [this] { return !running; });
+	stopping = !running;
+      }
+      double now = get_now();
+      uint64_t ops = total_ops();
+      bool due = stopping
+	|| (interval_ms != 0 && now >= next_time)
+	|| (interval_ops != 0 && ops >= next_ops);
+      if (!due)
+	continue;
+      int64_t mem = wait_memory();
+
+      double mops = (now > last_time) ? (ops - last_ops) / (now - last_time) / 1000000 : 0;
+      fprintf(out, "%s,%.3f,%llu,%llu,%.4f,%lld\n", phase.c_str(), now - start_time,
+	      (unsigned long long)ops, (unsigned long long)(ops - last_ops), mops,
+	      (long long)mem);
+      fflush(out);
+
+      last_time = now;
+      last_ops = ops;
+      if (interval_ms != 0)
+	next_time = now + interval_ms / 1000.0;
+      if (interval_ops != 0)
+	next_ops = (ops / interval_ops + 1) * interval_ops;
+    }
+  }
+
+  int num_threads;
+  uint32_t interval_ms;
+  uint64_t interval_ops;
+  FILE *out;
+  ThreadProgress *progress;
+
+  std::string phase;
+  std::function<int64_t()> memory;
+  std::atomic<bool> memory_wanted;
+  int64_t memory_sample;   // guarded by mtx
+  int64_t final_memory;    // guarded by mtx
+  std::thread reporter;
+  std::mutex mtx;
+  std::condition_variable cv;
+  bool running;
+};
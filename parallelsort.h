@@ -0,0 +1,198 @@
+/*
+  Parallel sort of key/value pairs for Index::bulk_load().
+
+  Keys that order like their bytes (uint64_t as big-endian, GenericKey,
+  NormalizedKey) go through one MSD radix pass: every thread histograms
+  its share of the input on a 16-bit digit, the digits are laid out in
+  order, every thread scatters its share to its own offsets within each
+  digit, and the threads then take the digit buckets one by one and
+  std::stable_sort them. The digit is the two bytes after the prefix that all
+  keys share, found from the smallest and the largest key, so that dense
+  or monotonic keys spread over the buckets as well as random ones.
+  Other keys are sorted in chunks by the threads and merged pairwise.
+  The key types come from indexkey.h, included before this file.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template<typename KeyType>
+struct KeyBytes {
+  static const bool radix = false;
+};
+
+template<>
+struct KeyBytes<uint64_t> {
+  static const bool radix = true;
+  static const unsigned length = 8;
+  static inline uint8_t byte(const uint64_t &key, unsigned i) {
+    return (uint8_t)(key >> (56 - 8 * i));
+  }
+};
+
+template<std::size_t keySize>
+struct KeyBytes<GenericKey<keySize> > {
+  static const bool radix = true;
+  static const unsigned length = keySize;
+  static inline uint8_t byte(const GenericKey<keySize> &key, unsigned i) {
+    return (uint8_t)key.data[i];
+  }
+};
+
+template<std::size_t keySize>
+struct KeyBytes<NormalizedKey<keySize> > {
+  static const bool radix = true;
+  static const unsigned length = keySize;
+  static inline uint8_t byte(const NormalizedKey<keySize> &key, unsigned i) {
+    return (uint8_t)key.data[i];
+  }
+};
+
+// Runs fn(t) for t < num_threads, fn(0) on the calling thread.
+template<typename Fn>
+inline void run_parallel(int num_threads, Fn fn) {
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++)
+    threads.emplace_back(fn, t);
+  fn(0);
+  for (size_t t = 0; t < threads.size(); t++)
+    threads[t].join();
+}
+
+template<typename KeyType, class KeyComparator>
+struct PairLess {
+  KeyComparator less;
+  inline bool operator()(const std::pair<KeyType, uint64_t> &a, const std::pair<KeyType, uint64_t> &b) const {
+    return less(a.first, b.first);
+  }
+};
+
+template<typename KeyType, class KeyComparator>
+void radix_sort_pairs(const KeyType *keys, const uint64_t *values, size_t n, int num_threads,
+		      std::vector<std::pair<KeyType, uint64_t> > &out) {
+  typedef KeyBytes<KeyType> KB;
+  static const unsigned DIGITS = 1 << 16;
+  KeyComparator less;
+
+  // the prefix every key shares ends where the smallest and the largest differ
+  std::vector<size_t> lo(num_threads, 0), hi(num_threads, 0);
+  run_parallel(num_threads, [&](int t) {
+      size_t begin = n * t / num_threads, end = n * (t + 1) / num_threads;
+      if (begin == end)
+	return;
+      lo[t] = hi[t] = begin;
+      for (size_t i = begin + 1; i < end; i++) {
+	if (less(keys[i], keys[lo[t]]))
+	  lo[t] = i;
+	if (less(keys[hi[t]], keys[i]))
+	  hi[t] = i;
+      }
+    });
+  size_t min = lo[num_threads - 1], max = hi[num_threads - 1];
+  for (int t = 0; t < num_threads; t++) {
+    if (n * t / num_threads == n * (t + 1) / num_threads)
+      continue;
+    if (less(keys[lo[t]], keys[min]))
+      min = lo[t];
+    if (less(keys[max], keys[hi[t]]))
+      max = hi[t];
+  }
+  unsigned depth = 0;
+  while (depth < KB::length && KB::byte(keys[min], depth) == KB::byte(keys[max], depth))
+    depth++;
+  auto digit = [depth](const KeyType &key) -> unsigned {
+    unsigned d = (depth < KB::length) ? KB::byte(key, depth) << 8 : 0;
+    if (depth + 1 < KB::length)
+      d |= KB::byte(key, depth + 1);
+    return d;
+  };
+
+  std::vector<std::vector<size_t> > offset(num_threads, std::vector<size_t>(DIGITS, 0));
+  run_parallel(num_threads, [&](int t) {
+      std::vector<size_t> &count = offset[t];
+      for (size_t i = n * t / num_threads; i < n * (t + 1) / num_threads; i++)
+	count[digit(keys[i])]++;
+    });
+  std::vector<size_t> bucket(DIGITS + 1);
+  size_t sum = 0;
+  for (unsigned d = 0; d < DIGITS; d++) {
+    bucket[d] = sum;
+    for (int t = 0; t < num_threads; t++) {
+      size_t c = offset[t][d];
+      offset[t][d] = sum;
+      sum += c;
+    }
+  }
+  bucket[DIGITS] = sum;
+
+  out.resize(n);
+  run_parallel(num_threads, [&](int t) {
+      std::vector<size_t> &pos = offset[t];
+      for (size_t i = n * t / num_threads; i < n * (t + 1) / num_threads; i++)
+	out[pos[digit(keys[i])]++] = std::make_pair(keys[i], values[i]);
+    });
+
+  std::atomic<unsigned> next(0);
+  run_parallel(num_threads, [&](int) {
+      PairLess<KeyType, KeyComparator> pair_less;
+      for (unsigned d = next++; d < DIGITS; d = next++)
+	if (bucket[d + 1] - bucket[d] > 1)
+	  std::stable_sort(out.begin() + bucket[d], out.begin() + bucket[d + 1], pair_less);
+    });
+}
+
+template<typename KeyType, class KeyComparator>
+void merge_sort_pairs(const KeyType *keys, const uint64_t *values, size_t n, int num_threads,
+		      std::vector<std::pair<KeyType, uint64_t> > &out) {
+  out.resize(n);
+  std::vector<size_t> bound(num_threads + 1);
+  for (int t = 0; t <= num_threads; t++)
+    bound[t] = n * t / num_threads;
+  run_parallel(num_threads, [&](int t) {
+      for (size_t i = bound[t]; i < bound[t + 1]; i++)
+	out[i] = std::make_pair(keys[i], values[i]);
+      std::stable_sort(out.begin() + bound[t], out.begin() + bound[t + 1], PairLess<KeyType, KeyComparator>());
+    });
+  // merge neighbouring runs, half as many merges every round
+  for (int width = 1; width < num_threads; width *= 2) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t + width < num_threads; t += 2 * width) {
+      size_t begin = bound[t], mid = bound[t + width], end = bound[std::min(t + 2 * width, num_threads)];
+      threads.emplace_back([&out, begin, mid, end]() {
+	  std::inplace_merge(out.begin() + begin, out.begin() + mid, out.begin() + end,
+			     PairLess<KeyType, KeyComparator>());
+	});
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+      threads[i].join();
+  }
+}
+
+// Fills out with (keys[i], values[i]), i < n, sorted by key on
+// num_threads threads. Of equal keys only the first in the input is
+// kept, as insert() keeps it: the scatter and the merges keep the input
+// order and the sorts are stable.
+template<typename KeyType, class KeyComparator>
+void parallel_sort_pairs(const KeyType *keys, const uint64_t *values, size_t n, int num_threads,
+			 std::vector<std::pair<KeyType, uint64_t> > &out) {
+  out.clear();
+  if (n == 0)
+    return;
+  if (num_threads < 1)
+    num_threads = 1;
+  if constexpr (KeyBytes<KeyType>::radix)
+    radix_sort_pairs<KeyType, KeyComparator>(keys, values, n, num_threads, out);
+  else
+    merge_sort_pairs<KeyType, KeyComparator>(keys, values, n, num_threads, out);
+  KeyComparator less;
+  size_t m = 0;
+  for (size_t i = 0; i < out.size(); i++)
+    if (m == 0 || less(out[m - 1].first, out[i].first))
+      out[m++] = out[i];
+  out.resize(m);
+}
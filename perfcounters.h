@@ -0,0 +1,221 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//==============================================================
+// HARDWARE COUNTERS
+//==============================================================
+// Per-thread hardware event counts through perf_event_open, one set per
+// phase. Every worker opens its own counters on itself (pid 0, any
+// CPU, user space only) when it starts a phase and reads them when it
+// is done, so only the worker's own operations are counted - not the
+// barrier wait, the interval reporter or the other workers. The events
+// are opened separately rather than as a group, so that asking for more
+// of them than the PMU has registers still works; the kernel then
+// multiplexes them and the counts are scaled by enabled/running time.
+class PerfCounters {
+ public:
+  enum { CYCLES = 0, INSTRUCTIONS = 1, LLC_MISSES = 2, DTLB_MISSES = 3, BRANCH_MISSES = 4, NUM_EVENTS = 5 };
+
+  static const char *eventName(int e) {
+    static const char *names[NUM_EVENTS] = {"cycles", "instructions", "llc-misses", "dtlb-misses", "branch-misses"};
+    return names[e];
+  }
+
+  // Turns a comma-separated list of event names (or "all") into an
+  // event mask; false on an unknown name.
+  static bool parse(const char *list, uint32_t &mask) {
+    mask = 0;
+    std::string s(list);
+    size_t pos = 0;
+    while (pos <= s.size()) {
+      size_t comma = s.find(',', pos);
+      if (comma == std::string::npos)
+	comma = s.size();
+      std::string name = s.substr(pos, comma - pos);
+      pos = comma + 1;
+      if (name == "all") {
+	mask = (1u << NUM_EVENTS) - 1;
+	continue;
+      }
+      int e = 0;
+      while (e < NUM_EVENTS && name != eventName(e))
+	e++;
+      if (e == NUM_EVENTS)
+	return false;
+      mask |= 1u << e;
+    }
+    return mask != 0;
+  }
+
+  PerfCounters(int n, uint32_t event_mask) : num_threads(n), mask(event_mask), threads(n) {}
+
+  bool enabled() const {
+    return mask != 0;
+  }
+
+  void clear() {
+    for (int t = 0; t < num_threads; t++)
+      threads[t].clear();
+  }
+
+  // Opens and enables the counters of the calling thread.
+  void start(int thread_id) {
+    if (!enabled())
+      return;
+    ThreadCounters &c = threads[thread_id];
+    for (int e = 0; e < NUM_EVENTS; e++) {
+      if (!(mask & (1u << e)))
+	continue;
+      c.fd[e] = openEvent(e);
+      if (c.fd[e] < 0)
+	c.error[e] = errno;
+    }
+    for (int e = 0; e < NUM_EVENTS; e++)
+      if (c.fd[e] >= 0)
+	ioctl(c.fd[e], PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  // Stops the counters of the calling thread and adds them to its
+  // counts for the phase.
+  void stop(int thread_id) {
+    if (!enabled())
+      return;
+    ThreadCounters &c = threads[thread_id];
+    for (int e = 0; e < NUM_EVENTS; e++)
+      if (c.fd[e] >= 0)
+	ioctl(c.fd[e], PERF_EVENT_IOC_DISABLE, 0);
+    for (int e = 0; e < NUM_EVENTS; e++) {
+      if (c.fd[e] < 0)
+	continue;
+      uint64_t buf[3]; // value, time enabled, time running
+      if (read(c.fd[e], buf, sizeof(buf)) == (ssize_t)sizeof(buf) && buf[2] != 0)
+	c.count[e] += (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+      close(c.fd[e]);
+      c.fd[e] = -1;
+    }
+  }
+
+  // Stops the thread's counters however the worker returns.
+  class Scope {
+   public:
+    Scope(PerfCounters &counters, int t) : pc(counters), thread_id(t) {
+      pc.start(thread_id);
+    }
+    ~Scope() {
+      pc.stop(thread_id);
+    }
+   private:
+    PerfCounters &pc;
+    int thread_id;
+  };
+
+  // Prints every event per operation of the phase (total_ops split over
+  // the threads like run_workers() does), and the IPC if both cycles
+  // and instructions were counted.
+  void print(const char *phase, size_t total_ops) const {
+    if (!enabled())
+      return;
+    ThreadCounters total;
+    for (int t = 0; t < num_threads; t++)
+      total.merge(threads[t]);
+    std::cout << phase << " counters:";
+    printCounts(total, total_ops);
+    if (num_threads == 1)
+      return;
+    for (int t = 0; t < num_threads; t++) {
+      size_t ops = total_ops * (t + 1) / num_threads - total_ops * t / num_threads;
+      std::cout << "thread " << t << " " << phase << " counters:";
+      printCounts(threads[t], ops);
+    }
+  }
+
+ private:
+  struct ThreadCounters {
+    int fd[NUM_EVENTS];
+    int error[NUM_EVENTS];
+    uint64_t count[NUM_EVENTS];
+    char padding[64];
+
+    ThreadCounters() {
+      for (int e = 0; e < NUM_EVENTS; e++)
+	fd[e] = -1;
+      clear();
+    }
+
+    void clear() {
+      for (int e = 0; e < NUM_EVENTS; e++) {
+	error[e] = 0;
+	count[e] = 0;
+      }
+    }
+
+    void merge(const ThreadCounters &other) {
+      for (int e = 0; e < NUM_EVENTS; e++) {
+	count[e] += other.count[e];
+	if (other.error[e])
+	  error[e] = other.error[e];
+      }
+    }
+  };
+
+  int openEvent(int e) const {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (e) {
+    case CYCLES:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case INSTRUCTIONS:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case LLC_MISSES:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case DTLB_MISSES:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_DTLB
+	| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+	| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case BRANCH_MISSES:
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    }
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  void printCounts(const ThreadCounters &c, size_t ops) const {
+    for (int e = 0; e < NUM_EVENTS; e++) {
+      if (!(mask & (1u << e)))
+	continue;
+      std::cout << " " << eventName(e) << "/op ";
+      if (c.error[e])
+	std::cout << "n/a (" << strerror(c.error[e]) << ")";
+      else
+	std::cout << (ops ? (double)c.count[e] / ops : 0);
+    }
+    bool have_ipc = (mask & (1u << CYCLES)) && (mask & (1u << INSTRUCTIONS))
+      && !c.error[CYCLES] && !c.error[INSTRUCTIONS] && c.count[CYCLES] != 0;
+    if (have_ipc)
+      std::cout << " IPC " << (double)c.count[INSTRUCTIONS] / c.count[CYCLES];
+    std::cout << "\n";
+  }
+
+  int num_threads;
+  uint32_t mask;
+  std::vector<ThreadCounters> threads;
+};
@@ -0,0 +1,169 @@
+/*
+  Node pool for the stx::btree based indexes.
+
+  With AllocatorTracker every allocate_leaf()/allocate_inner() is its own
+  malloc, so the nodes of a tree end up spread over the heap. NodePool
+  cuts fixed-size, cache-line-aligned blocks out of 2MB chunks instead:
+  sizes are rounded up to whole cache lines, and every size class keeps
+  a free list, so a freed leaf is reused by the next leaf. With
+  huge_pages the chunks are 2MB aligned and madvise()d as transparent
+  huge pages, one TLB entry per chunk; without it they are marked
+  MADV_NOHUGEPAGE so the comparison is not blurred by THP.
+
+  PoolAllocator is the STL allocator face of a NodePool. Copies and
+  rebinds share the pool, so the leaf and inner node allocators of a
+  tree draw from the same chunks, and the pool lives as long as the
+  last allocator that refers to it. The bytes of every chunk are added
+  to *memory_size when the chunk is taken; freed blocks stay in the
+  pool, so the reported memory never shrinks.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+class NodePool {
+ public:
+  static const size_t CHUNK_SIZE = 2 << 20;
+  static const size_t CLASS_SIZE = 64; // size classes are whole cache lines
+  static const size_t MAX_SIZE = 4096;
+  static const unsigned NUM_CLASSES = MAX_SIZE / CLASS_SIZE + 1;
+
+  NodePool(int64_t* m_ptr, bool huge) : memory_size(m_ptr), huge_pages(huge), cur(NULL), end(NULL) {
+    for (unsigned i = 0; i < NUM_CLASSES; i++)
+      free_list[i] = NULL;
+  }
+
+  ~NodePool() {
+    for (size_t i = 0; i < chunks.size(); i++)
+      free(chunks[i]);
+  }
+
+  inline void* allocate(size_t size) {
+    if (size > MAX_SIZE)
+      return allocateLarge(size);
+    unsigned c = sizeClass(size);
+    void* ptr = free_list[c];
+    if (ptr) {
+      free_list[c] = *(void**)ptr;
+      return ptr;
+    }
+    size_t bytes = c * CLASS_SIZE;
+    if (cur + bytes > end)
+      newChunk();
+    ptr = cur;
+    cur += bytes;
+    return ptr;
+  }
+
+  inline void deallocate(void* ptr, size_t size) {
+    if (size > MAX_SIZE) {
+      free(ptr);
+      *memory_size -= size;
+      return;
+    }
+    unsigned c = sizeClass(size);
+    *(void**)ptr = free_list[c];
+    free_list[c] = ptr;
+  }
+
+  bool hugePages() const {
+    return huge_pages;
+  }
+
+ private:
+  NodePool(const NodePool&);
+  NodePool& operator=(const NodePool&);
+
+  static inline unsigned sizeClass(size_t size) {
+    return (size + CLASS_SIZE - 1) / CLASS_SIZE;
+  }
+
+  void newChunk() {
+    void* ptr = NULL;
+    size_t align = huge_pages ? CHUNK_SIZE : CLASS_SIZE;
+    if (posix_memalign(&ptr, align, CHUNK_SIZE) != 0) {
+      std::cout << "POOL ALLOCATION FAIL!\n";
+      exit(1);
+    }
+    madvise(ptr, CHUNK_SIZE, huge_pages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    chunks.push_back(ptr);
+    cur = (char*)ptr;
+    end = cur + CHUNK_SIZE;
+    *memory_size += CHUNK_SIZE;
+  }
+
+  // blocks above MAX_SIZE bypass the chunks
+  void* allocateLarge(size_t size) {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, CLASS_SIZE, size) != 0) {
+      std::cout << "POOL ALLOCATION FAIL!\n";
+      exit(1);
+    }
+    *memory_size += size;
+    return ptr;
+  }
+
+  int64_t* memory_size;
+  bool huge_pages;
+  std::vector<void*> chunks;
+  char* cur;
+  char* end;
+  void* free_list[NUM_CLASSES];
+};
+
+template<typename ValueType>
+/**
+ * Allocator handing out blocks of a shared NodePool; a drop-in for
+ * AllocatorTracker.
+ */
+class PoolAllocator {
+public:
+  typedef ValueType value_type;
+  typedef ValueType* pointer;
+  typedef const ValueType* const_pointer;
+  typedef ValueType& reference;
+  typedef const ValueType& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  std::shared_ptr<NodePool> pool;
+
+  PoolAllocator() throw() {}
+
+  PoolAllocator(int64_t* m_ptr, bool huge_pages = false)
+    : pool(std::make_shared<NodePool>(m_ptr, huge_pages)) {}
+
+  PoolAllocator(const PoolAllocator& allocator) throw() : pool(allocator.pool) {}
+
+  template <class U> PoolAllocator(const PoolAllocator<U>& allocator) throw() : pool(allocator.pool) {}
+
+  ~PoolAllocator() {}
+
+  template<class U> struct rebind {
+    typedef PoolAllocator<U> other;
+  };
+
+  pointer allocate(size_type size) {
+    return (pointer)pool->allocate(size * sizeof(ValueType));
+  }
+
+  void deallocate(pointer ptr, size_type size) throw() {
+    pool->deallocate(ptr, size * sizeof(ValueType));
+  }
+
+  size_type max_size() const throw() {
+    return size_type(-1) / sizeof(ValueType);
+  }
+
+  template <class U> bool operator==(const PoolAllocator<U>& other) const {
+    return pool == other.pool;
+  }
+
+  template <class U> bool operator!=(const PoolAllocator<U>& other) const {
+    return pool != other.pool;
+  }
+};
@@ -46,6 +46,14 @@
 #include <memory>
 #include <cstddef>
 #include <cassert>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BTREE_SIMD 1
+#endif
 
 // *** Debugging Macros
 
@@ -82,6 +90,200 @@
 /// STX - Some Template Extensions namespace
 namespace stx {
 
+/// Search algorithm used by find_lower() and find_upper() inside a node,
+/// chosen separately for leaves and inner nodes by the traits' leaf_search
+/// and inner_search.
+enum btree_search_mode {
+    /// Scan the keys from the left using the comparator.
+    btree_search_linear,
+    /// Binary search using the comparator.
+    btree_search_binary,
+    /// Compare several keys per instruction, see btree_simd_search. Falls
+    /// back to linear search where that is not available.
+    btree_search_simd
+};
+
+/** Vectorized lower/upper bound in a sorted key array. Only integral keys of
+ * 4 or 8 bytes compared with std::less are supported, see the
+ * specializations below; for everything else enabled is false. */
+template <typename _Key, typename _Compare>
+struct btree_simd_search
+{
+    static const bool enabled = false;
+
+    template <bool _Upper>
+    static int search(const _Key*, int, const _Key&)
+    {
+        return 0;
+    }
+};
+
+#ifdef BTREE_SIMD
+
+/// Instruction set used by btree_simd_search, detected once at run time.
+enum btree_simd_level { btree_simd_none, btree_simd_sse42, btree_simd_avx2 };
+
+inline btree_simd_level btree_simd_detect()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return btree_simd_avx2;
+    if (__builtin_cpu_supports("sse4.2")) return btree_simd_sse42;
+    return btree_simd_none;
+}
+
+inline btree_simd_level btree_simd_detected()
+{
+    static const btree_simd_level level = btree_simd_detect();
+    return level;
+}
+
+/** Vector compares for the integral _Key. search<false> returns the number
+ * of keys less than key, search<true> the number of keys less or equal to
+ * key, i.e. the lower and upper bound in the sorted keys[0..n). Unsigned
+ * keys get their sign bit flipped so that the signed compares apply. The
+ * vector loops stop at the last full vector, the rest is scanned. */
+template <typename _Key, size_t _Size = sizeof(_Key)>
+struct btree_simd_int;
+
+template <typename _Key>
+struct btree_simd_int<_Key, 8>
+{
+    static const long long flip =
+        std::numeric_limits<_Key>::is_signed ? 0 : (long long)(1ULL << 63);
+
+    template <bool _Upper>
+    static int scan(const _Key* keys, int n, int i, const _Key& key)
+    {
+        while (i < n && (_Upper ? !(key < keys[i]) : keys[i] < key)) ++i;
+        return i;
+    }
+
+    template <bool _Upper>
+    __attribute__ ((target("sse4.2")))
+    static int search_sse42(const _Key* keys, int n, const _Key& key)
+    {
+        const __m128i sign = _mm_set1_epi64x(flip);
+        __m128i k = _mm_xor_si128(_mm_set1_epi64x((long long)key), sign);
+        int i = 0;
+        for ( ; i + 2 <= n; i += 2)
+        {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), sign);
+            // lanes before the bound: v < k, or v <= k for the upper bound
+            int before = _mm_movemask_pd(_mm_castsi128_pd(
+                                             _Upper ? _mm_cmpgt_epi64(v, k) : _mm_cmpgt_epi64(k, v)));
+            if (_Upper) before ^= 0x3;
+            if (before != 0x3) return i + __builtin_ctz(~before);
+        }
+        return scan<_Upper>(keys, n, i, key);
+    }
+
+    template <bool _Upper>
+    __attribute__ ((target("avx2")))
+    static int search_avx2(const _Key* keys, int n, const _Key& key)
+    {
+        const __m256i sign = _mm256_set1_epi64x(flip);
+        __m256i k = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), sign);
+        int i = 0;
+        for ( ; i + 4 <= n; i += 4)
+        {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), sign);
+            int before = _mm256_movemask_pd(_mm256_castsi256_pd(
+                                                _Upper ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v)));
+            if (_Upper) before ^= 0xF;
+            if (before != 0xF) return i + __builtin_ctz(~before);
+        }
+        return scan<_Upper>(keys, n, i, key);
+    }
+};
+
+template <typename _Key>
+struct btree_simd_int<_Key, 4>
+{
+    static const int flip =
+        std::numeric_limits<_Key>::is_signed ? 0 : (int)(1U << 31);
+
+    template <bool _Upper>
+    static int scan(const _Key* keys, int n, int i, const _Key& key)
+    {
+        while (i < n && (_Upper ? !(key < keys[i]) : keys[i] < key)) ++i;
+        return i;
+    }
+
+    template <bool _Upper>
+    __attribute__ ((target("sse4.2")))
+    static int search_sse42(const _Key* keys, int n, const _Key& key)
+    {
+        const __m128i sign = _mm_set1_epi32(flip);
+        __m128i k = _mm_xor_si128(_mm_set1_epi32((int)key), sign);
+        int i = 0;
+        for ( ; i + 4 <= n; i += 4)
+        {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), sign);
+            int before = _mm_movemask_ps(_mm_castsi128_ps(
+                                             _Upper ? _mm_cmpgt_epi32(v, k) : _mm_cmpgt_epi32(k, v)));
+            if (_Upper) before ^= 0xF;
+            if (before != 0xF) return i + __builtin_ctz(~before);
+        }
+        return scan<_Upper>(keys, n, i, key);
+    }
+
+    template <bool _Upper>
+    __attribute__ ((target("avx2")))
+    static int search_avx2(const _Key* keys, int n, const _Key& key)
+    {
+        const __m256i sign = _mm256_set1_epi32(flip);
+        __m256i k = _mm256_xor_si256(_mm256_set1_epi32((int)key), sign);
+        int i = 0;
+        for ( ; i + 8 <= n; i += 8)
+        {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), sign);
+            int before = _mm256_movemask_ps(_mm256_castsi256_ps(
+                                                _Upper ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v)));
+            if (_Upper) before ^= 0xFF;
+            if (before != 0xFF) return i + __builtin_ctz(~before);
+        }
+        return scan<_Upper>(keys, n, i, key);
+    }
+};
+
+/// Dispatches to the widest instruction set the CPU supports.
+template <typename _Key>
+struct btree_simd_search_int
+{
+    static const bool enabled = true;
+
+    template <bool _Upper>
+    static int search(const _Key* keys, int n, const _Key& key)
+    {
+        typedef btree_simd_int<_Key> impl;
+        switch (btree_simd_detected())
+        {
+        case btree_simd_avx2:
+            return impl::template search_avx2<_Upper>(keys, n, key);
+        case btree_simd_sse42:
+            return impl::template search_sse42<_Upper>(keys, n, key);
+        default:
+            return impl::template scan<_Upper>(keys, n, 0, key);
+        }
+    }
+};
+
+#define BTREE_SIMD_SEARCH(type)                                         \
+    template <>                                                         \
+    struct btree_simd_search<type, std::less<type> >                    \
+        : public btree_simd_search_int<type> { };
+
+BTREE_SIMD_SEARCH(int)
+BTREE_SIMD_SEARCH(unsigned int)
+BTREE_SIMD_SEARCH(long)
+BTREE_SIMD_SEARCH(unsigned long)
+BTREE_SIMD_SEARCH(long long)
+BTREE_SIMD_SEARCH(unsigned long long)
+
+#undef BTREE_SIMD_SEARCH
+
+#endif // BTREE_SIMD
+
 /** Generates default traits for a B+ tree used as a set. It estimates leaf and
  * inner node sizes by assuming a cache line size of 256 bytes. */
 template <typename _Key>
@@ -106,11 +308,14 @@ public:
     /// has a size of about 256 bytes.
     static const int innerslots = BTREE_MAX(8, 256 / (sizeof(_Key) + sizeof(void*)));
 
-    /// As of stx-btree-0.9, the code does linear search in find_lower() and
-    /// find_upper() instead of binary_search, unless the node size is larger
-    /// than this threshold. See notes at
-    /// http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
-    static const size_t binsearch_threshold = 256;
+    /// Search algorithm of find_lower() and find_upper() in leaves. Linear
+    /// search beats binary search on nodes of a few cache lines, see notes
+    /// at http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
+    /// and SIMD search beats both for integral keys.
+    static const btree_search_mode leaf_search = btree_search_simd;
+
+    /// Search algorithm of find_lower() and find_upper() in inner nodes.
+    static const btree_search_mode inner_search = btree_search_simd;
 };
 
 /** Generates default traits for a B+ tree used as a map. It estimates leaf and
@@ -141,13 +346,14 @@ public:
     static const int innerslots = BTREE_MAX(8, 512 / (sizeof(_Key) + sizeof(void*)));
     //static const int innerslots = BTREE_MAX(8, 4096 / (sizeof(_Key) + sizeof(void*)));
 
-    /// As of stx-btree-0.9, the code does linear search in find_lower() and
-    /// find_upper() instead of binary_search, unless the node size is larger
-    /// than this threshold. See notes at
-    /// http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
-    //static const size_t binsearch_threshold = 256;
-    static const size_t binsearch_threshold = 512;
-    //static const size_t binsearch_threshold = 4096;
+    /// Search algorithm of find_lower() and find_upper() in leaves. Linear
+    /// search beats binary search on nodes of a few cache lines, see notes
+    /// at http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
+    /// and SIMD search beats both for integral keys.
+    static const btree_search_mode leaf_search = btree_search_simd;
+
+    /// Search algorithm of find_lower() and find_upper() in inner nodes.
+    static const btree_search_mode inner_search = btree_search_simd;
 };
 
 /** @brief Basic class implementing a base B+ tree data structure in memory.
@@ -253,6 +459,10 @@ public:
     /// invariants after each insert/erase operation.
     static const bool selfverify = traits::selfverify;
 
+    /// Operational parameter: Number of keys whose searches find_batch()
+    /// interleaves.
+    static const unsigned short batch_group = 16;
+
     /// Debug parameter: Prints out lots of debug information about how the
     /// algorithms change the tree. Requires the header file to be compiled
     /// with BTREE_DEBUG and the key type must be std::ostream printable.
@@ -289,7 +499,7 @@ private:
     struct inner_node : public node
     {
         /// Define an related allocator for the inner_node structs.
-        typedef typename _Alloc::template rebind<inner_node>::other alloc_type;
+        typedef typename std::allocator_traits<_Alloc>::template rebind_alloc<inner_node> alloc_type;
 
         /// Keys of children or data pointers
         key_type slotkey[innerslotmax];
@@ -332,7 +542,7 @@ private:
     struct leaf_node : public node
     {
         /// Define an related allocator for the leaf_node structs.
-        typedef typename _Alloc::template rebind<leaf_node>::other alloc_type;
+        typedef typename std::allocator_traits<_Alloc>::template rebind_alloc<leaf_node> alloc_type;
 
         /// Double linked list pointers to traverse the leaves
         leaf_node * prevleaf;
@@ -1492,14 +1702,14 @@ private:
         if (n->isleafnode()) {
             leaf_node* ln = static_cast<leaf_node*>(n);
             typename leaf_node::alloc_type a(leaf_node_allocator());
-            a.destroy(ln);
+            ln->~leaf_node();
             a.deallocate(ln, 1);
             m_stats.leaves--;
         }
         else {
             inner_node* in = static_cast<inner_node*>(n);
             typename inner_node::alloc_type a(inner_node_allocator());
-            a.destroy(in);
+            in->~inner_node();
             a.deallocate(in, 1);
             m_stats.innernodes--;
         }
@@ -1629,17 +1839,66 @@ public:
         return const_reverse_iterator(begin());
     }
 
+private:
+    // *** Prefetching for Batched Searches
+
+    /// Prefetches the cache lines of a node that a search reads: all of an
+    /// inner node, and the key array of a leaf.
+    inline void prefetch_node(const node* n, bool leaf) const
+    {
+        const char* p = reinterpret_cast<const char*>(n);
+        const char* e = leaf
+                        ? reinterpret_cast<const char*>(static_cast<const leaf_node*>(n)->slotkey + leafslotmax)
+                        : p + sizeof(inner_node);
+
+        for ( ; p < e; p += 64)
+            __builtin_prefetch(p);
+    }
+
 private:
     // *** B+ Tree Node Binary Search Functions
 
+    /// Vectorized search for key_type, if there is one for key_compare.
+    typedef btree_simd_search<key_type, key_compare> simd_search;
+
+    /// Search algorithm configured for leaves.
+    static inline btree_search_mode search_mode(const leaf_node*)
+    {
+        return traits::leaf_search;
+    }
+
+    /// Search algorithm configured for inner nodes.
+    static inline btree_search_mode search_mode(const inner_node*)
+    {
+        return traits::inner_search;
+    }
+
     /// Searches for the first key in the node n greater or equal to key. Uses
-    /// binary search with an optional linear self-verification. This is a
-    /// template function, because the slotkey array is located at different
-    /// places in leaf_node and inner_node.
+    /// linear, binary or SIMD search as the traits configure for the node
+    /// kind, with an optional linear self-verification. This is a template
+    /// function, because the slotkey array is located at different places in
+    /// leaf_node and inner_node.
     template <typename node_type>
     inline int find_lower(const node_type* n, const key_type& key) const
     {
-        if (0 && sizeof(n->slotkey) > traits::binsearch_threshold)
+        if (search_mode(n) == btree_search_simd && simd_search::enabled)
+        {
+            int lo = simd_search::template search<false>(n->slotkey, n->slotuse, key);
+
+            BTREE_PRINT("btree::find_lower: on " << n << " key " << key << " -> " << lo);
+
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_less(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_lower: testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else if (search_mode(n) == btree_search_binary)
         {
             if (n->slotuse == 0) return 0;
 
@@ -1671,7 +1930,7 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // btree_search_linear, or SIMD search is not available
         {
             int lo = 0;
             while (lo < n->slotuse && key_less(n->slotkey[lo], key)) ++lo;
@@ -1679,14 +1938,32 @@ private:
         }
     }
 
-    /// Searches for the first key in the node n greater than key. Uses binary
-    /// search with an optional linear self-verification. This is a template
+    /// Searches for the first key in the node n greater than key. Uses
+    /// linear, binary or SIMD search as the traits configure for the node
+    /// kind, with an optional linear self-verification. This is a template
     /// function, because the slotkey array is located at different places in
     /// leaf_node and inner_node.
     template <typename node_type>
     inline int find_upper(const node_type* n, const key_type& key) const
     {
-        if (0 && sizeof(n->slotkey) > traits::binsearch_threshold)
+        if (search_mode(n) == btree_search_simd && simd_search::enabled)
+        {
+            int lo = simd_search::template search<true>(n->slotkey, n->slotuse, key);
+
+            BTREE_PRINT("btree::find_upper: on " << n << " key " << key << " -> " << lo);
+
+            if (selfverify)
+            {
+                int i = 0;
+                while (i < n->slotuse && key_lessequal(n->slotkey[i], key)) ++i;
+
+                BTREE_PRINT("btree::find_upper testfind: " << i);
+                BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else if (search_mode(n) == btree_search_binary)
         {
             if (n->slotuse == 0) return 0;
 
@@ -1718,7 +1995,7 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // btree_search_linear, or SIMD search is not available
         {
             int lo = 0;
             while (lo < n->slotuse && key_lessequal(n->slotkey[lo], key)) ++lo;
@@ -1822,6 +2099,94 @@ public:
                ? const_iterator(leaf, slot) : end();
     }
 
+    /// Non-STL function locating a batch of keys: out[i] is set to
+    /// find(keys[i]) for i < n. The searches of batch_group keys descend
+    /// the tree level by level in lockstep, and every node of the next
+    /// level is prefetched before any of them is searched, so that the
+    /// cache misses of different keys overlap.
+    void find_batch(const key_type* keys, size_type n, const_iterator* out) const
+    {
+        const node* nodes[batch_group];
+
+        for (size_type b = 0; b < n; b += batch_group)
+        {
+            size_type m = std::min<size_type>(n - b, batch_group);
+
+            if (!m_root) {
+                for (size_type i = 0; i < m; ++i) out[b + i] = end();
+                continue;
+            }
+
+            for (size_type i = 0; i < m; ++i) nodes[i] = m_root;
+
+            // all leaves are on level 0, so the group reaches them together
+            while (!nodes[0]->isleafnode())
+            {
+                bool leaves = (nodes[0]->level == 1);
+                for (size_type i = 0; i < m; ++i)
+                {
+                    const inner_node* inner = static_cast<const inner_node*>(nodes[i]);
+                    int slot = find_lower(inner, keys[b + i]);
+
+                    nodes[i] = inner->childid[slot];
+                    prefetch_node(nodes[i], leaves);
+                }
+            }
+
+            for (size_type i = 0; i < m; ++i)
+            {
+                const leaf_node* leaf = static_cast<const leaf_node*>(nodes[i]);
+                int slot = find_lower(leaf, keys[b + i]);
+
+                out[b + i] = (slot < leaf->slotuse && key_equal(keys[b + i], leaf->slotkey[slot]))
+                             ? const_iterator(leaf, slot) : end();
+            }
+        }
+    }
+
+    /// Position of a find() that find_step() advances one node at a time,
+    /// for callers that interleave many searches themselves.
+    struct find_cursor
+    {
+        /// Node to be searched next, NULL if the tree is empty.
+        const node* n;
+    };
+
+    /// Non-STL function starting a stepwise find() at the root.
+    void find_begin(find_cursor& c) const
+    {
+        c.n = m_root;
+    }
+
+    /// Non-STL function searching the node c points at for key. On an
+    /// inner node c moves to the child, whose cache lines are prefetched,
+    /// and false is returned. Otherwise the search is over, out is set to
+    /// find(key) and true is returned.
+    bool find_step(const key_type& key, find_cursor& c, const_iterator& out) const
+    {
+        if (!c.n) {
+            out = end();
+            return true;
+        }
+
+        if (c.n->isleafnode())
+        {
+            const leaf_node* leaf = static_cast<const leaf_node*>(c.n);
+            int slot = find_lower(leaf, key);
+
+            out = (slot < leaf->slotuse && key_equal(key, leaf->slotkey[slot]))
+                  ? const_iterator(leaf, slot) : end();
+            return true;
+        }
+
+        const inner_node* inner = static_cast<const inner_node*>(c.n);
+        int slot = find_lower(inner, key);
+
+        c.n = inner->childid[slot];
+        prefetch_node(c.n, inner->level == 1);
+        return false;
+    }
+
     /// Tries to locate a key in the B+ tree and returns the number of
     /// identical key entries found.
     size_type count(const key_type& key) const
@@ -2401,8 +2766,11 @@ public:
 
     /// Bulk load a sorted range. Loads items into leaves and constructs a
     /// B-tree above them. The tree must be empty when calling this function.
+    /// The leaves are allocated and linked in order, then num_threads
+    /// threads copy the items into them, each a contiguous run of leaves;
+    /// the inner levels are built on the calling thread.
     template <typename Iterator>
-    void bulk_load(Iterator ibegin, Iterator iend)
+    void bulk_load(Iterator ibegin, Iterator iend, unsigned num_threads = 1)
     {
         BTREE_ASSERT(empty());
 
@@ -2414,17 +2782,17 @@ public:
 
         BTREE_PRINT("btree::bulk_load, level 0: " << m_stats.itemcount << " items into " << num_leaves << " leaves with up to " << ((iend - ibegin + num_leaves - 1) / num_leaves) << " items per leaf.");
 
-        Iterator it = ibegin;
+        // leaf i gets the items from first_item[i] on
+        std::vector<leaf_node*> leaves(num_leaves);
+        std::vector<size_t> first_item(num_leaves);
         for (size_t i = 0; i < num_leaves; ++i)
         {
             // allocate new leaf node
             leaf_node* leaf = allocate_leaf();
 
-            // copy keys or (key,value) pairs into leaf nodes, uses template
-            // switch leaf->set_slot().
             leaf->slotuse = static_cast<int>(num_items / (num_leaves - i));
-            for (size_t s = 0; s < leaf->slotuse; ++s, ++it)
-                leaf->set_slot(s, *it);
+            leaves[i] = leaf;
+            first_item[i] = (iend - ibegin) - num_items;
 
             if (m_tailleaf != NULL) {
                 m_tailleaf->nextleaf = leaf;
@@ -2438,7 +2806,31 @@ public:
             num_items -= leaf->slotuse;
         }
 
-        BTREE_ASSERT(it == iend && num_items == 0);
+        BTREE_ASSERT(num_items == 0);
+
+        // copy keys or (key,value) pairs into leaf nodes, uses template
+        // switch leaf->set_slot().
+        auto fill = [&](unsigned t) {
+            size_t lbegin = num_leaves * t / num_threads, lend = num_leaves * (t + 1) / num_threads;
+            if (lbegin == lend)
+                return;
+            Iterator it = ibegin + first_item[lbegin];
+            for (size_t i = lbegin; i < lend; ++i)
+                for (unsigned short s = 0; s < leaves[i]->slotuse; ++s, ++it)
+                    leaves[i]->set_slot(s, *it);
+        };
+        if (num_threads < 2 || num_leaves < num_threads) {
+            num_threads = 1; // fill() splits the leaves by num_threads
+            fill(0);
+        }
+        else {
+            std::vector<std::thread> threads;
+            for (unsigned t = 1; t < num_threads; ++t)
+                threads.emplace_back(fill, t);
+            fill(0);
+            for (size_t t = 0; t < threads.size(); ++t)
+                threads[t].join();
+        }
 
         // if the btree is so small to fit into one leaf, then we're done.
         if (m_headleaf == m_tailleaf) {
@@ -142,6 +142,10 @@ public:
     /// Operational parameter: Allow duplicate keys in the btree.
     static const bool allow_duplicates = btree_impl::allow_duplicates;
 
+    /// Operational parameter: Number of keys whose searches find_batch()
+    /// interleaves.
+    static const unsigned short batch_group = btree_impl::batch_group;
+
 public:
     // *** Iterators and Reverse Iterators
 
@@ -351,6 +355,29 @@ public:
         return tree.find(key);
     }
 
+    /// Non-STL function locating a batch of keys: out[i] is set to
+    /// find(keys[i]) for i < n, with the searches interleaved.
+    void find_batch(const key_type* keys, size_type n, const_iterator* out) const
+    {
+        tree.find_batch(keys, n, out);
+    }
+
+    /// Position of a stepwise find(), see find_begin() and find_step().
+    typedef typename btree_impl::find_cursor find_cursor;
+
+    /// Non-STL function starting a stepwise find() at the root.
+    void find_begin(find_cursor& c) const
+    {
+        tree.find_begin(c);
+    }
+
+    /// Non-STL function advancing a stepwise find() by one node, with the
+    /// next node prefetched. Returns true once out is set to find(key).
+    bool find_step(const key_type& key, find_cursor& c, const_iterator& out) const
+    {
+        return tree.find_step(key, c, out);
+    }
+
     /// Tries to locate a key in the B+ tree and returns the number of
     /// identical key entries found. Since this is a unique map, count()
     /// returns either 0 or 1.
@@ -522,11 +549,11 @@ public:
 
     /// Bulk load a sorted range [first,last). Loads items into leaves and
     /// constructs a B-tree above them. The tree must be empty when calling
-    /// this function.
+    /// this function. num_threads threads fill the leaves.
     template <typename Iterator>
-    inline void bulk_load(Iterator first, Iterator last)
+    inline void bulk_load(Iterator first, Iterator last, unsigned num_threads = 1)
     {
-        return tree.bulk_load(first, last);
+        return tree.bulk_load(first, last, num_threads);
     }
 
 public:
@@ -0,0 +1,227 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+//==============================================================
+// BINARY TRACE FORMAT
+//==============================================================
+// A workload file converted once from the YCSB text output (see
+// trace_convert.cpp) so that the drivers can mmap it instead of parsing
+// it. Layout, every section 64-byte aligned, native byte order:
+//
+//   TraceHeader
+//   ops[num_ops]              uint8_t, INSERT = 0, READ = 1, UPDATE = 2, SCAN = 3
+//   keys                      key_size bytes per op, or the concatenated
+//                             key bytes if key_size == 0 (variable-length)
+//   key_offsets[num_ops + 1]  uint64_t, only if key_size == 0
+//   ranges[num_ops]           int32_t, scan length (1 for inserts)
+static const char TRACE_MAGIC[8] = {'I', 'M', 'B', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t TRACE_VERSION = 1;
+static const uint64_t TRACE_ALIGN = 64;
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t key_size;
+  uint64_t num_ops;
+  uint64_t ops_offset;
+  uint64_t keys_offset;
+  uint64_t key_offsets_offset;
+  uint64_t ranges_offset;
+  uint64_t file_size;
+};
+
+//==============================================================
+// TRACE FILE (READER)
+//==============================================================
+class TraceFile {
+ public:
+  TraceFile() : base(NULL), length(0), header(NULL) {}
+
+  ~TraceFile() {
+    close();
+  }
+
+  // Maps the whole file read-only. Returns false if it cannot be mapped
+  // or is not a well-formed trace.
+  bool open(const char *path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+      ::close(fd);
+      return false;
+    }
+    length = st.st_size;
+    void *addr = mmap(NULL, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      length = 0;
+      return false;
+    }
+    base = (const char *)addr;
+    header = (const TraceHeader *)base;
+    madvise(addr, length, MADV_SEQUENTIAL);
+    if (!validate()) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    if (base != NULL)
+      munmap((void *)base, length);
+    base = NULL;
+    length = 0;
+    header = NULL;
+  }
+
+  bool isOpen() const {
+    return base != NULL;
+  }
+
+  uint64_t size() const {
+    return header->num_ops;
+  }
+
+  uint32_t keySize() const {
+    return header->key_size;
+  }
+
+  const uint8_t *ops() const {
+    return (const uint8_t *)(base + header->ops_offset);
+  }
+
+  // Fixed-size keys, reinterpreted in place.
+  template<typename KeyType>
+  const KeyType *keys() const {
+    return (const KeyType *)(base + header->keys_offset);
+  }
+
+  // Variable-length keys.
+  const char *key(uint64_t i, uint64_t &len) const {
+    const uint64_t *offsets = (const uint64_t *)(base + header->key_offsets_offset);
+    len = offsets[i + 1] - offsets[i];
+    return base + header->keys_offset + offsets[i];
+  }
+
+  const int32_t *ranges() const {
+    return (const int32_t *)(base + header->ranges_offset);
+  }
+
+ private:
+  TraceFile(const TraceFile &);
+  TraceFile &operator=(const TraceFile &);
+
+  bool validate() const {
+    const TraceHeader *h = header;
+    if (memcmp(h->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 || h->version != TRACE_VERSION)
+      return false;
+    if (h->file_size != length)
+      return false;
+    if (h->ops_offset + h->num_ops > length || h->ranges_offset + h->num_ops * sizeof(int32_t) > length)
+      return false;
+    if (h->key_size != 0)
+      return h->keys_offset + h->num_ops * h->key_size <= length;
+    if (h->key_offsets_offset + (h->num_ops + 1) * sizeof(uint64_t) > length)
+      return false;
+    const uint64_t *offsets = (const uint64_t *)(base + h->key_offsets_offset);
+    return h->keys_offset + offsets[h->num_ops] <= length;
+  }
+
+  const char *base;
+  size_t length;
+  const TraceHeader *header;
+};
+
+//==============================================================
+// TRACE WRITER
+//==============================================================
+// Buffers a trace in memory and writes it out in one go.
+class TraceWriter {
+ public:
+  // key_size == 0 selects variable-length keys.
+  TraceWriter(uint32_t ks) : key_size(ks) {
+    key_offsets.push_back(0);
+  }
+
+  // Fixed-size keys are zero-padded (or truncated) to key_size bytes.
+  void append(uint8_t op, const void *key, size_t len, int32_t range) {
+    ops.push_back(op);
+    if (key_size == 0) {
+      key_bytes.insert(key_bytes.end(), (const char *)key, (const char *)key + len);
+      key_offsets.push_back(key_bytes.size());
+    }
+    else {
+      size_t pos = key_bytes.size();
+      key_bytes.resize(pos + key_size, 0);
+      memcpy(&key_bytes[pos], key, len < key_size ? len : key_size);
+    }
+    ranges.push_back(range);
+  }
+
+  uint64_t size() const {
+    return ops.size();
+  }
+
+  bool write(const char *path) const {
+    TraceHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    h.version = TRACE_VERSION;
+    h.key_size = key_size;
+    h.num_ops = ops.size();
+    uint64_t off = align(sizeof(TraceHeader));
+    h.ops_offset = off;
+    off = align(off + ops.size());
+    h.keys_offset = off;
+    off = align(off + key_bytes.size());
+    if (key_size == 0) {
+      h.key_offsets_offset = off;
+      off = align(off + key_offsets.size() * sizeof(uint64_t));
+    }
+    h.ranges_offset = off;
+    off += ranges.size() * sizeof(int32_t);
+    h.file_size = off;
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+      return false;
+    bool ok = section(f, 0, &h, sizeof(h))
+      && section(f, h.ops_offset, ops.data(), ops.size())
+      && section(f, h.keys_offset, key_bytes.data(), key_bytes.size())
+      && (key_size != 0 || section(f, h.key_offsets_offset, key_offsets.data(), key_offsets.size() * sizeof(uint64_t)))
+      && section(f, h.ranges_offset, ranges.data(), ranges.size() * sizeof(int32_t));
+    return (fclose(f) == 0) && ok;
+  }
+
+ private:
+  static uint64_t align(uint64_t off) {
+    return (off + TRACE_ALIGN - 1) & ~(TRACE_ALIGN - 1);
+  }
+
+  // Zero-fills up to offset, then writes the section.
+  static bool section(FILE *f, uint64_t offset, const void *data, size_t len) {
+    static const char zeros[TRACE_ALIGN] = {0};
+    long pos = ftell(f);
+    if (pos < 0 || (uint64_t)pos > offset)
+      return false;
+    if (fwrite(zeros, 1, offset - pos, f) != offset - pos)
+      return false;
+    return fwrite(data, 1, len, f) == len;
+  }
+
+  uint32_t key_size;
+  std::vector<uint8_t> ops;
+  std::vector<char> key_bytes;
+  std::vector<uint64_t> key_offsets;
+  std::vector<int32_t> ranges;
+};
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <stdlib.h>
+
+#include "trace.h"
+
+//==============================================================
+// Converts a YCSB text workload (workloads/*.dat) into the binary
+// trace format read by the drivers. The drivers pick up foo.trace in
+// place of foo.dat when it exists.
+//==============================================================
+
+static const uint32_t STRING_KEY_SIZE = 31; // GenericKey<31> in workload_string
+
+int main(int argc, char *argv[]) {
+  if (argc != 4) {
+    std::cout << "Usage:\n";
+    std::cout << "1. key type: int, string, var\n";
+    std::cout << "   int = uint64, string = " << STRING_KEY_SIZE << "-byte zero-padded, var = variable-length\n";
+    std::cout << "2. input text workload file\n";
+    std::cout << "3. output trace file\n";
+    return 1;
+  }
+
+  uint32_t key_size;
+  bool int_keys = false;
+  if (strcmp(argv[1], "int") == 0) {
+    key_size = sizeof(uint64_t);
+    int_keys = true;
+  }
+  else if (strcmp(argv[1], "string") == 0)
+    key_size = STRING_KEY_SIZE;
+  else if (strcmp(argv[1], "var") == 0)
+    key_size = 0;
+  else {
+    std::cout << "UNRECOGNIZED KEY TYPE " << argv[1] << "\n";
+    return 1;
+  }
+
+  std::ifstream infile(argv[2]);
+  if (!infile.good()) {
+    std::cout << "CANNOT OPEN " << argv[2] << "\n";
+    return 1;
+  }
+
+  TraceWriter writer(key_size);
+  std::string op;
+  std::string key_str;
+  int32_t range;
+  while (infile >> op >> key_str) {
+    uint8_t op_code;
+    range = 1;
+    if (op == "INSERT")
+      op_code = 0;
+    else if (op == "READ")
+      op_code = 1;
+    else if (op == "UPDATE")
+      op_code = 2;
+    else if (op == "SCAN") {
+      op_code = 3;
+      if (!(infile >> range)) {
+	std::cout << "MISSING SCAN RANGE!\n";
+	return 1;
+      }
+    }
+    else {
+      std::cout << "UNRECOGNIZED CMD " << op << "!\n";
+      return 1;
+    }
+
+    if (int_keys) {
+      uint64_t key = strtoull(key_str.c_str(), NULL, 10);
+      writer.append(op_code, &key, sizeof(key), range);
+    }
+    else if (key_size != 0) {
+      // keep the terminating zero strcmp relies on
+      size_t len = key_str.size() < key_size - 1 ? key_str.size() : key_size - 1;
+      writer.append(op_code, key_str.data(), len, range);
+    }
+    else
+      writer.append(op_code, key_str.data(), key_str.size(), range);
+  }
+
+  if (!writer.write(argv[3])) {
+    std::cout << "WRITING TRACE FILE FAIL!\n";
+    return 1;
+  }
+  std::cout << argv[3] << ": " << writer.size() << " ops\n";
+  return 0;
+}
@@ -1,7 +1,23 @@
 #include "microbench.h"
 
+// VAR_KEYS (workload_string_var) stores the emails as VarKeys instead
+// of zero-padded 31-byte keys, NORM_KEYS (workload_string_norm) as
+// NormalizedKeys compared a word at a time instead of with strcmp, and
+// HEAD_KEYS (workload_string_head) as 16-byte heads plus a pointer
+#if defined(VAR_KEYS)
+typedef VarKey keytype;
+typedef VarKeyComparator keycomp;
+#elif defined(HEAD_KEYS)
+typedef HeadKey<16> keytype;
+typedef HeadKeyComparator<16> keycomp;
+#elif defined(NORM_KEYS)
+typedef NormalizedKey<32> keytype;
+typedef NormalizedComparator<32> keycomp;
+#else
 typedef GenericKey<31> keytype;
 typedef GenericComparator<31> keycomp;
+#endif
+typedef GenericKey<31> tracekey; // traces always hold the 31-byte keys
 
 static const uint64_t key_type=0;
 static const uint64_t value_type=1; // 0 = random pointers, 1 = pointers to keys
@@ -15,6 +31,18 @@ Index<KeyType, KeyComparator> *getInstance(const int type, const uint64_t kt) {
     return new BtreeIndex<KeyType, KeyComparator>(kt);
   else if (type == 1)
     return new ArtIndex_Generic<KeyType, KeyComparator>(kt);
+  else if (type == 2)
+    return new ArtIndex_Generic<KeyType, KeyComparator>(kt, true);
+  else if (type == 3)
+    return new ArtOLCIndex_Generic<KeyType, KeyComparator>(kt);
+  else if (type == 4)
+    return new ArtIndex_Generic<KeyType, KeyComparator>(kt, false, true);
+  else if (type == 5)
+    return new HybridBtreeIndex<KeyType, KeyComparator>(kt);
+  else if (type == 6)
+    return new BtreeIndex<KeyType, KeyComparator, PoolAllocator<std::pair<const KeyType, uint64_t> > >(kt, false);
+  else if (type == 7)
+    return new BtreeIndex<KeyType, KeyComparator, PoolAllocator<std::pair<const KeyType, uint64_t> > >(kt, true);
   else
     return new BtreeIndex<KeyType, KeyComparator>(kt);
 }
@@ -22,7 +50,23 @@ Index<KeyType, KeyComparator> *getInstance(const int type, const uint64_t kt) {
 //==============================================================
 // LOAD
 //==============================================================
-inline void load(int wl, int kt, int index_type, std::vector<keytype> &init_keys, std::vector<keytype> &keys, std::vector<uint64_t> &values, std::vector<int> &ranges, std::vector<int> &ops) {
+// The keys of a trace as keytypes: the mapped keys themselves, or
+// copies of them in buf for the other key types.
+inline const keytype *trace_keys(const tracekey *keys, size_t n, std::vector<keytype> &buf) {
+#if defined(VAR_KEYS) || defined(NORM_KEYS) || defined(HEAD_KEYS)
+  keytype key;
+  buf.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    key.setFromString(std::string(keys[i].data, strnlen(keys[i].data, sizeof(keys[i].data))));
+    buf.push_back(key);
+  }
+  return buf.data();
+#else
+  return keys;
+#endif
+}
+
+inline bool load(int wl, int kt, Workload<keytype> &w) {
   std::string init_file;
   std::string txn_file;
   // 0 = a, 1 = c, 2 = e
@@ -43,9 +87,6 @@ inline void load(int wl, int kt, int index_type, std::vector<keytype> &init_keys
     txn_file = "workloads/email_txnsa_zipf_int_100M.dat";
   }
 
-  std::ifstream infile_load(init_file);
-  std::ifstream infile_txn(txn_file);
-
   std::string op;
   std::string key_str;
   keytype key;
@@ -56,137 +97,125 @@ inline void load(int wl, int kt, int index_type, std::vector<keytype> &init_keys
   std::string update("UPDATE");
   std::string scan("SCAN");
 
-  int count = 0;
-  while ((count < INIT_LIMIT) && infile_load.good()) {
-    infile_load >> op >> key_str;
-    if (op.compare(insert) != 0) {
-      std::cout << "READING LOAD FILE FAIL!\n";
-      return;
+  if (map_trace<tracekey>(init_file, w.init_trace)) {
+    w.num_init = std::min<size_t>(w.init_trace.size(), INIT_LIMIT);
+    w.init_keys = trace_keys(w.init_trace.keys<tracekey>(), w.num_init, w.init_key_buf);
+  }
+  else {
+    std::ifstream infile_load(init_file);
+    int count = 0;
+    while ((count < INIT_LIMIT) && (infile_load >> op >> key_str)) {
+      if (op.compare(insert) != 0) {
+	std::cout << "READING LOAD FILE FAIL!\n";
+	return false;
+      }
+      key.setFromString(key_str);
+      w.init_key_buf.push_back(key);
+      count++;
     }
-    key.setFromString(key_str);
-    init_keys.push_back(key);
-    count++;
+    w.num_init = w.init_key_buf.size();
+    w.init_keys = w.init_key_buf.data();
   }
 
-  count = 0;
-  uint64_t value = 0;
-  void *base_ptr = malloc(8);
-  uint64_t base = (uint64_t)(base_ptr);
-  free(base_ptr);
-
-  keytype *init_keys_data = init_keys.data();
+  if (w.num_init == 0) {
+    std::cout << "READING LOAD FILE FAIL!\n";
+    return false;
+  }
 
-  if (value_type == 0) {
-    while (count < INIT_LIMIT) {
-      value = base + rand();
-      values.push_back(value);
-      count++;
-    }
+  if (map_trace<tracekey>(txn_file, w.txn_trace)) {
+    w.num_txns = std::min<size_t>(w.txn_trace.size(), LIMIT);
+    w.keys = trace_keys(w.txn_trace.keys<tracekey>(), w.num_txns, w.key_buf);
+    w.ops = w.txn_trace.ops();
+    w.ranges = w.txn_trace.ranges();
   }
   else {
-    while (count < INIT_LIMIT) {
-      values.push_back((uint64_t)init_keys_data[count].data);
+    std::ifstream infile_txn(txn_file);
+    int count = 0;
+    while ((count < LIMIT) && (infile_txn >> op >> key_str)) {
+      key.setFromString(key_str);
+      range = 1;
+      if (op.compare(insert) == 0) {
+	w.op_buf.push_back(0);
+      }
+      else if (op.compare(read) == 0) {
+	w.op_buf.push_back(1);
+      }
+      else if (op.compare(update) == 0) {
+	w.op_buf.push_back(2);
+      }
+      else if (op.compare(scan) == 0) {
+	infile_txn >> range;
+	w.op_buf.push_back(3);
+      }
+      else {
+	std::cout << "UNRECOGNIZED CMD!\n";
+	return false;
+      }
+      w.key_buf.push_back(key);
+      w.range_buf.push_back(range);
       count++;
     }
+    w.num_txns = w.op_buf.size();
+    w.keys = w.key_buf.data();
+    w.ops = w.op_buf.data();
+    w.ranges = w.range_buf.data();
   }
 
-  count = 0;
-  while ((count < LIMIT) && infile_txn.good()) {
-    infile_txn >> op >> key_str;
-    key.setFromString(key_str);
-    if (op.compare(insert) == 0) {
-      ops.push_back(0);
-      keys.push_back(key);
-      ranges.push_back(1);
-    }
-    else if (op.compare(read) == 0) {
-      ops.push_back(1);
-      keys.push_back(key);
-    }
-    else if (op.compare(update) == 0) {
-      ops.push_back(2);
-      keys.push_back(key);
-    }
-    else if (op.compare(scan) == 0) {
-      infile_txn >> range;
-      ops.push_back(3);
-      keys.push_back(key);
-      ranges.push_back(range);
-    }
-    else {
-      std::cout << "UNRECOGNIZED CMD!\n";
-      return;
-    }
-    count++;
-  }
+  // txns also take their values by position, so cover both phases
+  size_t num_values = std::max(w.num_init, w.num_txns);
+  void *base_ptr = malloc(8);
+  uint64_t base = (uint64_t)(base_ptr);
+  free(base_ptr);
 
+  w.value_buf.reserve(num_values);
+  if (value_type == 0) {
+    for (size_t i = 0; i < num_values; i++)
+      w.value_buf.push_back(base + rand());
+  }
+  else {
+    for (size_t i = 0; i < num_values; i++)
+      w.value_buf.push_back((uint64_t)w.init_keys[i % w.num_init].data);
+  }
+  w.values = w.value_buf.data();
+  return true;
 }
 
 //==============================================================
 // EXEC
 //==============================================================
-inline void exec(int wl, int index_type, std::vector<keytype> &init_keys, std::vector<keytype> &keys, std::vector<uint64_t> &values, std::vector<int> &ranges, std::vector<int> &ops) {
-
-  Index<keytype, keycomp> *idx = getInstance<keytype, keycomp>(index_type, key_type);
-
-  //WRITE ONLY TEST-----------------
-  int count = 0;
-  double start_time = get_now();
-  while (count < (int)init_keys.size()) {
-    idx->insert(init_keys[count], values[count]);
-    /*
-    if (!idx->insert(init_keys[count], values[count])) {
-      std::cout << "LOAD FAIL!\n";
-      return;
-    }
-    */
-    count++;
-  }
-  double end_time = get_now();
-  double tput = count / (end_time - start_time) / 1000000; //Mops/sec
-
-  std::cout << "insert " << tput << "\n";
-  std::cout << "memory " << (idx->getMemory() / 1000000) << "\n";
+inline bool exec_txns(Index<keytype, keycomp> *idx, const Workload<keytype> &w, size_t begin, size_t end, uint64_t &sum, LatencyStats &lat, IntervalReporter &rep, int thread_id, const BenchOptions &opt) {
+  bool reporting = rep.enabled();
+  const keytype *keys = w.keys;
+  const uint64_t *values = w.values;
+  const int32_t *ranges = w.ranges;
+  const uint8_t *ops = w.ops;
+  // READs per find_batch() / interleave_finds() call
+  size_t batch = opt.coro ? CORO_RUN : opt.batch;
+  std::vector<uint64_t> batch_out(batch > 1 ? batch : 0);
+
+  for (size_t txn_num = begin; txn_num < end; txn_num++) {
+    bool timed = lat.sample();
+    uint64_t op_start = timed ? read_cycles() : 0;
+    size_t done = 1; // ops handled in this iteration
 
-  //idx->merge();
-  std::cout << "static memory " << (idx->getMemory() / 1000000) << "\n\n";
-  //return;
-
-  //READ/UPDATE/SCAN TEST----------------
-  start_time = get_now();
-  int txn_num = 0;
-  uint64_t sum = 0;
-
-#ifdef PAPI_IPC
-  //Variables for PAPI
-  float real_time, proc_time, ipc;
-  long long ins;
-  int retval;
-
-  if((retval = PAPI_ipc(&real_time, &proc_time, &ins, &ipc)) < PAPI_OK) {    
-    printf("PAPI error: retval: %d\n", retval);
-    exit(1);
-  }
-#endif
-
-#ifdef PAPI_CACHE
-  int events[3] = {PAPI_L1_TCM, PAPI_L2_TCM, PAPI_L3_TCM};
-  long long counters[3] = {0, 0, 0};
-  int retval;
-
-  if ((retval = PAPI_start_counters(events, 3)) != PAPI_OK) {
-    fprintf(stderr, "PAPI failed to start counters: %s\n", PAPI_strerror(retval));
-    exit(1);
-  }
-#endif
-
-  while ((txn_num < LIMIT) && (txn_num < (int)ops.size())) {
     if (ops[txn_num] == 0) { //INSERT
       //idx->insert(keys[txn_num] + 1, values[txn_num]);
       idx->insert(keys[txn_num], values[txn_num]);
     }
     else if (ops[txn_num] == 1) { //READ
-      sum += idx->find(keys[txn_num]);
+      if (batch > 1) {
+	// the run of READs starting here, up to batch of them
+	while (done < batch && txn_num + done < end && ops[txn_num + done] == 1)
+	  done++;
+	if (opt.coro)
+	  interleave_finds(idx, keys + txn_num, done, opt.coro, batch_out.data());
+	else
+	  idx->find_batch(keys + txn_num, done, batch_out.data());
+	for (size_t i = 0; i < done; i++)
+	  sum += batch_out[i];
+      }
+      else
+	sum += idx->find(keys[txn_num]);
     }
     else if (ops[txn_num] == 2) { //UPDATE
       //std::cout << "\n=============================================\n";
@@ -200,60 +229,158 @@ inline void exec(int wl, int index_type, std::vector<keytype> &init_keys, std::v
     }
     else {
       std::cout << "UNRECOGNIZED CMD!\n";
-      return;
+      return false;
     }
-    txn_num++;
-  }
 
-#ifdef PAPI_IPC
-  if((retval = PAPI_ipc(&real_time, &proc_time, &ins, &ipc)) < PAPI_OK) {    
-    printf("PAPI error: retval: %d\n", retval);
-    exit(1);
+    if (timed)
+      lat.record(ops[txn_num], (read_cycles() - op_start) / done);
+    txn_num += done - 1;
+    if (reporting)
+      rep.report(thread_id, txn_num - begin + 1);
   }
+  return true;
+}
 
-  std::cout << "Time = " << real_time << "\n";
-  std::cout << "Tput = " << LIMIT/real_time << "\n";
-  std::cout << "Inst = " << ins << "\n";
-  std::cout << "IPC = " << ipc << "\n";
-#endif
+inline void exec(int wl, int index_type, const BenchOptions &opt, const Workload<keytype> &w) {
+  int num_threads = opt.num_threads;
 
-#ifdef PAPI_CACHE
-  if ((retval = PAPI_read_counters(counters, 3)) != PAPI_OK) {
-    fprintf(stderr, "PAPI failed to read counters: %s\n", PAPI_strerror(retval));
-    exit(1);
+  Index<keytype, keycomp> *idx = getInstance<keytype, keycomp>(index_type, key_type);
+
+  if (num_threads > 1 && !idx->isThreadSafe()) {
+    std::cout << "INDEX TYPE IS NOT THREAD-SAFE, --threads " << num_threads << " UNSUPPORTED!\n";
+    return;
   }
+  if (opt.merge_threads)
+    idx->setMergeThreads(opt.merge_threads);
+  if (opt.merge_step_us)
+    idx->setMergeStepBudget(opt.merge_step_us);
+
+  std::vector<double> thread_time;
+  std::vector<char> thread_fail(num_threads, 0);
+  std::vector<LatencyStats> thread_lat(num_threads, LatencyStats(opt.latency_sample));
+  IntervalReporter rep(num_threads, opt);
+  PerfCounters ctr(num_threads, opt.counters);
+  std::function<int64_t()> memory = [idx]() { return idx->getMemory(); };
 
-  std::cout << "L1 miss = " << counters[0] << "\n";
-  std::cout << "L2 miss = " << counters[1] << "\n";
-  std::cout << "L3 miss = " << counters[2] << "\n";
-#endif
+  //WRITE ONLY TEST-----------------
+  bool from_snapshot = snapshot_exists(opt);
+  if (from_snapshot) {
+    if (!load_snapshot(idx, opt))
+      return;
+  }
+  else if (opt.bulk_load) {
+    if (!run_bulk_load(idx, w.init_keys, w.values, w.num_init, opt))
+      return;
+  }
+  else {
+    const keytype *init_keys = w.init_keys;
+    const uint64_t *values = w.values;
+    size_t count = w.num_init;
+    rep.start("insert", memory);
+    double load_time = run_workers(num_threads, count, [&](int t, size_t begin, size_t end) {
+	PerfCounters::Scope counting(ctr, t);
+	LatencyStats &lat = thread_lat[t];
+	bool reporting = rep.enabled();
+	size_t n = 1;
+	for (size_t i = begin; i < end; i += n) {
+	  n = (opt.batch > 1) ? std::min<size_t>(opt.batch, end - i) : 1;
+	  bool timed = lat.sample();
+	  uint64_t op_start = timed ? read_cycles() : 0;
+	  if (n > 1)
+	    idx->insert_batch(init_keys + i, values + i, n);
+	  else
+	    idx->insert(init_keys[i], values[i]);
+	  if (timed)
+	    lat.record(LatencyStats::INSERT, (read_cycles() - op_start) / n);
+	  if (reporting)
+	    rep.report(t, i - begin + n);
+	  /*
+	  if (!idx->insert(init_keys[i], values[i])) {
+	    std::cout << "LOAD FAIL!\n";
+	    return;
+	  }
+	  */
+	}
+      }, thread_time);
+    rep.stop();
+    double tput = count / load_time / 1000000; //Mops/sec
+
+    std::cout << "insert " << tput << "\n";
+    print_thread_tput("insert", num_threads, count, thread_time);
+    print_thread_latency("insert", thread_lat);
+    ctr.print("insert", count);
+  }
+  std::cout << "memory " << (idx->getMemory() / 1000000) << "\n";
+  if (!opt.snapshot.empty() && !from_snapshot)
+    save_snapshot(idx, opt);
+
+  //idx->merge();
+  std::cout << "static memory " << (idx->getMemory() / 1000000) << "\n\n";
+  //return;
+
+  //READ/UPDATE/SCAN TEST----------------
+  for (int t = 0; t < num_threads; t++)
+    thread_lat[t].clear();
+  ctr.clear();
+  size_t txn_num = w.num_txns;
+  if (txn_num > LIMIT)
+    txn_num = LIMIT;
+  std::vector<uint64_t> thread_sum(num_threads, 0);
+  uint64_t sum = 0;
 
-  end_time = get_now();
-  tput = txn_num / (end_time - start_time) / 1000000; //Mops/sec
+  rep.start("txn", memory);
+  double txn_time = run_workers(num_threads, txn_num, [&](int t, size_t begin, size_t end) {
+      PerfCounters::Scope counting(ctr, t);
+      if (!exec_txns(idx, w, begin, end, thread_sum[t], thread_lat[t], rep, t, opt))
+	thread_fail[t] = 1;
+    }, thread_time);
+  rep.stop();
+
+  for (int t = 0; t < num_threads; t++) {
+    if (thread_fail[t])
+      return;
+    sum += thread_sum[t];
+  }
+
+  double tput = txn_num / txn_time / 1000000; //Mops/sec
 
   std::cout << "sum = " << sum << "\n";
+  print_find_mode(opt);
 
   if (wl == 0) {  
     std::cout << "read/update " << (tput + (sum - sum)) << "\n";
+    print_thread_tput("read/update", num_threads, txn_num, thread_time);
   }
   else if (wl == 1) {
     std::cout << "read " << (tput + (sum - sum)) << "\n";
+    print_thread_tput("read", num_threads, txn_num, thread_time);
   }
   else if (wl == 2) {
     std::cout << "insert/scan " << (tput + (sum - sum)) << "\n";
+    print_thread_tput("insert/scan", num_threads, txn_num, thread_time);
   }
   else {
     std::cout << "read/update " << (tput + (sum - sum)) << "\n";
+    print_thread_tput("read/update", num_threads, txn_num, thread_time);
   }
+
+  print_thread_latency("txn", thread_lat);
+  ctr.print("txn", txn_num);
+  if (opt.coro)
+    run_coro_pair(idx, w.keys, w.ops, txn_num, opt);
+  idx->printStats();
 }
 
 int main(int argc, char *argv[]) {
 
-  if (argc != 4) {
+  BenchOptions opt;
+
+  if (argc < 4 || !parse_options(argc, argv, 4, opt)) {
     std::cout << "Usage:\n";
     std::cout << "1. workload type: a, c, e\n";
     std::cout << "2. key distribution: email\n";
-    std::cout << "3. index type: btree, art\n";
+    std::cout << "3. index type: btree, art, art-async, art-olc, art-bloom, btree-hybrid, btree-pool, btree-pool-huge\n";
+    print_options_usage();
     return 1;
   }
 
@@ -281,22 +408,37 @@ int main(int argc, char *argv[]) {
   int index_type = 0;
   // 0 = btree
   // 1 = art
+  // 2 = art-async
+  // 3 = art-olc
+  // 4 = art-bloom
+  // 5 = btree-hybrid
+  // 6 = btree-pool
+  // 7 = btree-pool-huge
   if (strcmp(argv[3], "btree") == 0)
     index_type = 0;
   else if (strcmp(argv[3], "art") == 0)
     index_type = 1;
+  else if (strcmp(argv[3], "art-async") == 0)
+    index_type = 2;
+  else if (strcmp(argv[3], "art-olc") == 0)
+    index_type = 3;
+  else if (strcmp(argv[3], "art-bloom") == 0)
+    index_type = 4;
+  else if (strcmp(argv[3], "btree-hybrid") == 0)
+    index_type = 5;
+  else if (strcmp(argv[3], "btree-pool") == 0)
+    index_type = 6;
+  else if (strcmp(argv[3], "btree-pool-huge") == 0)
+    index_type = 7;
   else
     index_type = 0;
 
-  std::vector<keytype> init_keys;
-  std::vector<keytype> keys;
-  std::vector<uint64_t> values;
-  std::vector<int> ranges;
-  std::vector<int> ops; //INSERT = 0, READ = 1, UPDATE = 2
+  Workload<keytype> w;
 
-  load(wl, kt, index_type, init_keys, keys, values, ranges, ops);
+  if (!load(wl, kt, w))
+    return 1;
 
-  exec(wl, index_type, init_keys, keys, values, ranges, ops);
+  exec(wl, index_type, opt, w);
 
   return 0;
 }
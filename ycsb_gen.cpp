@@ -0,0 +1,754 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "trace.h"
+
+//==============================================================
+// Generates the drivers' workload files without YCSB. Reads a
+// workload_spec/ property file and draws the same operations YCSB's
+// CoreWorkload would (same key hashing, generators and insert key
+// sequence), then writes them as workloads/load_<keytype>_<workload>
+// and workloads/txn_<keytype>_<workload> like gen_workload.py, or as
+// binary traces with --trace.
+//
+// The ops are cut into blocks of BLOCK_OPS, and every block draws from
+// its own random stream seeded by (seed, block), so the output does not
+// depend on the number of threads. Op types are drawn first for all
+// blocks; the insert counts of the blocks before a block then give it
+// the insert key sequence it starts from.
+//==============================================================
+
+static const uint64_t BLOCK_OPS = 1 << 20;
+static const uint32_t STRING_KEY_SIZE = 31; // GenericKey<31> in workload_string
+static const uint32_t INT_KEY_SIZE = sizeof(uint64_t);
+
+enum { OP_INSERT = 0, OP_READ = 1, OP_UPDATE = 2, OP_SCAN = 3, OP_RMW = 4, NUM_OP_KINDS = 5 };
+static const char *op_names[4] = {"INSERT", "READ", "UPDATE", "SCAN"};
+
+//==============================================================
+// PROPERTIES
+//==============================================================
+class Properties {
+ public:
+  bool load(const std::string &path) {
+    std::ifstream in(path.c_str());
+    if (!in.good())
+      return false;
+    std::string line;
+    while (std::getline(in, line))
+      set(line);
+    return true;
+  }
+
+  // "name=value"; comments and lines without '=' are ignored
+  bool set(const std::string &line) {
+    std::string s = trim(line);
+    size_t eq = s.find('=');
+    if (s.empty() || s[0] == '#' || eq == std::string::npos)
+      return false;
+    props[trim(s.substr(0, eq))] = trim(s.substr(eq + 1));
+    return true;
+  }
+
+  std::string get(const std::string &name, const std::string &def) const {
+    std::map<std::string, std::string>::const_iterator it = props.find(name);
+    return (it == props.end()) ? def : it->second;
+  }
+
+  uint64_t getInt(const std::string &name, uint64_t def) const {
+    std::string v = get(name, "");
+    return v.empty() ? def : strtoull(v.c_str(), NULL, 10);
+  }
+
+  double getDouble(const std::string &name, double def) const {
+    std::string v = get(name, "");
+    return v.empty() ? def : strtod(v.c_str(), NULL);
+  }
+
+ private:
+  static std::string trim(const std::string &s) {
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if (b == std::string::npos)
+      return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+  }
+
+  std::map<std::string, std::string> props;
+};
+
+//==============================================================
+// GENERATORS (ports of com.yahoo.ycsb.generator)
+//==============================================================
+typedef std::mt19937_64 Random;
+
+inline double nextDouble(Random &rnd) {
+  return (rnd() >> 11) * (1.0 / (1ull << 53));
+}
+
+// Utils.hash(): FNV-1a over the 8 bytes of the value, made positive
+inline uint64_t fnvhash64(uint64_t val) {
+  int64_t hashval = (int64_t)0xCBF29CE484222325ull;
+  for (int i = 0; i < 8; i++) {
+    int64_t octet = val & 0xff;
+    val >>= 8;
+    hashval ^= octet;
+    hashval = (int64_t)((uint64_t)hashval * 1099511628211ull);
+  }
+  return (uint64_t)(hashval < 0 ? -hashval : hashval);
+}
+
+// sum of 1 / (i + 1)^theta for i in [st, n)
+inline double zeta(uint64_t st, uint64_t n, double theta, double initial) {
+  double sum = initial;
+  for (uint64_t i = st; i < n; i++)
+    sum += 1 / pow(i + 1, theta);
+  return sum;
+}
+
+// zeta(0, n) summed by num_threads threads
+inline double parallel_zeta(uint64_t n, double theta, int num_threads) {
+  std::vector<double> part(num_threads, 0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < num_threads; t++)
+    workers.push_back(std::thread([&, t]() {
+	  part[t] = zeta(n * t / num_threads, n * (t + 1) / num_threads, theta, 0);
+	}));
+  double sum = 0;
+  for (int t = 0; t < num_threads; t++) {
+    workers[t].join();
+    sum += part[t];
+  }
+  return sum;
+}
+
+class ZipfianGenerator {
+ public:
+  static constexpr double ZIPFIAN_CONSTANT = 0.99;
+
+  ZipfianGenerator(uint64_t min, uint64_t max, double zipf_constant, double zetan_value)
+    : items(max - min + 1), base(min), theta(zipf_constant), zetan(zetan_value), countforzeta(items) {
+    alpha = 1.0 / (1.0 - theta);
+    zeta2theta = zeta(0, 2, theta, 0);
+    eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2theta / zetan);
+  }
+
+  // Continues from zetan already summed up to count items.
+  void resume(uint64_t count, double zetan_value) {
+    countforzeta = count;
+    zetan = zetan_value;
+    eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2theta / zetan);
+  }
+
+  // YCSB grows zetan incrementally when itemcount goes up, but keeps
+  // computing eta from the original item count.
+  uint64_t nextLong(uint64_t itemcount, Random &rnd) {
+    if (itemcount > countforzeta) {
+      zetan = zeta(countforzeta, itemcount, theta, zetan);
+      countforzeta = itemcount;
+      eta = (1 - pow(2.0 / items, 1 - theta)) / (1 - zeta2theta / zetan);
+    }
+    double u = nextDouble(rnd);
+    double uz = u * zetan;
+    if (uz < 1.0)
+      return base;
+    if (uz < 1.0 + pow(0.5, theta))
+      return base + 1;
+    return base + (uint64_t)(itemcount * pow(eta * u - eta + 1, alpha));
+  }
+
+  uint64_t nextValue(Random &rnd) {
+    return nextLong(items, rnd);
+  }
+
+ private:
+  uint64_t items;
+  uint64_t base;
+  double theta;
+  double zetan;
+  uint64_t countforzeta;
+  double alpha;
+  double zeta2theta;
+  double eta;
+};
+
+// Zipfian over a huge precomputed item space, hashed into [min, max] so
+// that the popular items are spread out.
+class ScrambledZipfianGenerator {
+ public:
+  static constexpr double ZETAN = 26.46902820178302;
+  static const uint64_t ITEM_COUNT = 10000000000ull;
+
+  ScrambledZipfianGenerator(uint64_t min, uint64_t max)
+    : base(min), itemcount(max - min + 1),
+      gen(0, ITEM_COUNT, ZipfianGenerator::ZIPFIAN_CONSTANT, ZETAN) {}
+
+  uint64_t nextValue(Random &rnd) {
+    return base + fnvhash64(gen.nextValue(rnd)) % itemcount;
+  }
+
+ private:
+  uint64_t base;
+  uint64_t itemcount;
+  ZipfianGenerator gen;
+};
+
+class HotspotGenerator {
+ public:
+  HotspotGenerator(uint64_t lower, uint64_t upper, double hotset_fraction, double hot_opn_fraction)
+    : lower_bound(lower), hot_opn(hot_opn_fraction) {
+    uint64_t interval = upper - lower + 1;
+    hot_interval = (uint64_t)(interval * hotset_fraction);
+    cold_interval = interval - hot_interval;
+  }
+
+  uint64_t nextValue(Random &rnd) {
+    if (nextDouble(rnd) < hot_opn)
+      return lower_bound + (hot_interval ? rnd() % hot_interval : 0);
+    return lower_bound + hot_interval + (cold_interval ? rnd() % cold_interval : 0);
+  }
+
+ private:
+  uint64_t lower_bound;
+  double hot_opn;
+  uint64_t hot_interval;
+  uint64_t cold_interval;
+};
+
+//==============================================================
+// WORKLOAD
+//==============================================================
+struct GenOp {
+  uint8_t op;
+  uint64_t keynum;
+  int32_t range;
+};
+
+struct Spec {
+  uint64_t recordcount;
+  uint64_t operationcount;
+  uint64_t insertstart;
+  bool ordered;
+  double proportion[NUM_OP_KINDS];
+  std::string requestdistribution;
+  uint64_t maxscanlength;
+  std::string scanlengthdistribution;
+  double hotspotdatafraction;
+  double hotspotopnfraction;
+
+  bool init(const Properties &p) {
+    recordcount = p.getInt("recordcount", 0);
+    operationcount = p.getInt("operationcount", 0);
+    insertstart = p.getInt("insertstart", 0);
+    ordered = (p.get("insertorder", "hashed") != "hashed");
+    proportion[OP_READ] = p.getDouble("readproportion", 0.95);
+    proportion[OP_UPDATE] = p.getDouble("updateproportion", 0.05);
+    proportion[OP_INSERT] = p.getDouble("insertproportion", 0);
+    proportion[OP_SCAN] = p.getDouble("scanproportion", 0);
+    proportion[OP_RMW] = p.getDouble("readmodifywriteproportion", 0);
+    requestdistribution = p.get("requestdistribution", "uniform");
+    maxscanlength = p.getInt("maxscanlength", 1000);
+    scanlengthdistribution = p.get("scanlengthdistribution", "uniform");
+    hotspotdatafraction = p.getDouble("hotspotdatafraction", 0.2);
+    hotspotopnfraction = p.getDouble("hotspotopnfraction", 0.8);
+    if (recordcount == 0) {
+      std::cout << "RECORDCOUNT MUST BE > 0!\n";
+      return false;
+    }
+    if (requestdistribution != "uniform" && requestdistribution != "zipfian"
+	&& requestdistribution != "latest" && requestdistribution != "hotspot") {
+      std::cout << "UNSUPPORTED REQUEST DISTRIBUTION " << requestdistribution << "!\n";
+      return false;
+    }
+    if (scanlengthdistribution != "uniform" && scanlengthdistribution != "zipfian") {
+      std::cout << "UNSUPPORTED SCAN LENGTH DISTRIBUTION " << scanlengthdistribution << "!\n";
+      return false;
+    }
+    return true;
+  }
+
+  // DiscreteGenerator in YCSB's order: read, update, insert, scan, rmw
+  int nextOp(Random &rnd) const {
+    static const int order[NUM_OP_KINDS] = {OP_READ, OP_UPDATE, OP_INSERT, OP_SCAN, OP_RMW};
+    double sum = 0;
+    for (int i = 0; i < NUM_OP_KINDS; i++)
+      sum += proportion[i];
+    double val = nextDouble(rnd);
+    int last = OP_READ;
+    for (int i = 0; i < NUM_OP_KINDS; i++) {
+      double w = proportion[order[i]];
+      if (w <= 0)
+	continue;
+      last = order[i];
+      if (val < w / sum)
+	return order[i];
+      val -= w / sum;
+    }
+    return last;
+  }
+};
+
+inline Random block_random(uint64_t seed, uint64_t block, uint64_t pass) {
+  std::seed_seq seq{seed, block, pass};
+  return Random(seq);
+}
+
+// Runs fn(block) for blocks [first, last) on num_threads threads.
+template<typename Fn>
+inline void parallel_blocks(uint64_t first, uint64_t last, int num_threads, Fn fn) {
+  std::vector<std::thread> workers;
+  for (int t = 0; t < num_threads; t++)
+    workers.push_back(std::thread([&, t]() {
+	  for (uint64_t b = first + t; b < last; b += num_threads)
+	    fn(b);
+	}));
+  for (int t = 0; t < num_threads; t++)
+    workers[t].join();
+}
+
+// Draws the transaction ops of one block. next_insert is the first
+// key number the block inserts; everything up to next_insert - 1 has
+// been inserted before. latest_zetan is zeta(0, next_insert - 1) for
+// the "latest" distribution, which like YCSB's SkewedLatestGenerator
+// picks last - Zipfian(last).
+class TxnBlockGenerator {
+ public:
+  TxnBlockGenerator(const Spec &s, uint64_t next_insert_key, double latest_zetan)
+    : spec(s), next_insert(next_insert_key),
+      scrambled(s.insertstart, s.insertstart + s.recordcount + expectedNewKeys(s)),
+      latest(0, initialLast(s) - 1, ZipfianGenerator::ZIPFIAN_CONSTANT, latest_zetan),
+      hotspot(s.insertstart, s.insertstart + s.recordcount - 1, s.hotspotdatafraction, s.hotspotopnfraction),
+      scan_zipf(1, s.maxscanlength, ZipfianGenerator::ZIPFIAN_CONSTANT,
+		zeta(0, s.maxscanlength, ZipfianGenerator::ZIPFIAN_CONSTANT, 0)) {
+    latest.resume(next_insert - 1, latest_zetan);
+  }
+
+  // the last key number of the load phase
+  static uint64_t initialLast(const Spec &s) {
+    return s.insertstart + s.recordcount - 1;
+  }
+
+  static uint64_t expectedNewKeys(const Spec &s) {
+    return (uint64_t)(s.operationcount * s.proportion[OP_INSERT] * 2.0);
+  }
+
+  void generate(const uint8_t *op_kinds, size_t n, Random &rnd, std::vector<GenOp> &out) {
+    for (size_t i = 0; i < n; i++) {
+      GenOp g;
+      g.range = 1;
+      switch (op_kinds[i]) {
+      case OP_INSERT:
+	g.op = OP_INSERT;
+	g.keynum = next_insert++;
+	out.push_back(g);
+	break;
+      case OP_SCAN:
+	g.op = OP_SCAN;
+	g.keynum = nextKeynum(rnd);
+	g.range = (int32_t)nextScanLength(rnd);
+	out.push_back(g);
+	break;
+      case OP_RMW:
+	g.op = OP_READ;
+	g.keynum = nextKeynum(rnd);
+	out.push_back(g);
+	g.op = OP_UPDATE;
+	out.push_back(g);
+	break;
+      default:
+	g.op = op_kinds[i];
+	g.keynum = nextKeynum(rnd);
+	out.push_back(g);
+	break;
+      }
+    }
+  }
+
+ private:
+  // only key numbers that have been inserted already are requested
+  uint64_t nextKeynum(Random &rnd) {
+    uint64_t last = next_insert - 1;
+    const std::string &dist = spec.requestdistribution;
+    if (dist == "latest")
+      return last - latest.nextLong(last, rnd);
+    uint64_t keynum;
+    do {
+      if (dist == "zipfian")
+	keynum = scrambled.nextValue(rnd);
+      else if (dist == "hotspot")
+	keynum = hotspot.nextValue(rnd);
+      else
+	keynum = spec.insertstart + rnd() % spec.recordcount;
+    } while (keynum > last);
+    return keynum;
+  }
+
+  uint64_t nextScanLength(Random &rnd) {
+    if (spec.scanlengthdistribution == "zipfian")
+      return scan_zipf.nextValue(rnd);
+    return 1 + rnd() % spec.maxscanlength;
+  }
+
+  const Spec &spec;
+  uint64_t next_insert;
+  ScrambledZipfianGenerator scrambled;
+  ZipfianGenerator latest;
+  HotspotGenerator hotspot;
+  ZipfianGenerator scan_zipf;
+};
+
+//==============================================================
+// KEY TYPES
+//==============================================================
+// Turns YCSB key numbers into the keys of a key type, the way
+// gen_workload.py does:
+//   randint: the YCSB key (the hashed key number unless insertorder=ordered)
+//   monoint: the position of the key in insert order
+//   email:   an entry of the email list with the host name reversed;
+//            loaded key i is entry i * gap, inserted key j entry j * gap + 1
+class KeyMapper {
+ public:
+  enum { RANDINT, MONOINT, EMAIL };
+
+  KeyMapper(int kt, const Spec &s) : key_type(kt), spec(s), gap(0) {}
+
+  bool loadEmails(const std::string &path) {
+    std::ifstream in(path.c_str());
+    if (!in.good()) {
+      std::cout << "CANNOT OPEN EMAIL LIST " << path << "\n";
+      return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+      emails.push_back(line);
+    gap = emails.size() / spec.recordcount;
+    if (gap == 0) {
+      std::cout << "EMAIL LIST TOO SHORT!\n";
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t keySize() const {
+    return key_type == EMAIL ? STRING_KEY_SIZE : INT_KEY_SIZE;
+  }
+
+  uint64_t intKey(uint64_t keynum) const {
+    if (key_type == MONOINT)
+      return keynum - spec.insertstart;
+    return spec.ordered ? keynum : fnvhash64(keynum);
+  }
+
+  const std::string &emailKey(uint64_t keynum, std::string &buf) const {
+    uint64_t n = keynum - spec.insertstart;
+    uint64_t line = (n < spec.recordcount) ? n * gap : (n - spec.recordcount) * gap + 1;
+    if (line >= emails.size()) {
+      std::cout << "EMAIL LIST TOO SHORT!\n";
+      exit(1);
+    }
+    reverseHostName(emails[line], buf);
+    return buf;
+  }
+
+  // text form of the key, appended to out
+  void appendKey(uint64_t keynum, std::string &out, std::string &buf) const {
+    if (key_type == EMAIL)
+      out += emailKey(keynum, buf);
+    else {
+      char num[24];
+      int len = snprintf(num, sizeof(num), "%llu", (unsigned long long)intKey(keynum));
+      out.append(num, len);
+    }
+  }
+
+  // trace form of the key, keySize() bytes appended to out
+  void appendBinaryKey(uint64_t keynum, std::string &out, std::string &buf) const {
+    if (key_type == EMAIL) {
+      const std::string &key = emailKey(keynum, buf);
+      // keep the terminating zero strcmp relies on
+      size_t len = std::min<size_t>(key.size(), STRING_KEY_SIZE - 1);
+      out.append(key.data(), len);
+      out.append(STRING_KEY_SIZE - len, '\0');
+    }
+    else {
+      uint64_t key = intKey(keynum);
+      out.append((const char *)&key, sizeof(key));
+    }
+  }
+
+ private:
+  // name@mail.example.com -> com.example.mail.@name
+  static void reverseHostName(const std::string &email, std::string &out) {
+    size_t at = email.find('@');
+    std::string name = email.substr(0, at);
+    std::string host = (at == std::string::npos) ? "" : email.substr(at + 1);
+    out.clear();
+    size_t end = host.size();
+    while (true) {
+      size_t dot = host.rfind('.', end == 0 ? std::string::npos : end - 1);
+      size_t begin = (dot == std::string::npos || end == 0) ? 0 : dot + 1;
+      out.append(host, begin, end - begin);
+      out += '.';
+      if (begin == 0)
+	break;
+      end = dot;
+    }
+    if (at != std::string::npos)
+      out += '@';
+    out += name;
+  }
+
+  int key_type;
+  const Spec &spec;
+  std::vector<std::string> emails;
+  uint64_t gap;
+};
+
+//==============================================================
+// OUTPUT
+//==============================================================
+// Writes the ops of consecutive blocks, as text or as a trace.
+class OpWriter {
+ public:
+  OpWriter(const KeyMapper &k, bool as_trace) : keys(k), trace(as_trace), out(NULL), writer(k.keySize()) {}
+
+  bool open(const std::string &path) {
+    file_path = path;
+    if (trace)
+      return true;
+    out = fopen(path.c_str(), "w");
+    return out != NULL;
+  }
+
+  // Formats a block into buf; runs on the worker threads.
+  void format(const std::vector<GenOp> &ops, std::string &buf) const {
+    std::string tmp;
+    buf.clear();
+    for (size_t i = 0; i < ops.size(); i++) {
+      if (trace) {
+	keys.appendBinaryKey(ops[i].keynum, buf, tmp);
+	continue;
+      }
+      buf += op_names[ops[i].op];
+      buf += ' ';
+      keys.appendKey(ops[i].keynum, buf, tmp);
+      if (ops[i].op == OP_SCAN) {
+	char num[16];
+	int len = snprintf(num, sizeof(num), " %d", ops[i].range);
+	buf.append(num, len);
+      }
+      buf += '\n';
+    }
+  }
+
+  bool write(const std::vector<GenOp> &ops, const std::string &buf) {
+    if (!trace)
+      return fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+    uint32_t ks = keys.keySize();
+    for (size_t i = 0; i < ops.size(); i++)
+      writer.append(ops[i].op, buf.data() + i * ks, ks, ops[i].range);
+    return true;
+  }
+
+  bool close() {
+    if (trace)
+      return writer.write(file_path.c_str());
+    return fclose(out) == 0;
+  }
+
+ private:
+  const KeyMapper &keys;
+  bool trace;
+  std::string file_path;
+  FILE *out;
+  TraceWriter writer;
+};
+
+// Generates the blocks [0, num_blocks) round by round, num_threads
+// blocks at a time, and writes them in order.
+template<typename GenFn>
+inline bool generate_file(OpWriter &writer, uint64_t num_blocks, int num_threads, GenFn gen, uint64_t &num_ops) {
+  std::vector<std::vector<GenOp> > ops(num_threads);
+  std::vector<std::string> bufs(num_threads);
+  num_ops = 0;
+  for (uint64_t first = 0; first < num_blocks; first += num_threads) {
+    uint64_t last = std::min<uint64_t>(first + num_threads, num_blocks);
+    parallel_blocks(first, last, num_threads, [&](uint64_t b) {
+	std::vector<GenOp> &block_ops = ops[b - first];
+	block_ops.clear();
+	gen(b, block_ops);
+	writer.format(block_ops, bufs[b - first]);
+      });
+    for (uint64_t b = first; b < last; b++) {
+      if (!writer.write(ops[b - first], bufs[b - first]))
+	return false;
+      num_ops += ops[b - first].size();
+    }
+  }
+  return writer.close();
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cout << "Usage:\n";
+    std::cout << "1. workload spec file name (in workload_spec/)\n";
+    std::cout << "2. key type: randint, monoint, email\n";
+    std::cout << "options:\n";
+    std::cout << "  --threads N: generator threads (default: all cores)\n";
+    std::cout << "  --seed N: random seed (default 0)\n";
+    std::cout << "  --trace: write binary .trace files instead of text\n";
+    std::cout << "  --out DIR: output directory (default workloads/)\n";
+    std::cout << "  --spec-dir DIR: workload spec directory (default workload_spec/)\n";
+    std::cout << "  --email-list FILE: email list for the email key type (default list.txt)\n";
+    std::cout << "  -p NAME=VALUE: override a workload property\n";
+    return 1;
+  }
+
+  std::string workload = argv[1];
+  std::string key_type_name = argv[2];
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t seed = 0;
+  bool trace = false;
+  std::string out_dir = "workloads/";
+  std::string spec_dir = "workload_spec/";
+  std::string email_list = "list.txt";
+  std::vector<std::string> overrides;
+
+  for (int i = 3; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      num_threads = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+      seed = strtoull(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--trace") == 0)
+      trace = true;
+    else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+      out_dir = std::string(argv[++i]) + "/";
+    else if (strcmp(argv[i], "--spec-dir") == 0 && i + 1 < argc)
+      spec_dir = std::string(argv[++i]) + "/";
+    else if (strcmp(argv[i], "--email-list") == 0 && i + 1 < argc)
+      email_list = argv[++i];
+    else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+      overrides.push_back(argv[++i]);
+    else {
+      std::cout << "UNRECOGNIZED OPTION " << argv[i] << "\n";
+      return 1;
+    }
+  }
+
+  int key_type;
+  if (key_type_name == "randint")
+    key_type = KeyMapper::RANDINT;
+  else if (key_type_name == "monoint")
+    key_type = KeyMapper::MONOINT;
+  else if (key_type_name == "email")
+    key_type = KeyMapper::EMAIL;
+  else {
+    std::cout << "UNRECOGNIZED KEY TYPE " << key_type_name << "\n";
+    return 1;
+  }
+
+  Properties props;
+  if (!props.load(spec_dir + workload)) {
+    std::cout << "CANNOT OPEN WORKLOAD SPEC " << spec_dir + workload << "\n";
+    return 1;
+  }
+  for (size_t i = 0; i < overrides.size(); i++)
+    if (!props.set(overrides[i])) {
+      std::cout << "INVALID PROPERTY " << overrides[i] << "\n";
+      return 1;
+    }
+  Spec spec;
+  if (!spec.init(props))
+    return 1;
+
+  KeyMapper keys(key_type, spec);
+  if (key_type == KeyMapper::EMAIL && !keys.loadEmails(email_list))
+    return 1;
+
+  std::cout << "workload = " << workload << "\n";
+  std::cout << "key type = " << key_type_name << "\n";
+
+  std::string suffix = trace ? ".trace" : "";
+  std::string load_path = out_dir + "load_" + key_type_name + "_" + workload + suffix;
+  std::string txn_path = out_dir + "txn_" + key_type_name + "_" + workload + suffix;
+
+  //LOAD----------------
+  OpWriter load_writer(keys, trace);
+  if (!load_writer.open(load_path)) {
+    std::cout << "CANNOT OPEN " << load_path << "\n";
+    return 1;
+  }
+  uint64_t load_blocks = (spec.recordcount + BLOCK_OPS - 1) / BLOCK_OPS;
+  uint64_t num_ops = 0;
+  bool ok = generate_file(load_writer, load_blocks, num_threads, [&](uint64_t b, std::vector<GenOp> &out) {
+      uint64_t end = std::min<uint64_t>((b + 1) * BLOCK_OPS, spec.recordcount);
+      for (uint64_t i = b * BLOCK_OPS; i < end; i++) {
+	GenOp g = {OP_INSERT, spec.insertstart + i, 1};
+	out.push_back(g);
+      }
+    }, num_ops);
+  if (!ok) {
+    std::cout << "WRITING " << load_path << " FAIL!\n";
+    return 1;
+  }
+  std::cout << load_path << ": " << num_ops << " ops\n";
+
+  //TXN----------------
+  // pass 1: op types and the insert key number every block starts from
+  uint64_t txn_blocks = (spec.operationcount + BLOCK_OPS - 1) / BLOCK_OPS;
+  std::vector<uint8_t> op_kinds(spec.operationcount);
+  std::vector<uint64_t> block_inserts(txn_blocks, 0);
+  parallel_blocks(0, txn_blocks, num_threads, [&](uint64_t b) {
+      Random rnd = block_random(seed, b, 0);
+      uint64_t end = std::min<uint64_t>((b + 1) * BLOCK_OPS, spec.operationcount);
+      for (uint64_t i = b * BLOCK_OPS; i < end; i++) {
+	op_kinds[i] = (uint8_t)spec.nextOp(rnd);
+	if (op_kinds[i] == OP_INSERT)
+	  block_inserts[b]++;
+      }
+    });
+
+  std::vector<uint64_t> block_next_insert(txn_blocks);
+  std::vector<double> block_zetan(txn_blocks, 0);
+  uint64_t next_insert = spec.insertstart + spec.recordcount;
+  double zetan = 0;
+  if (spec.requestdistribution == "latest")
+    zetan = parallel_zeta(next_insert - 1, ZipfianGenerator::ZIPFIAN_CONSTANT, num_threads);
+  for (uint64_t b = 0; b < txn_blocks; b++) {
+    if (spec.requestdistribution == "latest" && b > 0)
+      zetan = zeta(block_next_insert[b - 1] - 1, next_insert - 1, ZipfianGenerator::ZIPFIAN_CONSTANT, zetan);
+    block_next_insert[b] = next_insert;
+    block_zetan[b] = zetan;
+    next_insert += block_inserts[b];
+  }
+
+  // pass 2: keys
+  OpWriter txn_writer(keys, trace);
+  if (!txn_writer.open(txn_path)) {
+    std::cout << "CANNOT OPEN " << txn_path << "\n";
+    return 1;
+  }
+  ok = generate_file(txn_writer, txn_blocks, num_threads, [&](uint64_t b, std::vector<GenOp> &out) {
+      Random rnd = block_random(seed, b, 1);
+      TxnBlockGenerator gen(spec, block_next_insert[b], block_zetan[b]);
+      uint64_t begin = b * BLOCK_OPS;
+      uint64_t end = std::min<uint64_t>(begin + BLOCK_OPS, spec.operationcount);
+      gen.generate(&op_kinds[begin], end - begin, rnd, out);
+    }, num_ops);
+  if (!ok) {
+    std::cout << "WRITING " << txn_path << " FAIL!\n";
+    return 1;
+  }
+  std::cout << txn_path << ": " << num_ops << " ops\n";
+  return 0;
+}